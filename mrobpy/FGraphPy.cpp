@@ -24,6 +24,7 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/eigen.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 
 
 #include "mrob/factor_graph_solve.hpp"
@@ -45,6 +46,10 @@
 namespace py = pybind11;
 using namespace mrob;
 
+// Stacked numpy arrays, row-major and contiguous, as Eigen fixed size matrices expect
+typedef py::array_t<matData_t, py::array::c_style | py::array::forcecast> pyArray;
+typedef py::array_t<uint_t, py::array::c_style | py::array::forcecast> pyArrayIds;
+
 
 
 /**
@@ -62,9 +67,18 @@ public:
     FGraphPy() :
         FGraphSolve(FGraphSolve::matrixMethod::ADJ,
                     FGraphSolve::optimMethod::GN) {};
-    id_t add_node_pose_2d(const py::EigenDRef<const Mat31> x)
+    /**
+     * Sets the mode of any node already in the graph, for instance
+     * ANCHOR nodes are kept constant and excluded from the optimization.
+     */
+    void set_node_mode(uint_t nodeId, mrob::Node::nodeMode mode)
+    {
+        this->get_node(nodeId)->set_node_mode(mode);
+    }
+    id_t add_node_pose_2d(const py::EigenDRef<const Mat31> x, mrob::Node::nodeMode mode)
     {
         std::shared_ptr<mrob::Node> n(new mrob::NodePose2d(x));
+        n->set_node_mode(mode);
         this->add_node(n);
         return n->get_id();
     }
@@ -98,9 +112,10 @@ public:
         this->add_node(n);
         return n->get_id();
     }*/
-    id_t add_node_pose_3d(const SE3 &x)
+    id_t add_node_pose_3d(const SE3 &x, mrob::Node::nodeMode mode)
     {
         std::shared_ptr<mrob::Node> n(new mrob::NodePose3d(x));
+        n->set_node_mode(mode);
         this->add_node(n);
         return n->get_id();
     }
@@ -158,6 +173,110 @@ public:
         return f->get_id();
     }
 
+    // Bulk construction: stacked arrays are parsed in a single C++ loop.
+    // Each element is accessed by an Eigen::Map over the numpy buffer, without temporaries.
+    // Information matrices are either stacked (M x D x D) or a single D x D shared by all factors.
+    // There is no reserve of the containers: nodes and factors are stored in a std::deque (see FGraph),
+    // which allocates by blocks and never relocates the elements already inserted, so M insertions
+    // do not copy the graph. The neighbours of each node are already reserved in Node.
+    // ------------------------------------------------------------------------------------
+    py::array_t<id_t> add_nodes_pose_2d(const pyArray &x, mrob::Node::nodeMode mode)
+    {
+        if (x.ndim() != 2 || x.shape(1) != 3)
+            throw std::invalid_argument("FGraph::add_nodes_pose_2d: expected an array Nx3");
+        uint_t N = x.shape(0);
+        py::array_t<id_t> ids(N);
+        auto idsRef = ids.mutable_unchecked<1>();
+        const matData_t *data = x.data();
+        for (uint_t i = 0; i < N; ++i)
+        {
+            std::shared_ptr<mrob::Node> n(new mrob::NodePose2d(Eigen::Map<const Mat31>(data + 3*i)));
+            n->set_node_mode(mode);
+            this->add_node(n);
+            idsRef(i) = n->get_id();
+        }
+        return ids;
+    }
+    py::array_t<id_t> add_nodes_pose_3d(const pyArray &x, mrob::Node::nodeMode mode)
+    {
+        if (x.ndim() != 3 || x.shape(1) != 4 || x.shape(2) != 4)
+            throw std::invalid_argument("FGraph::add_nodes_pose_3d: expected an array Nx4x4");
+        uint_t N = x.shape(0);
+        py::array_t<id_t> ids(N);
+        auto idsRef = ids.mutable_unchecked<1>();
+        const matData_t *data = x.data();
+        for (uint_t i = 0; i < N; ++i)
+        {
+            std::shared_ptr<mrob::Node> n(new mrob::NodePose3d(Mat4(Eigen::Map<const Mat4>(data + 16*i))));
+            n->set_node_mode(mode);
+            this->add_node(n);
+            idsRef(i) = n->get_id();
+        }
+        return ids;
+    }
+    void add_factors_2poses_2d(const pyArray &obs, const pyArrayIds &nodeIds, const pyArray &obsInvCov, bool updateNodeTarget)
+    {
+        if (obs.ndim() != 2 || obs.shape(1) != 3)
+            throw std::invalid_argument("FGraph::add_factors_2poses_2d: expected observations Mx3");
+        uint_t M = obs.shape(0);
+        const uint_t *ids = check_node_ids(nodeIds, M);
+        const matData_t *W = obsInvCov.data();
+        uint_t strideW = check_information(obsInvCov, M, 3);
+        const matData_t *data = obs.data();
+        for (uint_t i = 0; i < M; ++i)
+        {
+            auto nO = this->get_node(ids[2*i]);
+            auto nT = this->get_node(ids[2*i+1]);
+            std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses2d(Eigen::Map<const Mat31>(data + 3*i),
+                    nO, nT, Eigen::Map<const Mat3>(W + strideW*i), updateNodeTarget));
+            this->add_factor(f);
+        }
+    }
+    void add_factors_2poses_3d(const pyArray &obs, const pyArrayIds &nodeIds, const pyArray &obsInvCov, bool updateNodeTarget)
+    {
+        // Observations are either RBT matrices Mx4x4 or their Lie algebra coordinates Mx6
+        bool isLieAlgebra;
+        if (obs.ndim() == 2 && obs.shape(1) == 6)
+            isLieAlgebra = true;
+        else if (obs.ndim() == 3 && obs.shape(1) == 4 && obs.shape(2) == 4)
+            isLieAlgebra = false;
+        else
+            throw std::invalid_argument("FGraph::add_factors_2poses_3d: expected observations Mx4x4 or Mx6");
+        uint_t M = obs.shape(0);
+        const uint_t *ids = check_node_ids(nodeIds, M);
+        const matData_t *W = obsInvCov.data();
+        uint_t strideW = check_information(obsInvCov, M, 6);
+        const matData_t *data = obs.data();
+        for (uint_t i = 0; i < M; ++i)
+        {
+            auto nO = this->get_node(ids[2*i]);
+            auto nT = this->get_node(ids[2*i+1]);
+            SE3 Tobs = isLieAlgebra ? SE3(Mat61(Eigen::Map<const Mat61>(data + 6*i))) :
+                                      SE3(Mat4(Eigen::Map<const Mat4>(data + 16*i)));
+            std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(Tobs, nO, nT,
+                    Eigen::Map<const Mat6>(W + strideW*i), updateNodeTarget));
+            this->add_factor(f);
+        }
+    }
+    void add_factors_1pose_1landmark_3d(const pyArray &obs, const pyArrayIds &nodeIds, const pyArray &obsInvCov, bool initializeLandmark)
+    {
+        if (obs.ndim() != 2 || obs.shape(1) != 3)
+            throw std::invalid_argument("FGraph::add_factors_1pose_1landmark_3d: expected observations Mx3");
+        uint_t M = obs.shape(0);
+        const uint_t *ids = check_node_ids(nodeIds, M);
+        const matData_t *W = obsInvCov.data();
+        uint_t strideW = check_information(obsInvCov, M, 3);
+        const matData_t *data = obs.data();
+        for (uint_t i = 0; i < M; ++i)
+        {
+            auto n1 = this->get_node(ids[2*i]);
+            auto n2 = this->get_node(ids[2*i+1]);
+            std::shared_ptr<mrob::Factor> f(new mrob::Factor1Pose1Landmark3d(Eigen::Map<const Mat31>(data + 3*i),
+                    n1, n2, Eigen::Map<const Mat3>(W + strideW*i), initializeLandmark));
+            this->add_factor(f);
+        }
+    }
+
     // Planes in 4d, i.e. pi = [nx.ny,nz,d] \in P^3
     // There is a problem with scaling of long distances (d->inf n->0), but well, this
     // is not a minimal representation. For finite distances should be fine.
@@ -178,6 +297,85 @@ public:
         return f->get_id();
     }
 
+    // Zero-copy exports: numpy arrays are read-only views on the internal buffers.
+    // They are updated in place on every call. If the number of nodes (or factors) changes,
+    // a new buffer is allocated and the views returned before keep the old values.
+    // ------------------------------------------------------------------------------------
+    py::array get_estimated_state_2d()
+    {
+        auto buffer = this->get_estimated_state_buffer(3);
+        return view_buffer<matData_t>({buffer->rows(), 3},
+                {3*sizeof(matData_t), sizeof(matData_t)}, buffer->data(), buffer);
+    }
+    py::array get_estimated_state_3d()
+    {
+        auto buffer = this->get_estimated_state_buffer(16);
+        return view_buffer<matData_t>({buffer->rows(), 4, 4},
+                {16*sizeof(matData_t), 4*sizeof(matData_t), sizeof(matData_t)}, buffer->data(), buffer);
+    }
+    py::array get_chi2_array_view()
+    {
+        auto buffer = this->get_chi2_buffer();
+        return view_buffer<matData_t>({buffer->rows()}, {sizeof(matData_t)}, buffer->data(), buffer);
+    }
+    /**
+     * Returns the tuple (data, indices, indptr, shape) of the information matrix in
+     * CSC format, as expected by scipy.sparse.csc_matrix(...). The arrays are copies,
+     * since the information matrix is reallocated on every solve.
+     */
+    py::tuple get_information_matrix_csc()
+    {
+        L_.makeCompressed();
+        py::array_t<matData_t> data(L_.nonZeros(), L_.valuePtr());
+        py::array_t<SMatCol::StorageIndex> indices(L_.nonZeros(), L_.innerIndexPtr());
+        py::array_t<SMatCol::StorageIndex> indptr(L_.outerSize() + 1, L_.outerIndexPtr());
+        return py::make_tuple(data, indices, indptr, py::make_tuple(L_.rows(), L_.cols()));
+    }
+
+protected:
+    /**
+     * Creates a read-only numpy array pointing to the memory of a shared buffer. The base
+     * of the array is a capsule owning a reference to the buffer, so the array remains
+     * valid even if the graph reallocates its buffers or is destroyed.
+     */
+    template<typename T, typename Buffer>
+    py::array view_buffer(std::vector<ssize_t> shape, std::vector<ssize_t> strides, const T *ptr,
+            std::shared_ptr<const Buffer> buffer)
+    {
+        py::capsule base(new std::shared_ptr<const Buffer>(buffer),
+                [](void *p) { delete static_cast<std::shared_ptr<const Buffer>*>(p); });
+        py::array_t<T> view(shape, strides, ptr, base);
+        view.attr("setflags")(py::arg("write") = false);
+        return view;
+    }
+    /**
+     * Checks the array of node ids is Mx2 and all ids are already in the graph.
+     * Returns the pointer to the (contiguous) data
+     */
+    const uint_t* check_node_ids(const pyArrayIds &nodeIds, uint_t M)
+    {
+        if (nodeIds.ndim() != 2 || nodeIds.shape(0) != M || nodeIds.shape(1) != 2)
+            throw std::invalid_argument("FGraph: expected an array of node ids Mx2, as many as observations");
+        const uint_t *ids = nodeIds.data();
+        for (uint_t i = 0; i < 2*M; ++i)
+        {
+            if (ids[i] >= this->number_nodes())
+                throw std::out_of_range("FGraph: node id not present in the graph");
+        }
+        return ids;
+    }
+    /**
+     * Checks the information matrices are MxDxD or a single DxD.
+     * Returns the stride between consecutive matrices, 0 if the matrix is shared
+     */
+    uint_t check_information(const pyArray &obsInvCov, uint_t M, uint_t D)
+    {
+        if (obsInvCov.ndim() == 2 && obsInvCov.shape(0) == D && obsInvCov.shape(1) == D)
+            return 0;
+        if (obsInvCov.ndim() == 3 && obsInvCov.shape(0) == M && obsInvCov.shape(1) == D && obsInvCov.shape(2) == D)
+            return D*D;
+        throw std::invalid_argument("FGraph: expected information matrices MxDxD or a single DxD");
+    }
 };
 
 void init_FGraph(py::module &m)
@@ -187,17 +385,24 @@ void init_FGraph(py::module &m)
         .value("LM", FGraphSolve::optimMethod::LM)
         .export_values()
         ;
+    py::enum_<Node::nodeMode>(m, "NodeMode")
+        .value("STANDARD", Node::nodeMode::STANDARD)
+        .value("ANCHOR", Node::nodeMode::ANCHOR)
+        .export_values()
+        ;
     // Fgraph class adding factors and providing method to solve the inference problem.
     py::class_<FGraphPy> (m,"FGraph")
             .def(py::init<>(),
                     "Constructor, solveType default is ADJ and GN.")
             .def("solve", &FGraphSolve::solve,
-                    "Solves the corresponding FG",
+                    "Solves the corresponding FG. The GIL is released, so different FGraph objects can be solved concurrently from python threads",
                     py::arg("method") =  FGraphSolve::optimMethod::GN,
-                    py::arg("maxIters") = 30)
+                    py::arg("maxIters") = 30,
+                    py::call_guard<py::gil_scoped_release>())
             .def("chi2", &FGraphSolve::chi2,
                     "Calculated the chi2 of the problem. By default re-evaluates residuals, set to false if doesn't",
-                    py::arg("evaluateResidualsFlag") = true)
+                    py::arg("evaluateResidualsFlag") = true,
+                    py::call_guard<py::gil_scoped_release>())
             .def("get_estimated_state", &FGraphSolve::get_estimated_state,
                     "returns the list of states ordered according to ids. Some of these elements might be matrices if the are 3D poses")
             .def("get_information_matrix", &FGraphSolve::get_information_matrix,
@@ -206,12 +411,27 @@ void init_FGraph(py::module &m)
             .def("get_chi2_array", &FGraphSolve::get_chi2_array,
                     "Returns the vector of chi2 values for each factor. It requires to be calculated -> solved the problem",
                     py::return_value_policy::copy)
+            .def("get_estimated_state_2d", &FGraphPy::get_estimated_state_2d,
+                    "Returns a read-only array Nx3 with all 2D poses, without copies. It is a view updated on every call while the number of nodes does not change. Other nodes are NaN")
+            .def("get_estimated_state_3d", &FGraphPy::get_estimated_state_3d,
+                    "Returns a read-only array Nx4x4 with all 3D poses, without copies. It is a view updated on every call while the number of nodes does not change. Other nodes are NaN")
+            .def("get_chi2_array_view", &FGraphPy::get_chi2_array_view,
+                    "Same as get_chi2_array, but returns a read-only view updated on every call while the number of factors does not change")
+            .def("get_information_matrix_csc", &FGraphPy::get_information_matrix_csc,
+                    "Returns (data, indices, indptr, shape) of the information matrix in CSC format, e.g. scipy.sparse.csc_matrix((data, indices, indptr), shape). The arrays are copies")
             .def("number_nodes", &FGraphSolve::number_nodes, "Returns the number of nodes")
             .def("number_factors", &FGraphSolve::number_factors, "Returns the number of factors")
             .def("print", &FGraph::print, "By default False: does not print all the information on the Fgraph", py::arg("completePrint") = false)
+            .def("set_node_mode", &FGraphPy::set_node_mode,
+                    "Sets the node mode: STANDARD (optimized) or ANCHOR (kept constant and excluded from the linear system)",
+                    py::arg("nodeId"),
+                    py::arg("mode"))
             // -----------------------------------------------------------------------------
             // Specific call to 2D
-            .def("add_node_pose_2d", &FGraphPy::add_node_pose_2d)
+            .def("add_node_pose_2d", &FGraphPy::add_node_pose_2d,
+                    "Input are 2D poses [x,y,theta]. By default the node is optimized, set mode ANCHOR to keep it constant",
+                    py::arg("x"),
+                    py::arg("mode") = Node::nodeMode::STANDARD)
             .def("add_factor_1pose_2d", &FGraphPy::add_factor_1pose_2d)
             .def("add_factor_2poses_2d", &FGraphPy::add_factor_2poses_2d,
                     "Factors connecting 2 poses. If last input set to true (by default false), also updates the value of the target Node according to the new obs + origin node",
@@ -221,6 +441,16 @@ void init_FGraph(py::module &m)
                     py::arg("obsInvCov"),
                     py::arg("updateNodeTarget") = false)
             .def("add_factor_2poses_2d_odom", &FGraphPy::add_factor_2poses_2d_odom)
+            .def("add_nodes_pose_2d", &FGraphPy::add_nodes_pose_2d,
+                    "Bulk version of add_node_pose_2d. Input is an array Nx3, returns the array of node ids",
+                    py::arg("x"),
+                    py::arg("mode") = Node::nodeMode::STANDARD)
+            .def("add_factors_2poses_2d", &FGraphPy::add_factors_2poses_2d,
+                    "Bulk version of add_factor_2poses_2d. Inputs are observations Mx3, node ids Mx2 (origin, target) and information Mx3x3 or a single 3x3",
+                    py::arg("obs"),
+                    py::arg("nodeIds"),
+                    py::arg("obsInvCov"),
+                    py::arg("updateNodeTarget") = false)
             // 2d Landmkarks
             .def("add_node_landmark_2d", &FGraphPy::add_node_landmark_2d,
                     "Ladmarks are 2D points, in [x,y]")
@@ -234,7 +464,9 @@ void init_FGraph(py::module &m)
             // -----------------------------------------------------------------------------
             // Specific call to 3D
             .def("add_node_pose_3d", &FGraphPy::add_node_pose_3d,
-                    "Input are 3D poses, as Lie Algebra of RBT around the Identity")
+                    "Input are 3D poses, as Lie Algebra of RBT around the Identity. By default the node is optimized, set mode ANCHOR to keep it constant",
+                    py::arg("x"),
+                    py::arg("mode") = Node::nodeMode::STANDARD)
             .def("add_factor_1pose_3d", &FGraphPy::add_factor_1pose_3d)
             .def("add_factor_2poses_3d", &FGraphPy::add_factor_2poses_3d,
                             "Factors connecting 2 poses. If last input set to true (by default false), also updates the value of the target Node according to the new obs + origin node",
@@ -243,6 +475,16 @@ void init_FGraph(py::module &m)
                             py::arg("nodeTargetId"),
                             py::arg("obsInvCov"),
                             py::arg("updateNodeTarget") = false)
+            .def("add_nodes_pose_3d", &FGraphPy::add_nodes_pose_3d,
+                    "Bulk version of add_node_pose_3d. Input is an array of RBT Nx4x4, returns the array of node ids",
+                    py::arg("x"),
+                    py::arg("mode") = Node::nodeMode::STANDARD)
+            .def("add_factors_2poses_3d", &FGraphPy::add_factors_2poses_3d,
+                    "Bulk version of add_factor_2poses_3d. Inputs are observations Mx4x4 (RBT) or Mx6 (Lie algebra), node ids Mx2 (origin, target) and information Mx6x6 or a single 6x6",
+                    py::arg("obs"),
+                    py::arg("nodeIds"),
+                    py::arg("obsInvCov"),
+                    py::arg("updateNodeTarget") = false)
             // -----------------------------------------------------------------------------
             // Landmark or Point 3D
             .def("add_node_landmark_3d", &FGraphPy::add_node_landmark_3d,
@@ -254,6 +496,12 @@ void init_FGraph(py::module &m)
                             py::arg("nodeLandmarkId"),
                             py::arg("obsInvCov"),
                             py::arg("initializeLandmark") = false)
+            .def("add_factors_1pose_1landmark_3d", &FGraphPy::add_factors_1pose_1landmark_3d,
+                            "Bulk version of add_factor_1pose_1landmark_3d. Inputs are observations Mx3, node ids Mx2 (pose, landmark) and information Mx3x3 or a single 3x3",
+                            py::arg("obs"),
+                            py::arg("nodeIds"),
+                            py::arg("obsInvCov"),
+                            py::arg("initializeLandmark") = false)
             // -----------------------------------------------------------------------------
             // Plane 4d Landmark to Pose 3D
             .def("add_node_plane_4d", &FGraphPy::add_node_plane_4d,
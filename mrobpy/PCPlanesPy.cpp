@@ -35,6 +35,8 @@ namespace py = pybind11;
 #include "mrob/plane.hpp"
 #include "mrob/create_points.hpp"
 #include "mrob/plane_registration.hpp"
+#include "mrob/plane_odometry.hpp"
+#include "mrob/plane_segmentation.hpp"
 
 
 using namespace mrob;
@@ -57,6 +59,13 @@ void init_PCPlanes(py::module &m)
         .value("GN_CLAMPED_HESSIAN", PlaneRegistration::SolveMode::GN_CLAMPED_HESSIAN)
         .value("LM_SPHER", PlaneRegistration::SolveMode::LM_SPHER)
         .value("LM_ELLIP", PlaneRegistration::SolveMode::LM_ELLIP)
+        .value("GRADIENT_LBFGS", PlaneRegistration::SolveMode::GRADIENT_LBFGS)
+        .value("GRADIENT_CG", PlaneRegistration::SolveMode::GRADIENT_CG)
+        .export_values()
+        ;
+    py::enum_<Plane::pointsMode>(m, "PointsMode")
+        .value("STORE_POINTS", Plane::pointsMode::STORE_POINTS)
+        .value("SUFFICIENT_STATISTICS", Plane::pointsMode::SUFFICIENT_STATISTICS)
         .export_values()
         ;
 	// This class creates a synthetic testing
@@ -82,27 +91,75 @@ void init_PCPlanes(py::module &m)
                     "resets the current solution and maintains the data from planes (PC)")
             .def("solve", &PlaneRegistration::solve,
                     py::arg("mode") = PlaneRegistration::SolveMode::GRADIENT_BENGIOS_NAG,
-                    py::arg("singleIteration") = false)
+                    py::arg("singleIteration") = false,
+                    py::call_guard<py::gil_scoped_release>())
             .def("print", &PlaneRegistration::print,
                     py::arg("plotPlanes") =  false)
             .def("print_evaluate", &PlaneRegistration::print_evaluate,
                     "returns: current error,1) number of iters, 2) determinant 3) number of negative eigenvalues 4) conditioning number",
-                    py::return_value_policy::copy)
+                    py::return_value_policy::copy,
+                    py::call_guard<py::gil_scoped_release>())
 			// TODO add methods to fill in the data structure more properly, now it is a reference pass by sharing the smart pointer
             .def("get_point_cloud", &PlaneRegistration::get_point_cloud,
                     "Gets the point cloud at input time index")
             .def("get_number_poses", &PlaneRegistration::get_number_poses)
             .def("get_trajectory", &PlaneRegistration::get_trajectory)
             .def("get_last_pose", &PlaneRegistration::get_last_pose)
+            .def("add_pose", &PlaneRegistration::add_pose,
+                    "appends a new pose (SE3) at the end of the trajectory and returns its time index")
             .def("add_plane", &PlaneRegistration::add_new_plane,
                     "input plane id (any integer and plane data structure")
             .def("plane_push_back_point", &PlaneRegistration::plane_push_back_point,
                     "input plane id and time id and 3 vector point")
+            .def("plane_push_back_points", &PlaneRegistration::plane_push_back_points,
+                    "input plane id, time id and a N x 3 array of points",
+                    py::arg("id"), py::arg("t"), py::arg("points"),
+                    py::call_guard<py::gil_scoped_release>())
+            .def("set_points_mode", &PlaneRegistration::set_points_mode,
+                    "sets how new planes keep their points: STORE_POINTS or SUFFICIENT_STATISTICS (only S matrices, no points)")
             .def("get_error", &PlaneRegistration::get_current_error,
-                    "get current error in plane estimation")
+                    "get current error in plane estimation",
+                    py::call_guard<py::gil_scoped_release>())
             .def("get_plane_error", &PlaneRegistration::get_current_error,
-                    "input plane id (any integer and plane data structure")
+                    "input plane id (any integer and plane data structure",
+                    py::call_guard<py::gil_scoped_release>())
+            .def("add_planes_matrix_S", &PlaneRegistration::add_planes_matrix_S,
+                    "input time id, list of plane ids and list of their 4x4 matrices S (see PlaneSegmentation)")
             .def("initialize_last_pose_solution", &PlaneRegistration::set_last_pose,
                     "initializes the solution for some final input plane id (any integer and plane data structure")
             ;
+    py::class_<PlaneSegmentation>(m,"PlaneSegmentation")
+            .def(py::init<double, double, double, uint_t, uint_t>(),
+                    "Constructor, input voxel size, max distance to the plane, max angle between normals [rad], "
+                    "min number of points on a voxel and min number of points on a plane",
+                    py::arg("voxelSize") = 0.5,
+                    py::arg("maxDistance") = 0.05,
+                    py::arg("maxAngle") = 0.17,
+                    py::arg("minPointsVoxel") = 10,
+                    py::arg("minPointsPlane") = 100)
+            .def("segment", &PlaneSegmentation::segment,
+                    "input a N x 3 array of points. Returns the number of planes",
+                    py::call_guard<py::gil_scoped_release>())
+            .def("get_number_planes", &PlaneSegmentation::get_number_planes)
+            .def("get_point_ids", &PlaneSegmentation::get_point_ids,
+                    "plane id of each point, NO_PLANE if the point does not belong to any plane")
+            .def("get_matrices_S", &PlaneSegmentation::get_matrices_S)
+            .def("get_planes", &PlaneSegmentation::get_planes)
+            .def_readonly_static("NO_PLANE", &PlaneSegmentation::NO_PLANE)
+            ;
+    py::class_<PlaneOdometry>(m,"PlaneOdometry")
+            .def(py::init<uint_t, Plane::pointsMode>(),
+                    "Constructor, input window size (number of poses) and points mode",
+                    py::arg("windowSize") = 5,
+                    py::arg("mode") = Plane::pointsMode::SUFFICIENT_STATISTICS)
+            .def("add_scan", &PlaneOdometry::add_scan,
+                    "input a N x 3 array of points and a list of N plane ids. Returns the estimated pose of the scan",
+                    py::arg("points"), py::arg("planeIds"),
+                    py::call_guard<py::gil_scoped_release>())
+            .def("get_number_poses", &PlaneOdometry::get_number_poses)
+            .def("get_pose", &PlaneOdometry::get_pose)
+            .def("get_trajectory", &PlaneOdometry::get_trajectory)
+            .def("get_number_active_planes", &PlaneOdometry::get_number_active_planes)
+            .def("get_number_planes", &PlaneOdometry::get_number_planes)
+            ;
 }
@@ -29,11 +29,15 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/eigen.h>
+#include <pybind11/stl.h>
 namespace py = pybind11;
 
 
 #include "mrob/SE3.hpp"
 #include "mrob/pc_registration.hpp"
+#include "mrob/spatial_index.hpp"
+#include "mrob/voxel_map.hpp"
+#include "mrob/loam.hpp"
 
 
 using namespace mrob;
@@ -47,6 +51,30 @@ SE3 arun_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX
 }
 
 
+py::tuple arun_batch_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const std::vector<uint_t> &offsets)
+{
+    std::vector<SE3> res;
+    std::vector<int> valid;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::arun_batch(X,Y,offsets,res,valid);
+    }
+    return py::make_tuple(res, valid);
+}
+
+py::tuple ransac_arun_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const PCRegistration::RansacOptions &options)
+{
+    SE3 res;
+    std::vector<uint_t> inliers;
+    {
+        py::gil_scoped_release release;
+        PCRegistration::ransac_arun(X,Y,res,inliers,options);
+    }
+    return py::make_tuple(res, inliers);
+}
+
 SE3 gicp_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
         const py::EigenDRef<const MatX> covX, const py::EigenDRef<const MatX> covY)
 {
@@ -63,12 +91,301 @@ SE3 weighted_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const
     return res;
 }
 
+py::tuple gicp_robust_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> covX, const py::EigenDRef<const MatX> covY, const SE3 &T0,
+        const PCRegistration::RegistrationOptions &options)
+{
+    SE3 res(T0);
+    PCRegistration::RegistrationStats stats;
+    {
+        py::gil_scoped_release release;
+        stats = PCRegistration::gicp(X,Y,covX,covY,res,options);
+    }
+    return py::make_tuple(res, stats);
+}
 
-void init_PCRegistration(py::module &m)
+py::tuple weighted_robust_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX1> weight, const SE3 &T0, const PCRegistration::RegistrationOptions &options)
+{
+    SE3 res(T0);
+    PCRegistration::RegistrationStats stats;
+    {
+        py::gil_scoped_release release;
+        stats = PCRegistration::weighted_point(X,Y,weight,res,options);
+    }
+    return py::make_tuple(res, stats);
+}
+
+py::tuple point_to_plane_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> normalsY, const SE3 &T0, const PCRegistration::RegistrationOptions &options)
+{
+    SE3 res(T0);
+    PCRegistration::RegistrationStats stats;
+    {
+        py::gil_scoped_release release;
+        stats = PCRegistration::point_to_plane(X,Y,normalsY,res,options);
+    }
+    return py::make_tuple(res, stats);
+}
+
+py::tuple symmetric_point_plane_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> normalsX, const py::EigenDRef<const MatX> normalsY, const SE3 &T0,
+        const PCRegistration::RegistrationOptions &options)
+{
+    SE3 res(T0);
+    PCRegistration::RegistrationStats stats;
+    {
+        py::gil_scoped_release release;
+        stats = PCRegistration::symmetric_point_plane(X,Y,normalsX,normalsY,res,options);
+    }
+    return py::make_tuple(res, stats);
+}
+
+MatX estimate_normals(const py::EigenDRef<const MatX> X, uint_t k, double maxDistance)
+{
+    return PCRegistration::estimate_normals(X, k, maxDistance);
+}
+
+SE3 icp_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y, const SE3 &T0,
+        double maxDistance, uint_t maxIters)
+{
+    SE3 res(T0);
+    PCRegistration::icp(X,Y,res,maxDistance,1e-4,maxIters);
+    return res;
+}
+
+SE3 icp_gicp_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y,
+        const py::EigenDRef<const MatX> covX, const py::EigenDRef<const MatX> covY, const SE3 &T0,
+        double maxDistance, uint_t maxIters)
+{
+    SE3 res(T0);
+    PCRegistration::icp_gicp(X,Y,covX,covY,res,maxDistance,1e-4,maxIters);
+    return res;
+}
+
+py::tuple icp_pyramid_solve(const py::EigenDRef<const MatX> X, const py::EigenDRef<const MatX> Y, const SE3 &T0,
+        const std::vector<PCRegistration::PyramidLevel> &levels, PCRegistration::registrationMethod method)
+{
+    SE3 res(T0);
+    std::vector<PCRegistration::RegistrationStats> stats;
+    {
+        py::gil_scoped_release release;
+        stats = PCRegistration::icp_pyramid(X,Y,res,levels,method);
+    }
+    return py::make_tuple(res, stats);
+}
+
+MatX estimate_covariances(const py::EigenDRef<const MatX> X, uint_t k, double e, double maxDistance)
 {
-    m.def("arun", &arun_solve);
-    m.def("gicp", &gicp_solve);
-    m.def("weighted", &weighted_solve);
+    return PCRegistration::estimate_covariances(X, k, e, maxDistance);
 }
 
+MatX estimate_covariances_index(const py::EigenDRef<const MatX> X, const SpatialIndex &indexX, uint_t k, double e, double maxDistance)
+{
+    return PCRegistration::estimate_covariances(X, indexX, k, e, maxDistance);
+}
 
+py::tuple knn_batch(const SpatialIndex &index, const py::EigenDRef<const MatX> queries, uint_t k, double maxDistance)
+{
+    MatXi indexes;
+    MatX squaredDistances;
+    {
+        py::gil_scoped_release release;
+        index.knn_batch(queries, k, indexes, squaredDistances, maxDistance);
+    }
+    return py::make_tuple(indexes, squaredDistances);
+}
+
+py::tuple voxel_map_register_scan(const VoxelMap &map, const py::EigenDRef<const MatX> points, const SE3 &T0,
+        uint_t maxIters, double tol, const PCRegistration::RegistrationOptions &options)
+{
+    SE3 res(T0);
+    PCRegistration::RegistrationStats stats;
+    {
+        py::gil_scoped_release release;
+        stats = map.register_scan(points, res, maxIters, tol, options);
+    }
+    return py::make_tuple(res, stats);
+}
+
+
+void init_PCRegistration(py::module &m)
+{
+    // These functions do not access any python object during the calculation, so the GIL is released
+    m.def("arun", &arun_solve, py::call_guard<py::gil_scoped_release>());
+    // Many pairs stacked in X,Y, pair k are the rows [offsets[k], offsets[k+1]). Returns a tuple (list of T, list of valid)
+    m.def("arun_batch", &arun_batch_solve,
+            "Arun over many pairs in parallel, input points X, Y stacked (N x 3) and offsets of each pair",
+            py::arg("X"), py::arg("Y"), py::arg("offsets"));
+    // RANSAC over Arun for correspondences with outliers. Returns a tuple (T, list of inlier indexes)
+    py::class_<PCRegistration::RansacOptions>(m, "RansacOptions")
+            .def(py::init<>())
+            .def_readwrite("threshold", &PCRegistration::RansacOptions::threshold)
+            .def_readwrite("maxIterations", &PCRegistration::RansacOptions::maxIterations)
+            .def_readwrite("confidence", &PCRegistration::RansacOptions::confidence)
+            .def_readwrite("prosac", &PCRegistration::RansacOptions::prosac)
+            .def_readwrite("sprt", &PCRegistration::RansacOptions::sprt)
+            .def_readwrite("sprtDelta", &PCRegistration::RansacOptions::sprtDelta)
+            .def_readwrite("sprtModelCost", &PCRegistration::RansacOptions::sprtModelCost)
+            .def_readwrite("seed", &PCRegistration::RansacOptions::seed)
+            ;
+    m.def("ransac_arun", &ransac_arun_solve,
+            "RANSAC over Arun, input points X, Y (N x 3, associated by index) and options",
+            py::arg("X"), py::arg("Y"), py::arg("options") = PCRegistration::RansacOptions());
+    m.def("gicp", &gicp_solve, py::call_guard<py::gil_scoped_release>());
+    m.def("weighted", &weighted_solve, py::call_guard<py::gil_scoped_release>());
+    // Robust registration, options define the kernel, LM and iterations. Returns a tuple (T, stats)
+    py::enum_<PCRegistration::robustKernel>(m, "RobustKernel")
+        .value("QUADRATIC", PCRegistration::robustKernel::QUADRATIC)
+        .value("HUBER", PCRegistration::robustKernel::HUBER)
+        .value("CAUCHY", PCRegistration::robustKernel::CAUCHY)
+        .value("GEMAN_MCCLURE", PCRegistration::robustKernel::GEMAN_MCCLURE)
+        .export_values()
+        ;
+    py::class_<PCRegistration::RegistrationOptions>(m, "RegistrationOptions")
+            .def(py::init<>())
+            .def_readwrite("maxIters", &PCRegistration::RegistrationOptions::maxIters)
+            .def_readwrite("tol", &PCRegistration::RegistrationOptions::tol)
+            .def_readwrite("useLM", &PCRegistration::RegistrationOptions::useLM)
+            .def_readwrite("lambda", &PCRegistration::RegistrationOptions::lambda)
+            .def_readwrite("kernel", &PCRegistration::RegistrationOptions::kernel)
+            .def_readwrite("kernelWidth", &PCRegistration::RegistrationOptions::kernelWidth)
+            ;
+    py::class_<PCRegistration::RegistrationStats>(m, "RegistrationStats")
+            .def_readonly("iterations", &PCRegistration::RegistrationStats::iterations)
+            .def_readonly("initialCost", &PCRegistration::RegistrationStats::initialCost)
+            .def_readonly("finalCost", &PCRegistration::RegistrationStats::finalCost)
+            .def_readonly("inlierRatio", &PCRegistration::RegistrationStats::inlierRatio)
+            .def_readonly("converged", &PCRegistration::RegistrationStats::converged)
+            ;
+    m.def("gicp_robust", &gicp_robust_solve,
+            "GICP with robust kernel, input points X, Y, covariances, initial transformation and options",
+            py::arg("X"), py::arg("Y"), py::arg("covX"), py::arg("covY"), py::arg("T0") = SE3(),
+            py::arg("options") = PCRegistration::RegistrationOptions());
+    m.def("weighted_robust", &weighted_robust_solve,
+            "Weighted point registration with robust kernel, input points X, Y, weights, initial transformation and options",
+            py::arg("X"), py::arg("Y"), py::arg("weight"), py::arg("T0") = SE3(),
+            py::arg("options") = PCRegistration::RegistrationOptions());
+    m.def("point_to_plane", &point_to_plane_solve,
+            "Point to plane registration, input points X, Y, normals of Y (N x 3), initial transformation and options",
+            py::arg("X"), py::arg("Y"), py::arg("normalsY"), py::arg("T0") = SE3(),
+            py::arg("options") = PCRegistration::RegistrationOptions());
+    m.def("symmetric_point_plane", &symmetric_point_plane_solve,
+            "Symmetric point to plane registration, input points X, Y, their normals, initial transformation and options",
+            py::arg("X"), py::arg("Y"), py::arg("normalsX"), py::arg("normalsY"), py::arg("T0") = SE3(),
+            py::arg("options") = PCRegistration::RegistrationOptions());
+    m.def("icp", &icp_solve,
+            "ICP with unknown data association, input points X, Y, initial transformation, max distance and iterations",
+            py::arg("X"), py::arg("Y"), py::arg("T0") = SE3(), py::arg("maxDistance") = 1.0, py::arg("maxIters") = 30,
+            py::call_guard<py::gil_scoped_release>());
+    m.def("icp_gicp", &icp_gicp_solve,
+            "ICP with unknown data association and GICP registration, input points X, Y, covariances, initial transformation, max distance and iterations",
+            py::arg("X"), py::arg("Y"), py::arg("covX"), py::arg("covY"), py::arg("T0") = SE3(), py::arg("maxDistance") = 1.0, py::arg("maxIters") = 30,
+            py::call_guard<py::gil_scoped_release>());
+    // Coarse to fine ICP, levels are ordered from coarse to fine. Returns a tuple (T, list of stats per level)
+    py::enum_<PCRegistration::registrationMethod>(m, "RegistrationMethod")
+        .value("POINT_POINT", PCRegistration::registrationMethod::POINT_POINT)
+        .value("POINT_PLANE", PCRegistration::registrationMethod::POINT_PLANE)
+        .value("SYMMETRIC_POINT_PLANE", PCRegistration::registrationMethod::SYMMETRIC_POINT_PLANE)
+        .value("GICP", PCRegistration::registrationMethod::GICP)
+        .export_values()
+        ;
+    py::class_<PCRegistration::PyramidLevel>(m, "PyramidLevel")
+            .def(py::init<>())
+            .def_readwrite("voxelSize", &PCRegistration::PyramidLevel::voxelSize)
+            .def_readwrite("maxDistance", &PCRegistration::PyramidLevel::maxDistance)
+            .def_readwrite("maxIters", &PCRegistration::PyramidLevel::maxIters)
+            .def_readwrite("tol", &PCRegistration::PyramidLevel::tol)
+            .def_readwrite("neighbours", &PCRegistration::PyramidLevel::neighbours)
+            .def_readwrite("options", &PCRegistration::PyramidLevel::options)
+            ;
+    m.def("create_pyramid_levels", &PCRegistration::create_pyramid_levels,
+            "input number of levels, voxel size of the finest level (0 full resolution), min voxel size and factor",
+            py::arg("numberLevels"), py::arg("voxelSize"), py::arg("minVoxelSize") = 0.05, py::arg("factor") = 2.0);
+    m.def("icp_pyramid", &icp_pyramid_solve,
+            "Coarse to fine ICP, input points X, Y, initial transformation, list of levels and method",
+            py::arg("X"), py::arg("Y"), py::arg("T0") = SE3(), py::arg("levels") = PCRegistration::create_pyramid_levels(3, 0.1),
+            py::arg("method") = PCRegistration::registrationMethod::POINT_PLANE);
+    // Preprocessing for GICP, covariances are a 3N x 3 array as required by gicp
+    m.def("voxel_downsample", &PCRegistration::voxel_downsample,
+            "input a N x 3 array of points and voxel size. Returns the centroids of each voxel",
+            py::arg("X"), py::arg("voxelSize"),
+            py::call_guard<py::gil_scoped_release>());
+    m.def("estimate_normals", &estimate_normals,
+            "input a N x 3 array of points, number of neighbours k and max distance. Returns the N x 3 normals",
+            py::arg("X"), py::arg("k") = 20, py::arg("maxDistance") = std::numeric_limits<double>::infinity(),
+            py::call_guard<py::gil_scoped_release>());
+    m.def("estimate_covariances", &estimate_covariances,
+            "input a N x 3 array of points, number of neighbours k, e and max distance. Returns the 3N x 3 covariances R diag(e,1,1) R'",
+            py::arg("X"), py::arg("k") = 20, py::arg("e") = 1e-3, py::arg("maxDistance") = std::numeric_limits<double>::infinity(),
+            py::call_guard<py::gil_scoped_release>());
+    m.def("estimate_covariances", &estimate_covariances_index,
+            "same as above, with the spatial index of X already built",
+            py::arg("X"), py::arg("index"), py::arg("k") = 20, py::arg("e") = 1e-3, py::arg("maxDistance") = std::numeric_limits<double>::infinity(),
+            py::call_guard<py::gil_scoped_release>());
+
+    // Spatial indexes, knn returns a tuple (indexes, squared distances), indexes are -1 when not found
+    py::class_<SpatialIndex>(m, "SpatialIndex")
+            .def("knn", &knn_batch,
+                    "input a M x 3 array of queries, k and max distance. Returns indexes (M x k) and squared distances (M x k)",
+                    py::arg("queries"), py::arg("k") = 1, py::arg("maxDistance") = std::numeric_limits<double>::infinity())
+            .def("get_number_points", &SpatialIndex::get_number_points)
+            ;
+    py::class_<KDTree, SpatialIndex>(m, "KDTree")
+            .def(py::init<const Eigen::Ref<const MatX> &, uint_t>(),
+                    "Constructor, input a N x 3 array of points and leaf size (positive, ValueError otherwise)",
+                    py::arg("points"), py::arg("leafSize") = 16)
+            ;
+    py::class_<VoxelHashGrid, SpatialIndex>(m, "VoxelHashGrid")
+            .def(py::init<const Eigen::Ref<const MatX> &, double>(),
+                    "Constructor, input a N x 3 array of points and voxel size (max search distance)",
+                    py::arg("points"), py::arg("voxelSize") = 1.0)
+            .def("get_number_voxels", &VoxelHashGrid::get_number_voxels)
+            ;
+    // Persistent voxel map for scan to map registration
+    py::class_<VoxelMap>(m, "VoxelMap")
+            .def(py::init<double, double, uint_t, double>(),
+                    "Constructor, input voxel size, radius of the map around the sensor, min points per voxel and e of the covariances",
+                    py::arg("voxelSize") = 1.0, py::arg("radius") = 50.0, py::arg("minPointsVoxel") = 5, py::arg("e") = 1e-3)
+            .def("insert", &VoxelMap::insert,
+                    "input a N x 3 array of points in the sensor frame and the pose of the sensor",
+                    py::arg("points"), py::arg("T"),
+                    py::call_guard<py::gil_scoped_release>())
+            .def("register_scan", &voxel_map_register_scan,
+                    "input a N x 3 array of points in the sensor frame, initial pose, max iterations, tol and options. Returns a tuple (T, stats)",
+                    py::arg("points"), py::arg("T0"), py::arg("maxIters") = 30, py::arg("tol") = 1e-4,
+                    py::arg("options") = PCRegistration::RegistrationOptions())
+            .def("clear", &VoxelMap::clear)
+            .def("get_number_voxels", &VoxelMap::get_number_voxels)
+            .def("get_means", &VoxelMap::get_means)
+            .def("get_covariances", &VoxelMap::get_covariances)
+            ;
+    // LOAM odometry and mapping, baseline for plane odometry
+    py::class_<Loam>(m, "Loam")
+            .def(py::init<double, double, double, double>(),
+                    "Constructor, input curvature thresholds for edges and planar points, voxel size and radius of the map",
+                    py::arg("edgeThreshold") = 0.1, py::arg("planarThreshold") = 0.1,
+                    py::arg("mapVoxelSize") = 0.4, py::arg("mapRadius") = 100.0)
+            .def("extract_features", &Loam::extract_features,
+                    "input a N x 3 array of points and the ring of each point. Returns the number of sharp and flat points",
+                    py::arg("points"), py::arg("rings"),
+                    py::call_guard<py::gil_scoped_release>())
+            .def("add_scan", &Loam::add_scan,
+                    "input a N x 3 array of points and the ring of each point. Returns the estimated pose",
+                    py::arg("points"), py::arg("rings"),
+                    py::call_guard<py::gil_scoped_release>())
+            .def("get_number_poses", &Loam::get_number_poses)
+            .def("get_trajectory", &Loam::get_trajectory)
+            .def("get_odometry", &Loam::get_odometry)
+            .def("get_sharp_points", &Loam::get_sharp_points)
+            .def("get_less_sharp_points", &Loam::get_less_sharp_points)
+            .def("get_flat_points", &Loam::get_flat_points)
+            .def("get_less_flat_points", &Loam::get_less_flat_points)
+            .def("get_map_edge_points", &Loam::get_map_edge_points)
+            .def("get_map_planar_points", &Loam::get_map_planar_points)
+            .def("set_iterations", &Loam::set_iterations,
+                    py::arg("odometryIters"), py::arg("mappingIters"))
+            .def("set_registration_options", &Loam::set_registration_options,
+                    py::arg("options"))
+            ;
+}
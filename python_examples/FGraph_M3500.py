@@ -50,9 +50,9 @@ with open('../benchmarks/M3500.txt', 'r') as file:
 # Initialize FG
 graph = mrob.fgraph.FGraph()
 x = np.zeros(3)
-n = graph.add_node_pose_2d(x)
+# the first node is anchored (kept constant), instead of adding a strong prior factor
+n = graph.add_node_pose_2d(x, mrob.fgraph.ANCHOR)
 print('node 0 id = ', n) # id starts at 1
-graph.add_factor_1pose_2d(x,n,1e9*np.identity(3))
 processing_time = []
 
 # start events, we solve for each node, adding it and it corresponding factors
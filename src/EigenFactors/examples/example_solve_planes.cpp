@@ -0,0 +1,106 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ *
+ * example_solve_planes.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/factor_graph_ef.hpp"
+#include "mrob/factors/nodePose3d.hpp"
+
+#include <Eigen/Geometry>
+
+#include <iostream>
+#include <vector>
+
+using namespace mrob;
+
+// This examples show how to jointly optimize a trajectory of poses observing planes
+int main()
+{
+    // 1) create mock scene with some planes and GT poses. Each plane
+    //    is observed only by a window of consecutive poses.
+    const uint_t numberPoses = 200, numberPlanes = 1000, window = 10, numberPoints = 20;
+    const double noisePoints = 0.01, noisePoses = 0.02;
+    EFSolve graph(EFSolve::ADJ, EFSolve::LM);
+
+    std::vector<SE3> gt;
+    for (uint_t t = 0; t < numberPoses; ++t)
+    {
+        Mat61 xi = Mat61::Random()*0.1;
+        xi(3) += 0.05*t;
+        SE3 T(xi);
+        gt.push_back(T);
+        Mat61 noise = Mat61::Random()*noisePoses;
+        SE3 Tini = SE3(noise) * T;
+        // the first pose fixes the reference frame
+        if (t == 0)
+            Tini = T;
+        std::shared_ptr<Node> n(new NodePose3d(Tini));
+        if (t == 0)
+            n->set_node_mode(Node::ANCHOR);
+        graph.add_node(n);
+    }
+
+    // 2) Add information to the EF Fgraph structure. For now only planes
+    for (uint_t i = 0; i < numberPlanes; ++i)
+    {
+        // plane with a random normal, centered somewhere along the trajectory
+        uint_t tStart = i % (numberPoses - window + 1);
+        Mat31 normal = Mat31::Random().normalized();
+        Mat31 u1 = normal.unitOrthogonal(), u2 = normal.cross(u1);
+        Mat31 center = gt[tStart + window/2].t() + Mat31::Random()*3.0;
+
+        std::shared_ptr<PlaneFactor> plane;
+        for (uint_t t = tStart; t < tStart + window; ++t)
+        {
+            Mat4 S = Mat4::Zero();
+            SE3 Tinv = gt[t].inv();
+            for (uint_t p = 0; p < numberPoints; ++p)
+            {
+                Eigen::Array2d ab = Eigen::Array2d::Random()*2.0;
+                Mat31 pw = center + ab(0)*u1 + ab(1)*u2 + normal*noisePoints*Eigen::Matrix<double,1,1>::Random()(0);
+                Mat41 ph;
+                ph << Tinv.transform(pw), 1.0;
+                S += ph * ph.transpose();
+            }
+            if (!plane)
+                plane.reset(new PlaneFactor(S, graph.get_node(t)));
+            else
+                plane->add_observation(S, graph.get_node(t));
+        }
+        graph.add_eigen_factor(plane);
+    }
+
+    // 3) Optimize, Measure distance to GT
+    auto errorTrajectory = [&]()
+    {
+        double error = 0.0;
+        for (uint_t t = 0; t < numberPoses; ++t)
+        {
+            Mat4 T = graph.get_node(t)->get_state();
+            SE3 dT = gt[t].inv() * SE3(T);
+            error += dT.ln_vee().norm();
+        }
+        return error/numberPoses;
+    };
+    std::cout << "Initial chi2 = " << graph.chi2() << ", average error w.r.t. GT = " << errorTrajectory() << std::endl;
+    graph.solve(EFSolve::LM, 20);
+    std::cout << "Final chi2 = " << graph.chi2() << ", average error w.r.t. GT = " << errorTrajectory() << std::endl;
+    return 0;
+}
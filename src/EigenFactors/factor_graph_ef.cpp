@@ -0,0 +1,147 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * factor_graph_ef.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/factor_graph_ef.hpp"
+
+using namespace mrob;
+
+
+EFSolve::EFSolve(matrixMethod method, optimMethod optim):
+        FGraphSolve(method, optim)
+{
+}
+
+EFSolve::~EFSolve() = default;
+
+bool EFSolve::add_eigen_factor(std::shared_ptr<PlaneFactor> &factor)
+{
+    factor->set_id(eigenFactors_.size());
+    eigenFactors_.push_back(factor);
+    return true;
+}
+
+std::shared_ptr<PlaneFactor>& EFSolve::get_eigen_factor(uint_t key)
+{
+    assert(key < eigenFactors_.size() && "EFSolve::get_eigen_factor: incorrect key");
+    return eigenFactors_[key];
+}
+
+void EFSolve::build_problem(bool useLambda)
+{
+    // 1) standard factors, from the adjacency matrix
+    FGraphSolve::build_problem(false);
+
+    // 2) eigen factors
+    time_profiles_.start();
+    this->build_info_eigen_factors();
+    time_profiles_.stop("Info Eigen Factors");
+
+    if (useLambda)
+    {
+        diagL_ = L_.diagonal();
+    }
+}
+
+void EFSolve::build_info_eigen_factors()
+{
+    // 1) Evaluate every plane given the current state, they are independent
+    const long numberEF = eigenFactors_.size();
+    #pragma omp parallel for schedule(dynamic)
+    for (long i = 0; i < numberEF; ++i)
+    {
+        eigenFactors_[i]->evaluate_jacobians();
+        eigenFactors_[i]->evaluate_chi2();
+    }
+
+    // 2) Node indexes, as in build_adjacency. Anchor nodes are not part of the state
+    indNodesMatrix_.clear();
+    uint_t N = 0;
+    for (auto &n : nodes_)
+    {
+        indNodesMatrix_.push_back(N);
+        if (n->get_node_mode() == Node::ANCHOR)
+            continue;
+        N += n->get_dim();
+    }
+    assert(N == N_ && "EFSolve::build_info_eigen_factors: State Dimensions are not coincident\n");
+
+    // 3) Each plane fills a dense block only on the poses that observed it
+    uint_t numberTriplets = 0;
+    for (auto &f : eigenFactors_)
+        numberTriplets += f->get_hessian().size();
+    hessianTriplets_.clear();
+    hessianTriplets_.reserve(numberTriplets);
+    for (auto &f : eigenFactors_)
+    {
+        auto neighNodes = f->get_neighbour_nodes();
+        const MatX &H = f->get_hessian();
+        auto J = f->get_jacobian();
+        uint_t index_n = 0;
+        for (auto &node1 : *neighNodes)
+        {
+            uint_t dim_n = node1->get_dim();
+            if (node1->get_node_mode() == Node::ANCHOR)
+            {
+                index_n += dim_n;
+                continue;
+            }
+            uint_t row = indNodesMatrix_[node1->get_id()];
+            b_.segment(row, dim_n) += J.block(index_n, 0, dim_n, 1);
+            uint_t index_m = 0;
+            for (auto &node2 : *neighNodes)
+            {
+                uint_t dim_m = node2->get_dim();
+                if (node2->get_node_mode() != Node::ANCHOR)
+                {
+                    uint_t col = indNodesMatrix_[node2->get_id()];
+                    for (uint_t i = 0; i < dim_n; ++i)
+                        for (uint_t j = 0; j < dim_m; ++j)
+                            hessianTriplets_.emplace_back(row + i, col + j, H(index_n + i, index_m + j));
+                }
+                index_m += dim_m;
+            }
+            index_n += dim_n;
+        }
+    }
+
+    // 4) L = A'WA + sum H_plane, duplicated entries (poses sharing planes) are summed up
+    SMatCol LEF(N_, N_);
+    LEF.setFromTriplets(hessianTriplets_.begin(), hessianTriplets_.end());
+    L_ += LEF;
+}
+
+matData_t EFSolve::chi2(bool evaluateResidualsFlag)
+{
+    matData_t totalChi2 = FGraphSolve::chi2(evaluateResidualsFlag);
+    if (evaluateResidualsFlag)
+    {
+        const long numberEF = eigenFactors_.size();
+        #pragma omp parallel for schedule(dynamic)
+        for (long i = 0; i < numberEF; ++i)
+        {
+            eigenFactors_[i]->evaluate_residuals();
+            eigenFactors_[i]->evaluate_chi2();
+        }
+    }
+    for (auto &f : eigenFactors_)
+        totalChi2 += f->get_chi2();
+    return totalChi2;
+}
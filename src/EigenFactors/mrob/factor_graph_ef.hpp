@@ -25,12 +25,25 @@
 #define FACTOR_GRAPH_EF_HPP_
 
 #include "mrob/factor_graph_solve.hpp"
+#include "mrob/plane_factor.hpp"
+
+#include <deque>
+#include <vector>
 
 /**
  * This class, inherits from solve_factor_graph and aims to provide the
  * additional structure required to process Eigen Factors as plane factors
  *
- * TODO: merge this in solve
+ * Eigen factors are stored separately from the rest of factors, since they
+ * do not provide residuals, but directly the gradient and Hessian over all the
+ * poses that observed them. On each iteration, the information matrix is built
+ * as usual from the adjacency (odometry, priors, etc.) and then each eigen factor
+ * adds its dense block only on the rows and columns of the poses that observed it,
+ * such that the sparse Cholesky exploits the same structure as in bundle adjustment.
+ *
+ * Nodes should be added to the graph before being observed by a plane,
+ * and at least one node must be fixed (anchor) or have a prior, since
+ * planes do not constrain the global reference frame.
  */
 
 
@@ -39,19 +52,40 @@ namespace mrob {
 class EFSolve: public FGraphSolve
 {
 public:
-    EFSolve();
+    EFSolve(matrixMethod method = ADJ, optimMethod optim = GN);
     ~EFSolve();
 
     /**
-     * Solve the alignment problem for a stream of observations
-     * from pose x_origin = I to x_f
-     * w.r.t the final pose
+     * Adds an eigen factor (plane), observed from nodes already in the graph.
+     * Its id is the position on the eigen factors container.
+     */
+    bool add_eigen_factor(std::shared_ptr<PlaneFactor> &factor);
+    /**
+     * Returns the eigen factor given its id
+     */
+    std::shared_ptr<PlaneFactor>& get_eigen_factor(uint_t key);
+    uint_t number_eigen_factors() const {return eigenFactors_.size();};
+    /**
+     * Evaluates the current solution chi2, including the error of all
+     * eigen factors (sum of squared point to plane distances)
+     */
+    matData_t chi2(bool evaluateResidualsFlag = true) override;
+
+protected:
+    /**
+     * Builds the information matrix and gradient from standard factors
+     * and adds the contribution of the eigen factors.
      */
-    void solve_1_pose();
+    void build_problem(bool useLambda = false) override;
     /**
-     * Solve the full problem involving multiple poses
+     * Evaluates all eigen factors (in parallel if OpenMP is available)
+     * and adds their Hessian blocks to L and gradients to b
      */
-    void solve_planes();
+    void build_info_eigen_factors();
+
+    std::deque<std::shared_ptr<PlaneFactor> > eigenFactors_;
+    std::vector<uint_t> indNodesMatrix_;
+    std::vector<Triplet> hessianTriplets_;
 };
 
 }//end namespace
@@ -26,7 +26,7 @@
 
 
 #include "mrob/factor.hpp"
-#include <unordered_map> // used for storing matrices S, paired by node Ids (or might be pointers)
+#include <vector>
 
 
 namespace mrob{
@@ -39,11 +39,28 @@ namespace mrob{
  * It is not required an explicit parametrization of the plane, so the resultant topology
  * is N nodes connecting to the plane factor.
  *
- * In order to build the problem we would follow the interface specifications by FGraph
- * but we need extra methods and variables to keep track of the neighbours
+ * The error is the minimum eigenvalue of Q = sum_t T_t * S_t * T_t', where S_t = sum p*p'
+ * are the points observed from pose T_t (node), that is, the sum of squared distances of
+ * all points to the plane pi = [n', d]', the eigenvector of Q. Since pi is unit as a 4-vector,
+ * distances are scaled by |n|^2, so the scene should be expressed close to the origin.
+ *
+ * Since the plane is not a node, its parameters are eliminated: the Hessian is the
+ * Gauss-Newton approximation of the joint problem (poses, plane), after the Schur complement
+ * of the plane. It is a dense matrix connecting all the poses that observed the plane:
+ *
+ *   H_ab = 2 * delta_ab * W'Q_a W - 2 * sum_k (W'Q_a v_k)(W'Q_b v_k)' / lambda_k
+ *
+ * where W = [G_1'pi, ..., G_6'pi] and v_k, lambda_k the remaining eigenpairs of Q.
+ * This is the Schur complement of the Gauss-Newton joint Hessian 2 [W V]' Q_a [W V], which is
+ * positive semi-definite. The second order expansion of the eigenvalue would weight each
+ * direction by the eigen-gap 1/(lambda_k - lambda_0) instead, both coincide for a perfect
+ * plane (lambda_0 = 0). The eigen-gap, together with the Gauss-Newton blocks, is not PSD
+ * and LM does not converge on noisy planes, so it is not used.
+ *
+ * Plane factors do not follow the residual interface (get_residual, get_information_matrix),
+ * instead they provide the gradient and the Hessian blocks, see EFSolve.
  *
  * This class assumes that matrices S = sum p*p' are calculated before since they are directly inputs
- * XXX should we store all points?
  */
 class PlaneFactor : public Factor{
 public:
@@ -53,118 +70,89 @@ public:
     PlaneFactor(const Mat4 &S, std::shared_ptr<Node> &nodeOrigin);
     ~PlaneFactor();
     /**
-     * Jacobians are not evaluated, just the residuals
+     * Jacobians are not evaluated, just the residuals (plane and its error)
      */
     void evaluate_residuals() override;
     /**
-     * Evaluates residuals and Jacobians
+     * Evaluates residuals, the gradient (stored as the Jacobian) and the Hessian
      */
     void evaluate_jacobians() override;
     void evaluate_chi2() override;
 
     void print() const;
 
-    // TODO are this functions useful? maybe add some assert inside
-    const Eigen::Ref<const MatX1> get_obs() const
-            {assert(0 && "PlaneFactor: method should not be called");return Mat31::Zero();};
+    const Eigen::Ref<const MatX> get_obs() const
+            {assert(0 && "PlaneFactor: method should not be called");return Mat4::Zero();};
     const Eigen::Ref<const MatX1> get_residual() const
             {assert(0 && "PlaneFactor: method should not be called");return Mat31::Zero();};
     const Eigen::Ref<const MatX> get_information_matrix() const
             {assert(0 && "PlaneFactor: method should not be called");return Mat4::Zero();};
     const Eigen::Ref<const MatX> get_trans_sqrt_information_matrix() const
             {assert(0 && "PlaneFactor: method should not be called");return Mat4::Zero();};
+    /**
+     * Returns the gradient of the error, stacked for all neighbour nodes J = [J1', ..., Jn']'.
+     * Blocks of anchor nodes are also evaluated, they are skipped by the solver (EFSolve::build_problem).
+     */
     const Eigen::Ref<const MatX> get_jacobian() const {return J_;};
 
 
     // NEW functions added to the base class factor.hpp
+    /**
+     * Returns the Hessian of the error, dense for all the neighbour nodes, in the same order
+     * than the Jacobian.
+     */
+    const MatX& get_hessian() const {return H_;};
     /**
      * get plane returns the current planeEstimation
      */
-    Mat41 get_plane(void) {return planeEstimation_;};
+    Mat41 get_plane(void) const {return planeEstimation_;};
     /**
-     * Add observation adds the S matrix and the time
+     * Add observation adds the S matrix observed from the newNode.
+     * Nodes are kept ordered by id, and each node can only observe the plane once
+     * (S should be accumulated before)
      */
     void add_observation(const Mat4& S, std::shared_ptr<Node> &newNode);
-    //void add_observation(const Mat4& S, time ts, SE3 initialPose); // TODO variables for these non-optimized nodes
     /**
      * Estimates the plane parameters: v = [n', d]'_{4x1}, where v is unit, (due to the Eigen solution)
      * although for standard plane estimation we could enforce unit on the normal vector n.
+     * Returns the error, i.e. the minimum eigenvalue.
      */
     double estimate_plane();
-    /**
-     * Estimates Incremetally the plane parameters: v = [n', d]'_{4x1}, where v is unitary, (due to the SVD solution)
-     * although for standard plane estimation we could enforce unitary on the normal vector n.
-     *
-     * The difference with the previous estimate_plane() is that we update the matrix Q for the give time
-     * stamp and recalculate the solution, on constant time O(1)
-     */
-    double estimate_plane_incrementally(uint_t t);
     /**
      * get error: returns the error as the min eigenvalue
      */
     double get_error() const {return planeError_;};
     /**
-     * get error incremental: returns the error as the min eigenvalue only updating the
-     * value of Q_t, at time step t. Nothing inside gets updated
-     */
-    double get_error_incremental(uint_t t) const;
-    /**
-     *  calculates the matrix Qi = 1^T_i * Si * (1^T_i)^transp
-     *  for all planes. Since this is an iterative process on T's,
+     *  calculates the matrix Qi = T_i * Si * T_i'
+     *  for all nodes. Since this is an iterative process on T's,
      *  we separate the calculation of the S matrix,
      *  and the Q matrix which rotates S
      */
     void calculate_all_matrices_Q();
     /**
-     * get mean point calculates the mean of the pointcloud observed at time t,
-     * given that S = sum p * p' =  sum ([x2 xy xz x
-     *                                    yx y2 yz y
-     *                                    zx zy z2 z
-     *                                    x   y  z 1]
-     * ser we just calcualte S and return
-     */
-    //Mat31 get_mean_point(uint_t t); // XXX is this necessary?
-    /**
-     * calculate Jacobian at node nodeId, returns the Jacobian over the Eigendecomposition of Q  = V D V'
-     * as d lamda = v' * dQ * v
+     * calculate Jacobian at node nodeId, returns the gradient of the min eigenvalue of Q = V D V'
+     * as d lamda = v' * dQ * v. If the node does not observe the plane, it returns zero.
      */
     Mat61 calculate_jacobian(uint_t nodeId);
-    /**
-     * Calculate Hessian at time
-     */
 
 
 protected:
     /**
      * On the base class it is declared vector<std::shared_ptr<Node> > neighbourNodes_;
-     * This is a sorted list, so the add_node function makes sure to keep the order.
-     *
-     * For planes nodes we need to keep a sorted list of nodes. While
-     * other factors connect to 1 node, 2 usually, plane factor is not bounded,
-     * so we will store a sorted container for nodes that have observed the same
-     * plane. Nodes on this list will not be optimized, but they should be related to its 2 closes nodes.
-     *
-     * For optimizaing we will use the neighbourNodes_ from the base class, and here we must preserve
-     * the order.
+     * This is a sorted list (by id), so the add_observation function makes sure to keep the order,
+     * together with the matrices S and Q at the same position.
      */
-    std::vector<std::shared_ptr<Node> > planeNodes_;
+    std::vector<Mat4> S_, Q_;
+    Mat4 accumulatedQ_;
+
     /**
-     * The Jacobian of the plane error, the poses involved are in XXX order
+     * The gradient of the plane error, stacked for the neighbour nodes
      */
     MatX1 J_;
     /**
-     * Hessian matrix, dense since it connects all poses from where plane was observed TODO order?
+     * Hessian matrix, dense since it connects all poses from where plane was observed, same order as J_
      */
     MatX H_;
-    /**
-     * According to our notation S = sum p*p'
-     * We choose unordered map here since this is a subset of neighbours (small) and we will iterate over them
-     * Iterations may be not in strict order, but we don't care much for now (will we?)
-     *
-     * Q = T *S *T'
-     */
-    std::unordered_map<uint_t, Mat4> S_, Q_;
-    Mat4 accumulatedQ_;//Q matrix of accumulated values for the incremental update of the error.
 
     Mat41 planeEstimation_;
     double planeError_;
@@ -23,137 +23,99 @@
 
 
 #include "mrob/plane_factor.hpp"
+#include "mrob/plane_eigen_solver.hpp"
+#include "mrob/SO3.hpp"
 
 #include <iostream>
+#include <algorithm>
 #include <Eigen/Eigenvalues>
-#include "mrob/SE3.hpp"
 
 using namespace mrob;
 
 PlaneFactor::PlaneFactor(const Mat4 &S, std::shared_ptr<Node> &nodeOrigin):
-        Factor(0,0), //Dimension zero since this is a non-parametric factor. Also we don't known how many nodes will connect, so we set the second param to 0 (not-used)
+        Factor(0,0), //Dimension zero since this is a non-parametric factor. Also we don't known how many nodes will connect, so we set the second param to 0 and update it on each observation
         planeEstimation_(Mat41::Zero()),
         planeError_(0.0)
 {
-    planeNodes_.push_back(nodeOrigin);
-    S_.emplace(nodeOrigin->get_id(), S);//TODO ids make sense? not really
+    add_observation(S, nodeOrigin);
 }
 
+PlaneFactor::~PlaneFactor() = default;
 
 void PlaneFactor::add_observation(const Mat4& S, std::shared_ptr<Node> &newNode)
 {
-    //neighbourNodes_ contain only those node to be optimized
-    planeNodes_.push_back(newNode);
-    S_.emplace(newNode->get_id(), S);
+    assert(newNode->get_dim() == 6 && "PlaneFactor::add_observation: only 3D poses are supported");
+    // neighbourNodes_ are kept ordered by id, and S_ at the same position
+    auto it = std::lower_bound(neighbourNodes_.begin(), neighbourNodes_.end(), newNode,
+            [](const std::shared_ptr<Node> &a, const std::shared_ptr<Node> &b){return a->get_id() < b->get_id();});
+    assert((it == neighbourNodes_.end() || (*it)->get_id() != newNode->get_id()) &&
+            "PlaneFactor::add_observation: node already observes this plane, accumulate S instead");
+    uint_t position = it - neighbourNodes_.begin();
+    neighbourNodes_.insert(it, newNode);
+    S_.insert(S_.begin() + position, S);
+    allNodesDim_ += newNode->get_dim();
 }
 
-double PlaneFactor::estimate_plane()
+void PlaneFactor::evaluate_residuals()
 {
-    calculate_all_matrices_Q();
-    accumulatedQ_ = Mat4::Zero();
-    for (const auto &Qi: Q_)
-    {
-        accumulatedQ_ += Qi.second;
-        //std::cout << Qi << std::endl;
-    }
+    estimate_plane();
+}
 
-    // Only needs Lower View from Q (https://eigen.tuxfamily.org/dox/classEigen_1_1SelfAdjointEigenSolver.html)
-    Eigen::SelfAdjointEigenSolver<Mat4> es(accumulatedQ_);
-    planeEstimation_ = es.eigenvectors().col(0);
-    //std::cout << es.eigenvectors() << "\n and solution \n" << planeEstimation_ <<  std::endl;
-    //std::cout << "plane estimation error: " << es.eigenvalues() <<  std::endl;
-    planeError_ = es.eigenvalues()(0);
+void PlaneFactor::evaluate_chi2()
+{
+    chi2_ = planeError_;
+}
 
+double PlaneFactor::estimate_plane()
+{
+    calculate_all_matrices_Q();
+    // the previous plane is the warm start, at the first iteration it is zero and solves the complete problem
+    planeError_ = min_eigenpair_4x4(accumulatedQ_, planeEstimation_);
     return planeError_;
 }
 
 void PlaneFactor::calculate_all_matrices_Q()
 {
-    Q_.clear();
-    for (auto &element : S_)
+    Q_.resize(S_.size());
+    accumulatedQ_.setZero();
+    for (uint_t i = 0; i < S_.size(); ++i)
     {
-        // Find the corresponding transformation, on this pair<id, S>
-        uint_t nodeId = element.first;
-        SE3 T;
-        // Use the corresponding matrix S
-        Mat4 Q;
-        Q.noalias() =  T.T() * element.second * T.T().transpose();
-        Q_.emplace(nodeId, Q);
+        Mat4 T = neighbourNodes_[i]->get_state();
+        Q_[i].noalias() = T * S_[i] * T.transpose();
+        accumulatedQ_ += Q_[i];
     }
 }
 
+void PlaneFactor::evaluate_jacobians()
+{
+    // gradient and Hessian of all the poses, with the plane eliminated (see plane_schur_gradient_hessian)
+    calculate_all_matrices_Q();
+    std::vector<const Mat4*> matricesQ(Q_.size());
+    for (uint_t a = 0; a < Q_.size(); ++a)
+        matricesQ[a] = &Q_[a];
+    planeError_ = plane_schur_gradient_hessian(accumulatedQ_, matricesQ, J_, H_, planeEstimation_);
+}
 
 Mat61 PlaneFactor::calculate_jacobian(uint_t nodeId)
 {
-    if (S_.count(nodeId) == 0) return Mat61::Zero();
-    Mat61 jacobian;
-    // calculate dQ/dxi for the submatrix S
-    // XXX for now keep vectors S and Q and create a separate vector/map for adding optimization nodes or do not include others???
-    Mat4 dQ, Q;// = matrixQ_[];
-
-    // dQ / d xi(0) = [0
-    //               -q3
-    //                q2
-    //                 0]
-    dQ.setZero();
-    dQ.row(1) << -Q.row(2);
-    dQ.row(2) <<  Q.row(1);
-    dQ += dQ.transpose().eval();
-    jacobian(0) = planeEstimation_.dot(dQ*planeEstimation_);
-
-    // dQ / d xi(1) = [q3
-    //                 0
-    //                -q1
-    //                 0]
-    dQ.setZero();
-    dQ.row(0) <<  Q.row(2);
-    dQ.row(2) << -Q.row(0);
-    dQ += dQ.transpose().eval();
-    jacobian(1) = planeEstimation_.dot(dQ*planeEstimation_);
-
-    // dQ / d xi(2) = [-q2
-    //                 q1
-    //                 0
-    //                 0]
-    dQ.setZero();
-    dQ.row(0) << -Q.row(1);
-    dQ.row(1) <<  Q.row(0);
-    dQ += dQ.transpose().eval();
-    jacobian(2) = planeEstimation_.dot(dQ*planeEstimation_);
-
-    // dQ / d xi(3) = [q4
-    //                 0
-    //                 0
-    //                 0]
-    dQ.setZero();
-    dQ.row(0) << Q.row(3);
-    dQ += dQ.transpose().eval();
-    jacobian(3) = planeEstimation_.dot(dQ*planeEstimation_);
-
-    // dQ / d xi(4) = [0
-    //                 q4
-    //                 0
-    //                 0]
-    dQ.setZero();
-    dQ.row(1) << Q.row(3);
-    dQ += dQ.transpose().eval();
-    jacobian(4) = planeEstimation_.dot(dQ*planeEstimation_);
-
-    // dQ / d xi(5) = [0
-    //                 0
-    //                 q4
-    //                 0]
-    dQ.setZero();
-    dQ.row(2) << Q.row(3);
-    dQ += dQ.transpose().eval();
-    jacobian(5) = planeEstimation_.dot(dQ*planeEstimation_);
-
-
+    auto it = std::find_if(neighbourNodes_.begin(), neighbourNodes_.end(),
+            [nodeId](const std::shared_ptr<Node> &n){return n->get_id() == nodeId;});
+    if (it == neighbourNodes_.end())
+        return Mat61::Zero();
+    const Mat4 &Q = Q_[it - neighbourNodes_.begin()];
+
+    // d lambda / d xi_i = pi' * (G_i * Q + Q * G_i') * pi = 2 * (G_i' pi)' * Q * pi
+    Eigen::Matrix<matData_t,4,6> W = Eigen::Matrix<matData_t,4,6>::Zero();
+    Mat31 n = planeEstimation_.head<3>();
+    W.topLeftCorner<3,3>() = hat3(n);
+    W.bottomRightCorner<1,3>() = n.transpose();
+    Mat61 jacobian = 2.0 * W.transpose() * Q * planeEstimation_;
     return jacobian;
 }
 
 
 void PlaneFactor::print() const
 {
-    std::cout << "Plane Eigen Factor" <<std::endl;
+    std::cout << "Plane Eigen Factor, id = " << id_ << ", observed from " << neighbourNodes_.size()
+              << " poses, plane = " << planeEstimation_.transpose() << " and error = " << planeError_ << std::endl;
 }
@@ -0,0 +1,116 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_EigenFactors.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/factor_graph_ef.hpp"
+#include "mrob/factors/nodePose3d.hpp"
+
+#include <Eigen/Geometry>
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+
+
+using namespace mrob;
+
+static int failures = 0;
+
+void check(bool condition, const char *name)
+{
+    std::cout << (condition ? "[  OK  ] " : "[ FAIL ] ") << name << std::endl;
+    if (!condition)
+        failures++;
+}
+
+// Trajectory observing planes, as example_solve_planes, at a smaller scale
+void build_planes(EFSolve &graph, std::vector<SE3> &gt)
+{
+    const uint_t numberPoses = 30, numberPlanes = 150, window = 10, numberPoints = 20;
+    const double noisePoints = 0.01, noisePoses = 0.02;
+    std::srand(1);
+    for (uint_t t = 0; t < numberPoses; ++t)
+    {
+        Mat61 xi = Mat61::Random()*0.1;
+        xi(3) += 0.05*t;
+        SE3 T(xi);
+        gt.push_back(T);
+        SE3 Tini = t == 0 ? T : SE3(Mat61(Mat61::Random()*noisePoses)) * T;
+        std::shared_ptr<Node> n(new NodePose3d(Tini));
+        if (t == 0)
+            n->set_node_mode(Node::ANCHOR);
+        graph.add_node(n);
+    }
+    for (uint_t i = 0; i < numberPlanes; ++i)
+    {
+        uint_t tStart = i % (numberPoses - window + 1);
+        Mat31 normal = Mat31::Random().normalized();
+        Mat31 u1 = normal.unitOrthogonal(), u2 = normal.cross(u1);
+        Mat31 center = gt[tStart + window/2].t() + Mat31::Random()*3.0;
+        std::shared_ptr<PlaneFactor> plane;
+        for (uint_t t = tStart; t < tStart + window; ++t)
+        {
+            Mat4 S = Mat4::Zero();
+            SE3 Tinv = gt[t].inv();
+            for (uint_t p = 0; p < numberPoints; ++p)
+            {
+                Eigen::Array2d ab = Eigen::Array2d::Random()*2.0;
+                Mat31 pw = center + ab(0)*u1 + ab(1)*u2 + normal*noisePoints*Eigen::Matrix<double,1,1>::Random()(0);
+                Mat41 ph;
+                ph << Tinv.transform(pw), 1.0;
+                S += ph * ph.transpose();
+            }
+            if (!plane)
+                plane.reset(new PlaneFactor(S, graph.get_node(t)));
+            else
+                plane->add_observation(S, graph.get_node(t));
+        }
+        graph.add_eigen_factor(plane);
+    }
+}
+
+// Average distance of the trajectory to the ground truth
+double error_trajectory(EFSolve &graph, const std::vector<SE3> &gt)
+{
+    double error = 0.0;
+    for (uint_t t = 0; t < gt.size(); ++t)
+        error += (gt[t].inv() * SE3(Mat4(graph.get_node(t)->get_state()))).ln_vee().norm();
+    return error / gt.size();
+}
+
+int main()
+{
+    // EFSolve converges on both optimization methods: chi2 decreases and the trajectory approaches the GT
+    for (auto optim : {EFSolve::GN, EFSolve::LM})
+    {
+        EFSolve graph(EFSolve::ADJ, optim);
+        std::vector<SE3> gt;
+        build_planes(graph, gt);
+        double chi2Initial = graph.chi2(), errorInitial = error_trajectory(graph, gt);
+        graph.solve(optim, 20);
+        double chi2Final = graph.chi2(), errorFinal = error_trajectory(graph, gt);
+        std::cout << "chi2 " << chi2Initial << " -> " << chi2Final << ", error w.r.t. GT "
+                  << errorInitial << " -> " << errorFinal << std::endl;
+        check(chi2Final < 0.1 * chi2Initial, "EFSolve reduces chi2");
+        check(errorFinal < 0.5 * errorInitial, "EFSolve approaches the ground truth");
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
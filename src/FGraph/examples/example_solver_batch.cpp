@@ -0,0 +1,79 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * example_solver_batch.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+
+#include "mrob/factor_graph_solve_batch.hpp"
+#include "mrob/factor_graph_solve_dense_fixed.hpp"
+#include "mrob/factors/nodePose3d.hpp"
+#include "mrob/factors/factor2Poses3d.hpp"
+
+
+#include <iostream>
+
+int main ()
+{
+    // create many small graphs to solve, each of them a loop:
+    //     X0 (anchor) ----- X1 ----- ... ----- XN ----- X0
+    const uint_t numberGraphs = 1000, numberNodes = 10;
+    // Each graph is solved by a dense solver with fixed size storage (the anchor is not part of the state)
+    typedef mrob::FGraphSolveDenseFixed<6*(numberNodes-1)> GraphType;
+    mrob::FGraphSolveBatch<GraphType> batch(numberGraphs);
+    for (uint_t g = 0; g < numberGraphs; ++g)
+    {
+        std::shared_ptr<GraphType> graph(new GraphType());
+        std::shared_ptr<mrob::Node> n0(new mrob::NodePose3d(mrob::SE3()));
+        n0->set_node_mode(mrob::Node::ANCHOR);
+        graph->add_node(n0);
+        Mat6 obsInformation = Mat6::Identity();
+        auto prev = n0;
+        for (uint_t i = 1; i < numberNodes; ++i)
+        {
+            Mat61 x = Mat61::Random()*0.05;
+            std::shared_ptr<mrob::Node> n(new mrob::NodePose3d(mrob::SE3(x)));
+            graph->add_node(n);
+            Mat61 obs = Mat61::Random()*0.01;
+            obs(3) += 1.0;
+            std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(mrob::SE3(obs),prev,n,obsInformation, true));
+            graph->add_factor(f);
+            prev = n;
+        }
+        // closing the loop
+        Mat61 obs = Mat61::Zero();
+        obs(3) = -1.0*(numberNodes-1);
+        std::shared_ptr<mrob::Factor> f(new mrob::Factor2Poses3d(mrob::SE3(obs),prev,n0,obsInformation));
+        graph->add_factor(f);
+        batch.add_graph(graph);
+    }
+
+    // solve all graphs with Levenberg-Marquardt
+    auto iterations = batch.solve(mrob::Optimizer::LEVENBERG_MARQUARDT_ELLIP, 1e-3);
+    auto errors = batch.calculate_errors();
+    matData_t totalChi2 = 0.0;
+    uint_t totalIterations = 0;
+    for (uint_t g = 0; g < numberGraphs; ++g)
+    {
+        totalChi2 += errors[g];
+        totalIterations += iterations[g];
+    }
+    std::cout << "Solved " << numberGraphs << " graphs, mean iterations = " << double(totalIterations)/numberGraphs
+              << ", mean chi2 = " << totalChi2/numberGraphs << std::endl;
+    return 0;
+}
@@ -26,6 +26,7 @@
 //#include "mrob/CustomCholesky.hpp"
 
 #include <iostream>
+#include <limits>
 #include <Eigen/SparseCore>
 #include <Eigen/SparseLU>
 #include <Eigen/SparseCholesky>
@@ -205,11 +206,6 @@ uint_t FGraphSolve::optimize_levenberg_marquardt(uint_t maxIters)
 
 void FGraphSolve::build_adjacency()
 {
-    // 0) resize properly matrices (if needed)
-    r_.resize(obsDim_,1);//dense vector TODO is it better to reserve and push_back??
-    A_.resize(obsDim_, stateDim_);//Sparse matrix clear data
-    W_.resize(obsDim_, obsDim_);//TODO should we reinitialize this all the time? an incremental should be fairly easy
-
     // 1) create the vector's structures
     std::deque<std::shared_ptr<Factor> >* factors;
     std::deque<std::shared_ptr<Node> >* nodes;
@@ -219,7 +215,8 @@ void FGraphSolve::build_adjacency()
 
     // 2) vector structure to bookkeep the starting Nodes indices inside A
 
-    // 2.2) Node indexes bookeept
+    // 2.2) Node indexes bookeept. Anchor nodes are not part of the state vector,
+    //      so they have no columns in A and their Jacobians are dropped.
     std::vector<uint_t> indNodesMatrix;
     indNodesMatrix.reserve(nodes->size());
 
@@ -227,12 +224,17 @@ void FGraphSolve::build_adjacency()
     for (id_t i = 0; i < nodes->size(); ++i)
     {
         // calculate the indices to access
-        uint_t dim = (*nodes)[i]->get_dim();
         indNodesMatrix.push_back(N_);
-        N_ += dim;
-
+        if ((*nodes)[i]->get_node_mode() == Node::ANCHOR)
+            continue;
+        N_ += (*nodes)[i]->get_dim();
     }
-    assert(N_ == stateDim_ && "FGraphSolve::buildAdjacency: State Dimensions are not coincident\n");
+    assert(N_ <= stateDim_ && "FGraphSolve::buildAdjacency: State Dimensions are not coincident\n");
+
+    // 2.3) resize properly matrices (if needed), once the number of active variables is known
+    r_.resize(obsDim_,1);//dense vector TODO is it better to reserve and push_back??
+    A_.resize(obsDim_, N_);//Sparse matrix clear data
+    W_.resize(obsDim_, obsDim_);//TODO should we reinitialize this all the time? an incremental should be fairly easy
 
     // 3) Evaluate every factor given the current state and bookeeping of Factor indices
     std::vector<uint_t> reservationA;
@@ -251,7 +253,12 @@ void FGraphSolve::build_adjacency()
 
         // calculate dimensions for reservation and bookeping vector
         uint_t dim = f->get_dim();
-        uint_t allDim = f->get_all_nodes_dim();
+        uint_t allDim = 0;
+        for (auto n : *f->get_neighbour_nodes())
+        {
+            if (n->get_node_mode() != Node::ANCHOR)
+                allDim += n->get_dim();
+        }
         for (uint_t j = 0; j < dim; ++j)
         {
             reservationA.push_back(allDim);
@@ -285,6 +292,11 @@ void FGraphSolve::build_adjacency()
             {
                 uint_t indNode = (*neighNodes)[j]->get_id();
                 uint_t dimNode = (*neighNodes)[j]->get_dim();
+                if ((*neighNodes)[j]->get_node_mode() == Node::ANCHOR)
+                {
+                    totalK += dimNode;
+                    continue;
+                }
                 for(uint_t k = 0; k < dimNode; ++k)
                 {
                     // order according to the permutation vector
@@ -351,6 +363,9 @@ void FGraphSolve::update_nodes()
     int acc_start = 0;
     for (uint_t i = 0; i < nodes_.size(); i++)
     {
+        // anchor nodes are not part of dx, they remain constant
+        if (nodes_[i]->get_node_mode() == Node::ANCHOR)
+            continue;
         // node update is the negative of dx just calculated.
         // x = x - alpha * H^(-1) * Grad = x - dx
         // Depending on the optimization, it is already taking care of the step alpha, so we assume alpha = 1
@@ -390,15 +405,41 @@ std::vector<MatX> FGraphSolve::get_estimated_state()
     return results;
 }
 
-MatX1 FGraphSolve::get_chi2_array()
+std::shared_ptr<const MatX> FGraphSolve::get_estimated_state_buffer(uint_t stateSize)
 {
-    MatX1 results(factors_.size());
+    // a new buffer is allocated if the dimensions change, the previous one is released
+    // when it is not shared anymore
+    std::shared_ptr<MatX> &buffer = stateBuffers_[stateSize];
+    if (!buffer || buffer->rows() != (long)nodes_.size())
+        buffer = std::make_shared<MatX>(nodes_.size(), stateSize);
+
+    for (uint_t i = 0; i < nodes_.size(); i++)
+    {
+        auto x = nodes_[i]->get_state();
+        if (x.size() != stateSize)
+        {
+            buffer->row(i).setConstant(std::numeric_limits<matData_t>::quiet_NaN());
+            continue;
+        }
+        // flattened row-wise, such that a 4x4 state is stored as [row0, row1, row2, row3]
+        for (uint_t r = 0; r < x.rows(); ++r)
+            for (uint_t c = 0; c < x.cols(); ++c)
+                (*buffer)(i, r*x.cols() + c) = x(r,c);
+    }
+
+    return buffer;
+}
+
+std::shared_ptr<const MatX1> FGraphSolve::get_chi2_buffer()
+{
+    if (!chi2Buffer_ || chi2Buffer_->rows() != (long)factors_.size())
+        chi2Buffer_ = std::make_shared<MatX1>(factors_.size());
 
     for (uint_t i = 0; i < factors_.size(); ++i)
     {
         auto f = factors_[i];
-        results(i) = f->get_chi2();
+        (*chi2Buffer_)(i) = f->get_chi2();
     }
 
-    return results;
+    return chi2Buffer_;
 }
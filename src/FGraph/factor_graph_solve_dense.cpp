@@ -57,14 +57,7 @@ matData_t FGraphSolveDense::calculate_error()
 }
 void FGraphSolveDense::calculate_gradient_hessian()
 {
-    // 1) calculate dimensionality and resize properly
-    uint_t n = this->get_dimension_state();
-    gradient_.resize(n);
-    gradient_.setZero();
-    hessian_.resize(n,n);
-    hessian_.setZero();
-
-    // 2) evaluate residuals and Jacobians
+    // 1) evaluate residuals and Jacobians
     for (uint_t i = 0; i < factors_.size(); ++i)
     {
         auto f = factors_[i];
@@ -74,78 +67,139 @@ void FGraphSolveDense::calculate_gradient_hessian()
         f->evaluate_chi2();
     }
 
-    // 3) calculate the indexes for the nodes for block allocation
-    std::vector<uint_t> indNodesMatrix, indNodeId;
-    indNodesMatrix.reserve(nodes_.size());
-    indNodeId.reserve(nodes_.size());
-    uint_t N = 0, M = 0;
-    for (id_t i = 0; i < nodes_.size(); ++i)
+    // 2) indexes of the nodes on the state vector
+    uint_t N = index_nodes();
+
+    // 3) resize properly (no reallocation if the graph has not changed). With the sparse
+    //    solver, the Hessian is built directly as a sparse matrix and hessian_ is left empty
+    const bool sparse = linearSolver_ == SPARSE_LDLT;
+    gradient_.resize(N);
+    gradient_.setZero();
+    if (sparse)
+    {
+        hessian_.resize(0,0);
+        hessianTriplets_.clear();
+    }
+    else
     {
-        // calculate the indices to access
-        uint_t dim = nodes_[i]->get_dim();
-        indNodesMatrix.push_back(N);
-        indNodeId.push_back(nodes_[i]->get_id()); //bookkeeps the nodes ids
-        N += dim;
+        hessian_.resize(N,N);
+        hessian_.setZero();
     }
-    assert(N == stateDim_ && "FGraphSolveDense::HessianAndGradient: State Dimensions are not coincident\n");
 
-    // 4) create Hessian and gradient, by traversing all nodes, looking for its factors
-    //    and completing the rows in the Hessian and gradient.
-    for (uint_t n = 0; n < nodes_.size(); ++n)
+    // 4) create Hessian and gradient by scattering the blocks of each factor:
+    //    Grad(n) = \sum J_n'*W*r  and  H(n,m) = \sum J_n'*W*J_m
+    //    The products W*J and W*r are calculated once per factor on the workspace.
+    //    Sparse blocks are accumulated as triplets, repeated entries are summed.
+    for (auto &f : factors_)
     {
-        auto node = nodes_[n];
-        uint_t node_id =  node->get_id();
-        N = node->get_dim();
-        auto factors = node->get_neighbour_factors();
-        for ( uint_t i = 0; i < factors->size(); ++i )
+        auto nodes_connected = f->get_neighbour_nodes();
+        auto J = f->get_jacobian();
+        uint_t D = f->get_dim();
+        uint_t allDim = f->get_all_nodes_dim();
+        Eigen::Map<MatX> WJ(workspace_.data(), D, allDim);
+        Eigen::Map<MatX1> Wr(workspace_.data() + D*allDim, D);
+        WJ.noalias() = f->get_information_matrix() * J;
+        Wr.noalias() = f->get_information_matrix() * f->get_residual();
+
+        uint_t index_n = 0;
+        for (auto &node1 : *nodes_connected)
         {
-            auto f = (*factors)[i];
-            auto nodes_connected = f->get_neighbour_nodes();
-            MatX J = f->get_jacobian();
-            uint_t D = f->get_dim();
-
-            // get the trans Jacobian corresponding to the node n. Always premultiplies in Hessian
-            MatX J_n_t;
-            uint_t matrix_index = 0;
-            for (uint_t m = 0; m < nodes_connected->size() ; ++m)
+            uint_t dim_n = node1->get_dim();
+            // anchor nodes have no block on the Hessian
+            if (node1->get_node_mode() == Node::ANCHOR)
             {
-                if ((*nodes_connected)[m]->get_id() ==  node_id)
-                {
-                    J_n_t = J.block(0, matrix_index, D,N ).transpose();
-                    break;
-                }
-                matrix_index += (*nodes_connected)[m]->get_dim();
+                index_n += dim_n;
+                continue;
             }
+            uint_t row = indNodesMatrix_[node1->get_id()];
+            gradient_.segment(row, dim_n).noalias() += J.block(0, index_n, D, dim_n).transpose() * Wr;
 
-            // Calculate the second part corresponding on the second factor
-            matrix_index = 0;
-            for (uint_t m = 0; m < nodes_connected->size() ; ++m)
+            uint_t index_m = 0;
+            for (auto &node2 : *nodes_connected)
             {
-                auto node2 = (*nodes_connected)[m];
-                M = node2->get_dim();
-                MatX J_m = J.block(0, matrix_index, D,M);
-                matrix_index += M;
-                // Gradient: Grad(n) = \sum J_n_t*W*r
-                gradient_.segment(indNodesMatrix[n], N) +=
-                        J_n_t * f->get_information_matrix() * f->get_residual();
-                // Hessian: H(n,m) = \sum J_n_t'*W*J_m
-                // Look for the corresponding index
-                auto it = std::find(indNodeId.begin(), indNodeId.end(), node2->get_id());
-                uint_t index = std::distance(indNodeId.begin(), it);
-                // Only the current block row is filled in (corresponding to the n-node). We could use a triang view...
-                hessian_.block(indNodesMatrix[n], indNodesMatrix[index],N,M) +=
-                        J_n_t * f->get_information_matrix() * J_m;
+                uint_t dim_m = node2->get_dim();
+                if (node2->get_node_mode() != Node::ANCHOR && sparse)
+                {
+                    uint_t col = indNodesMatrix_[node2->get_id()];
+                    hessianBlock_.noalias() = J.block(0, index_n, D, dim_n).transpose() * WJ.block(0, index_m, D, dim_m);
+                    for (uint_t i = 0; i < dim_n; ++i)
+                        for (uint_t j = 0; j < dim_m; ++j)
+                            hessianTriplets_.emplace_back(row + i, col + j, hessianBlock_(i,j));
+                }
+                else if (node2->get_node_mode() != Node::ANCHOR)
+                {
+                    hessian_.block(row, indNodesMatrix_[node2->get_id()], dim_n, dim_m).noalias() +=
+                            J.block(0, index_n, D, dim_n).transpose() * WJ.block(0, index_m, D, dim_m);
+                }
+                index_m += dim_m;
             }
+            index_n += dim_n;
         }
     }
+    if (sparse)
+    {
+        hessianSparse_.resize(N,N);
+        hessianSparse_.setFromTriplets(hessianTriplets_.begin(), hessianTriplets_.end());
+    }
     //std::cout << "hessian matrix> \n" << hessian_ << std::endl;
 
 }
+void FGraphSolveDense::calculate_gradient()
+{
+    // 1) evaluate Jacobians, residuals are already evaluated by calculate_error()
+    for (auto &f : factors_)
+        f->evaluate_jacobians();
+
+    // 2) only the gradient Grad(n) = \sum J_n'*W*r, the Hessian is not built
+    uint_t N = index_nodes();
+    gradient_.resize(N);
+    gradient_.setZero();
+    for (auto &f : factors_)
+    {
+        auto J = f->get_jacobian();
+        uint_t D = f->get_dim();
+        Eigen::Map<MatX1> Wr(workspace_.data(), D);
+        Wr.noalias() = f->get_information_matrix() * f->get_residual();
+        uint_t index_n = 0;
+        for (auto &node : *f->get_neighbour_nodes())
+        {
+            uint_t dim_n = node->get_dim();
+            if (node->get_node_mode() != Node::ANCHOR)
+                gradient_.segment(indNodesMatrix_[node->get_id()], dim_n).noalias() += J.block(0, index_n, D, dim_n).transpose() * Wr;
+            index_n += dim_n;
+        }
+    }
+}
+uint_t FGraphSolveDense::index_nodes()
+{
+    // Calculate the indexes for the nodes for block allocation. Anchor nodes are
+    // not part of the state, so they are not indexed in the Hessian.
+    // Node ids correspond to their position in nodes_, so the index is direct.
+    // Vectors are kept as members and only reallocate when the graph grows.
+    indNodesMatrix_.clear();
+    uint_t N = 0, maxDimFactor = 0;
+    for (id_t i = 0; i < nodes_.size(); ++i)
+    {
+        indNodesMatrix_.push_back(N);
+        if (nodes_[i]->get_node_mode() == Node::ANCHOR)
+            continue;
+        N += nodes_[i]->get_dim();
+    }
+    assert(N <= stateDim_ && "FGraphSolveDense::index_nodes: State Dimensions are not coincident\n");
+    for (auto &f : factors_)
+        maxDimFactor = std::max(maxDimFactor, f->get_dim() * (f->get_all_nodes_dim() + 1));
+    if (workspace_.size() < maxDimFactor)
+        workspace_.resize(maxDimFactor);
+    return N;
+}
 void FGraphSolveDense::update_state(const MatX1 &dx)
 {
     int acc_start = 0;
     for (uint_t i = 0; i < nodes_.size(); i++)
     {
+        // anchor nodes are not part of dx, they remain constant
+        if (nodes_[i]->get_node_mode() == Node::ANCHOR)
+            continue;
         // node update is the negative of dx just calculated.
         // x = x - alpha * H^(-1) * Grad = x - dx
         // Depending on the optimization, it is already taking care of the step alpha, so we assume alpha = 1
@@ -28,6 +28,9 @@
 #include "mrob/factor_graph.hpp"
 #include "mrob/time_profiling.hpp"
 
+#include <map>
+#include <memory>
+
 namespace mrob {
 
 
@@ -103,12 +106,23 @@ public:
      *      - (default) true: Recalculates residuals.
      *      - false: Uses the previous calculated residuals
      */
-    matData_t chi2(bool evaluateResidualsFlag = true);
+    virtual matData_t chi2(bool evaluateResidualsFlag = true);
     /**
      * Returns a Reference to the solution vector
      * of all variables, vectors, matrices, etc.
      */
     std::vector<MatX> get_estimated_state();
+    /**
+     * Returns a contiguous row-major buffer with the states of all
+     * nodes, one row per node (ordered by id), where each state matrix is flattened
+     * row-wise into stateSize elements, i.e. 3 for 2D poses and 16 for 3D poses.
+     * Nodes whose state has a different size (landmarks, etc.) are filled with NaN.
+     *
+     * There is one buffer per stateSize, kept in the class and updated in place, so
+     * repeated calls do not allocate memory. If the number of nodes changes, a new
+     * buffer is allocated and the buffers returned before remain valid, with the old values.
+     */
+    std::shared_ptr<const MatX> get_estimated_state_buffer(uint_t stateSize);
 
     /**
      * Functions to set the matrix method building
@@ -120,11 +134,17 @@ public:
      * Returns a reference to the information matrix.
      * TODO If true, it re-evaluates the problem
      */
-    SMatCol get_information_matrix() { return L_;}
+    const SMatCol& get_information_matrix() { return L_;}
     /**
      * Returns a vector of chi2 values for each of the factors.
+     * The vector is an internal buffer, only reallocated if the number of factors changes.
      */
-    MatX1 get_chi2_array();
+    const MatX1& get_chi2_array() {return *get_chi2_buffer();}
+    /**
+     * Same as get_chi2_array(), as a shared buffer. If the number of factors changes, a new
+     * buffer is allocated and the buffers returned before remain valid, with the old values.
+     */
+    std::shared_ptr<const MatX1> get_chi2_buffer();
 
 protected:
     /**
@@ -135,8 +155,10 @@ protected:
      *
      * If bool useLambda is true, it also stores a vector D2 containing the diagonal
      * of the information matrix L
+     *
+     * Derived classes may extend the problem with other terms (see EFSolve)
      */
-    void build_problem(bool useLambda = false);
+    virtual void build_problem(bool useLambda = false);
     /**
      * This protected method creates an Adjacency matrix, iterating over
      * all factors in the FG and creates a block diagonal matrix W with each factors information.
@@ -217,6 +239,11 @@ protected:
     // Correction deltas
     MatX1 dx_;
 
+    // Contiguous buffers for exporting the current solution, one per state size. They are
+    // shared, so exported views keep them alive after a reallocation
+    std::map<uint_t, std::shared_ptr<MatX>> stateBuffers_;
+    std::shared_ptr<MatX1> chi2Buffer_;
+
     // Particular parameters for Levenberg-Marquard
     matData_t lambda_; // current value of lambda
     matData_t solutionTolerance_;
@@ -0,0 +1,131 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * factor_graph_solve_batch.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef FACTOR_GRAPH_SOLVE_BATCH_HPP_
+#define FACTOR_GRAPH_SOLVE_BATCH_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/optimizer.hpp"
+#include "mrob/factor_graph_solve_dense.hpp"
+#include "mrob/factor_graph_solve_dense_fixed.hpp"
+
+#include <vector>
+#include <memory>
+#include <cassert>
+
+namespace mrob {
+
+
+/**
+ * Class FGraphSolveBatch solves a collection of small and independent
+ * factor graphs, for instance thousands of graphs of 5-50 nodes, where
+ * the cost of a sparse solver (ordering, symbolic factorization, etc.)
+ * is larger than the problem itself.
+ *
+ * Each graph is solved by a dense solver and graphs are distributed
+ * among threads (OpenMP, if available, otherwise sequentially).
+ * The solution is stored in each of the graphs, as when solving a
+ * single graph.
+ *
+ * The template parameter is the solver of each graph, which requires the methods
+ *  - optimize(method, lambda)
+ *  - calculate_error()
+ * There is no default, the solver must be chosen according to the size of the graphs:
+ * FGraphSolveDenseFixed (recommended) has fixed-size storage and does not allocate memory
+ * once the graphs are built, FGraphSolveDense is for graphs without a bound on their size.
+ *
+ * Graphs must be independent, i.e., nodes and factors can not be shared
+ * between two graphs of the same batch, since they are updated concurrently.
+ */
+template<typename GraphType>
+class FGraphSolveBatch
+{
+  public:
+    FGraphSolveBatch(uint_t potNumberGraphs = 64)
+    {
+        graphs_.reserve(potNumberGraphs);
+    }
+    ~FGraphSolveBatch() = default;
+
+    /**
+     * Adds a graph to the batch. Returns the index of the graph in the batch.
+     */
+    uint_t add_graph(const std::shared_ptr<GraphType> &graph)
+    {
+        graphs_.push_back(graph);
+        return graphs_.size() - 1;
+    }
+    /**
+     * Returns the graph at position key
+     */
+    std::shared_ptr<GraphType>& get_graph(uint_t key)
+    {
+        assert(key < graphs_.size() && "FGraphSolveBatch::get_graph: incorrect key");
+        return graphs_[key];
+    }
+    uint_t number_graphs() const {return graphs_.size();}
+    void clear() {graphs_.clear(); iterations_.clear(); errors_.clear();}
+
+    /**
+     * Solves all the graphs in the batch, in parallel. The solution
+     * of each problem is updated on the nodes of each graph.
+     *
+     * Input: optimization method and lambda for LM (see Optimizer)
+     * Output: vector with the number of iterations required for each graph. Graphs are
+     * solved silently, on LM the maximum number of iterations indicates no convergence.
+     */
+    const std::vector<uint_t>& solve(Optimizer::optimMethod method = Optimizer::NEWTON_RAPHSON, double lambda = 1e-5)
+    {
+        iterations_.resize(graphs_.size());
+        const long numberGraphs = graphs_.size();
+        // dynamic scheduling, graphs could have different sizes
+        #pragma omp parallel for schedule(dynamic)
+        for (long i = 0; i < numberGraphs; ++i)
+        {
+            iterations_[i] = graphs_[i]->optimize(method, lambda);
+        }
+        return iterations_;
+    }
+
+    /**
+     * Calculates the current error (chi2) of each graph.
+     */
+    const std::vector<matData_t>& calculate_errors()
+    {
+        errors_.resize(graphs_.size());
+        const long numberGraphs = graphs_.size();
+        #pragma omp parallel for schedule(dynamic)
+        for (long i = 0; i < numberGraphs; ++i)
+        {
+            errors_[i] = graphs_[i]->calculate_error();
+        }
+        return errors_;
+    }
+
+  protected:
+    std::vector<std::shared_ptr<GraphType>> graphs_;
+    std::vector<uint_t> iterations_;
+    std::vector<matData_t> errors_;
+};
+
+
+}//namespace
+
+#endif /* FACTOR_GRAPH_SOLVE_BATCH_HPP_ */
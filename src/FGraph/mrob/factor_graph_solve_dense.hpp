@@ -28,6 +28,8 @@
 #include "mrob/factor_graph.hpp"
 #include "mrob/time_profiling.hpp"
 
+#include <vector>
+
 namespace mrob {
 
 
@@ -35,6 +37,9 @@ namespace mrob {
  * Class FGraphSolveDense solve a factor graph problem asuming dense
  * precision matrix.
  *
+ * The Hessian is dense, unless the sparse linear solver is selected (Optimizer::SPARSE_LDLT),
+ * then it is built directly as a sparse matrix, without the dense N x N storage.
+ *
  * It inherits from two classes:
  *  - FGraph: structure for adding generic factors
  *  - Optimizer: Optimization methods given some abstract routines
@@ -48,10 +53,30 @@ class FGraphSolveDense: public FGraph, public Optimizer
     // Function from the parent class Optimizer
     virtual matData_t calculate_error() override;
     virtual void calculate_gradient_hessian() override;
+    /**
+     * Gradient only, for first order methods (L-BFGS, CG), the Hessian is not built.
+     * It is called after calculate_error(), which evaluates the residuals.
+     */
+    virtual void calculate_gradient() override;
     virtual void update_state(const MatX1 &dx) override;
     virtual void bookkeep_state() override;
     virtual void update_state_from_bookkeep() override;
 
+  protected:
+    /**
+     * Calculates the index of each node on the state vector and reserves the workspace.
+     * Returns the dimension of the state.
+     */
+    uint_t index_nodes();
+
+    // Index of each node on the state vector, indexed by node id
+    std::vector<uint_t> indNodesMatrix_;
+    // Storage for the per-factor products W*J and W*r, reused across iterations
+    std::vector<matData_t> workspace_;
+    // Sparse Hessian (SPARSE_LDLT): blocks as triplets, reused across iterations
+    std::vector<Eigen::Triplet<matData_t>> hessianTriplets_;
+    MatX hessianBlock_;
+
 };
 
 
@@ -0,0 +1,351 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * factor_graph_solve_dense_fixed.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef FACTOR_GRAPH_SOLVE_DENSE_FIXED_HPP_
+#define FACTOR_GRAPH_SOLVE_DENSE_FIXED_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/optimizer.hpp"
+#include "mrob/factor_graph.hpp"
+
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+#include <vector>
+#include <stdexcept>
+#include <cassert>
+#include <cmath>
+
+namespace mrob {
+
+
+/**
+ * Class FGraphSolveDenseFixed solves small factor graph problems with
+ * a dense precision matrix whose dimension is bounded at compile time.
+ *
+ * Template parameters:
+ *  - MaxStateDim: maximum dimension of the state (sum of all non-anchor nodes)
+ *  - MaxFactorDim: maximum dimension of the observation of any factor
+ *  - MaxFactorNodesDim: maximum summation of the dimensions of the nodes of any factor
+ *
+ * All matrices have their storage inside the object (no dynamic memory), so
+ * once the graph has been built, there are no heap allocations on each
+ * iteration:
+ *  - Gradient and Hessian are built by scattering the blocks of each factor
+ *    J_n'*W*r and J_n'*W*J_m, where nodes are indexed directly by their id.
+ *  - The linear system is solved by an LDLT factorization of the damped
+ *    Hessian (preallocated in the object) instead of calculating its inverse.
+ *  - On LM, when a step is rejected only the damping changes, so the
+ *    Hessian is not recalculated. On the first rejection, the eigendecomposition
+ *    of the (scaled) Hessian is calculated, and each further lambda is solved from
+ *    it in O(n^2) instead of a new LDLT factorization (see Optimizer::solve_step).
+ *
+ * Only the second order methods NR, LM_S and LM_E are available.
+ *
+ * The interface is the same as Optimizer (optimize, calculate_error), so it
+ * can be used in FGraphSolveBatch as well.
+ */
+template<int MaxStateDim, int MaxFactorDim = 6, int MaxFactorNodesDim = 12>
+class FGraphSolveDenseFixed: public FGraph
+{
+  public:
+    typedef Eigen::Matrix<matData_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::ColMajor, MaxStateDim, MaxStateDim> HessianType;
+    typedef Eigen::Matrix<matData_t, Eigen::Dynamic, 1, Eigen::ColMajor, MaxStateDim, 1> GradientType;
+    typedef Eigen::Matrix<matData_t, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, MaxFactorDim, MaxFactorNodesDim> FactorJacobianType;
+    typedef Eigen::Matrix<matData_t, Eigen::Dynamic, 1, Eigen::ColMajor, MaxFactorDim, 1> FactorResidualType;
+
+    FGraphSolveDenseFixed(matData_t solutionTolerance = 1e-4, uint_t maxIters = 100):
+        FGraph(), solutionTolerance_(solutionTolerance), maxIters_(maxIters),
+        lambda_(1e-5), eigenValid_(false)
+    {
+    }
+    ~FGraphSolveDenseFixed() = default;
+
+    /**
+     * Optimization call.
+     * Input: optimization method from {NR=0, LM_S, LM_E} and lambda for LM
+     * output: number of iterations
+     * First order methods (LBFGS, NONLINEAR_CG) are not available and throw std::invalid_argument
+     */
+    uint_t optimize(Optimizer::optimMethod method, double lambda = 1e-5)
+    {
+        optimization_method_ = method;
+        lambda_ = lambda;
+        switch(method)
+        {
+          case Optimizer::NEWTON_RAPHSON:
+            return optimize_newton_raphson();
+          case Optimizer::LEVENBERG_MARQUARDT_SPHER:
+          case Optimizer::LEVENBERG_MARQUARDT_ELLIP:
+            return optimize_levenberg_marquardt();
+          default:
+            throw std::invalid_argument("FGraphSolveDenseFixed::optimize: only NR and LM methods are available");
+        }
+    }
+
+    /**
+     * Calculates the total chi2 of the graph, and re-evaluates residuals
+     */
+    matData_t calculate_error()
+    {
+        matData_t totalChi2 = 0.0;
+        for (auto &f : factors_)
+        {
+            f->evaluate_residuals();
+            f->evaluate_chi2();
+            totalChi2 += f->get_chi2();
+        }
+        return totalChi2;
+    }
+
+    /**
+     * Calculates gradient and Hessian (undamped) at the current state.
+     */
+    void calculate_gradient_hessian()
+    {
+        // 1) evaluate residuals and Jacobians
+        for (auto &f : factors_)
+        {
+            f->evaluate_residuals();
+            f->evaluate_jacobians();
+            f->evaluate_chi2();
+        }
+
+        // 2) indexes of the nodes on the state vector. No allocation once the graph is built
+        indNodesMatrix_.clear();
+        uint_t N = 0;
+        for (auto &n : nodes_)
+        {
+            indNodesMatrix_.push_back(N);
+            if (n->get_node_mode() == Node::ANCHOR)
+                continue;
+            N += n->get_dim();
+        }
+        assert(N <= MaxStateDim && "FGraphSolveDenseFixed::calculate_gradient_hessian: state dimension exceeds MaxStateDim");
+        gradient_.setZero(N);
+        hessian_.setZero(N,N);
+
+        // 3) scatter the blocks of each factor: Grad(n) += J_n'*W*r, H(n,m) += J_n'*W*J_m
+        for (auto &f : factors_)
+        {
+            uint_t D = f->get_dim();
+            uint_t allDim = f->get_all_nodes_dim();
+            assert(D <= MaxFactorDim && allDim <= MaxFactorNodesDim &&
+                   "FGraphSolveDenseFixed::calculate_gradient_hessian: factor dimensions exceed the template bounds");
+            auto J = f->get_jacobian();
+            WJ_.resize(D, allDim);
+            WJ_.noalias() = f->get_information_matrix() * J;
+            Wr_.resize(D);
+            Wr_.noalias() = f->get_information_matrix() * f->get_residual();
+
+            auto nodes_connected = f->get_neighbour_nodes();
+            uint_t index_n = 0;
+            for (auto &node1 : *nodes_connected)
+            {
+                uint_t dim_n = node1->get_dim();
+                if (node1->get_node_mode() == Node::ANCHOR)
+                {
+                    index_n += dim_n;
+                    continue;
+                }
+                uint_t row = indNodesMatrix_[node1->get_id()];
+                gradient_.segment(row, dim_n).noalias() += J.block(0, index_n, D, dim_n).transpose() * Wr_;
+                uint_t index_m = 0;
+                for (auto &node2 : *nodes_connected)
+                {
+                    uint_t dim_m = node2->get_dim();
+                    if (node2->get_node_mode() != Node::ANCHOR)
+                    {
+                        hessian_.block(row, indNodesMatrix_[node2->get_id()], dim_n, dim_m).noalias() +=
+                                J.block(0, index_n, D, dim_n).transpose() * WJ_.block(0, index_m, D, dim_m);
+                    }
+                    index_m += dim_m;
+                }
+                index_n += dim_n;
+            }
+        }
+    }
+
+    const GradientType& get_gradient() const {return gradient_;}
+    const HessianType& get_hessian() const {return hessian_;}
+
+  protected:
+    /**
+     * Damps the Hessian according to the method, factorizes and solves
+     * dx = - (H + lambda*D)^-1 * grad.
+     *
+     * Input newHessian false indicates the Hessian has already been solved for another
+     * lambda (LM rejected step), then the step is solved by solve_step_eigen() if possible.
+     */
+    void solve_step(bool useLambda, bool newHessian = true)
+    {
+        if (newHessian)
+            eigenValid_ = false;
+        else if (useLambda && solve_step_eigen())
+            return;
+        damped_ = hessian_;
+        if (useLambda)
+        {
+            if (optimization_method_ == Optimizer::LEVENBERG_MARQUARDT_SPHER)
+                damped_.diagonal().array() += lambda_;
+            if (optimization_method_ == Optimizer::LEVENBERG_MARQUARDT_ELLIP)
+                damped_.diagonal() *= 1.0 + lambda_;
+        }
+        ldlt_.compute(damped_);
+        dx_ = -gradient_;
+        ldlt_.solveInPlace(dx_);
+    }
+    /**
+     * Solves the damped step from the eigendecomposition of S*H*S, with S = D^-1/2 for LM_E
+     * and S = I for LM_S, calculated once per Hessian:
+     * dx = - S * V * (Lambda + lambda * I)^-1 * V' * S * grad.
+     * Output: false if the damped Hessian is not positive definite (or D is not), then
+     * the step must be solved by a factorization.
+     */
+    bool solve_step_eigen()
+    {
+        if (!eigenValid_)
+        {
+            if (optimization_method_ == Optimizer::LEVENBERG_MARQUARDT_ELLIP)
+            {
+                if ((hessian_.diagonal().array() <= 0.0).any())
+                    return false;
+                eigenScale_ = hessian_.diagonal().cwiseSqrt().cwiseInverse();
+            }
+            else
+                eigenScale_.setOnes(hessian_.rows());
+            damped_ = eigenScale_.asDiagonal() * hessian_ * eigenScale_.asDiagonal();
+            eigen_.compute(damped_);
+            if (eigen_.info() != Eigen::Success)
+                return false;
+            eigenGradient_.noalias() = eigen_.eigenvectors().transpose() * eigenScale_.cwiseProduct(gradient_);
+            eigenValid_ = true;
+        }
+        eigenDamped_ = eigen_.eigenvalues().array() + lambda_;
+        if (eigenDamped_.minCoeff() <= 0.0)
+            return false;
+        dx_.noalias() = eigen_.eigenvectors() * eigenGradient_.cwiseQuotient(eigenDamped_);
+        dx_ = - eigenScale_.cwiseProduct(dx_);
+        return true;
+    }
+    void update_state()
+    {
+        uint_t acc_start = 0;
+        for (auto &n : nodes_)
+        {
+            if (n->get_node_mode() == Node::ANCHOR)
+                continue;
+            n->update(dx_.segment(acc_start, n->get_dim()));
+            acc_start += n->get_dim();
+        }
+    }
+    void bookkeep_state()
+    {
+        for (auto &n : nodes_)
+            n->set_auxiliary_state(n->get_state());
+    }
+    void update_state_from_bookkeep()
+    {
+        for (auto &n : nodes_)
+            n->set_state(n->get_auxiliary_state());
+    }
+
+    uint_t optimize_newton_raphson()
+    {
+        uint_t iters = 0;
+        matData_t previous_error = calculate_error(), diff_error;
+        do
+        {
+            calculate_gradient_hessian();
+            solve_step(false);
+            update_state();
+            matData_t current_error = calculate_error();
+            diff_error = previous_error - current_error;
+            previous_error = current_error;
+            iters++;
+        }while(std::fabs(diff_error) > solutionTolerance_ && iters < maxIters_);
+        return iters;
+    }
+
+    /**
+     * Levenberg-Marquardt trust region, lambda is updated as in Optimizer
+     * (see Optimizer::update_lambda). Rejected steps reuse the current Hessian and gradient.
+     */
+    uint_t optimize_levenberg_marquardt()
+    {
+        uint_t iters = 0;
+        matData_t previous_error = calculate_error(), diff_error, current_error;
+        bool rebuild = true;
+        do
+        {
+            iters++;
+            if (rebuild)
+                calculate_gradient_hessian();
+            bookkeep_state();
+            solve_step(true, rebuild);
+            update_state();
+            current_error = calculate_error();
+            diff_error = previous_error - current_error;
+
+            // step rejected, the state (and thus H and grad) remain the same
+            if (diff_error < 0)
+            {
+                lambda_ = Optimizer::update_lambda(lambda_, diff_error, 0.0);
+                update_state_from_bookkeep();
+                rebuild = false;
+                continue;
+            }
+            rebuild = true;
+            previous_error = current_error;
+            if (diff_error < solutionTolerance_)
+                return iters;
+
+            // model decrease -m(dx) = -dx'*grad - 0.5*dx'*(H + lambda*D)*dx
+            matData_t modelDecrease = -dx_.dot(gradient_) - 0.5*dx_.dot(hessian_ * dx_);
+            if (optimization_method_ == Optimizer::LEVENBERG_MARQUARDT_SPHER)
+                modelDecrease -= 0.5*lambda_*dx_.squaredNorm();
+            else
+                modelDecrease -= 0.5*lambda_*dx_.dot(hessian_.diagonal().cwiseProduct(dx_));
+            lambda_ = Optimizer::update_lambda(lambda_, diff_error, modelDecrease);
+        }while(iters < maxIters_);
+
+        return iters;
+    }
+
+    Optimizer::optimMethod optimization_method_;
+    matData_t solutionTolerance_;
+    uint_t maxIters_;
+    matData_t lambda_;
+
+    GradientType gradient_, dx_;
+    HessianType hessian_, damped_;
+    Eigen::LDLT<HessianType> ldlt_;
+    // Eigendecomposition of the scaled Hessian for LM rejected steps, see solve_step_eigen()
+    Eigen::SelfAdjointEigenSolver<HessianType> eigen_;
+    GradientType eigenScale_, eigenGradient_, eigenDamped_;
+    bool eigenValid_;
+    FactorJacobianType WJ_;
+    FactorResidualType Wr_;
+    std::vector<uint_t> indNodesMatrix_;
+};
+
+
+}//namespace
+
+#endif /* FACTOR_GRAPH_SOLVE_DENSE_FIXED_HPP_ */
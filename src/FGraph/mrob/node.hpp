@@ -51,10 +51,21 @@ class Factor;
  *	Two states are kept at the same time:
  *	- (principal) state: used for factors evaluations, errors and Jacobians
  *	- auxiliary state: a book-keep state useful for partial updates
+ *
+ *	Each node has a mode, indicating how it is treated by the solvers:
+ *	- STANDARD: the node is part of the state vector and gets optimized
+ *	- ANCHOR: the node is kept constant. It is not included in the state vector
+ *	  nor in the linear system, but factors still evaluate it. This is the
+ *	  natural way of fixing the gauge freedom, or freezing a subset of the graph.
  */
 
 class Node{
   public:
+    /**
+     * This enums the node modes available
+     */
+    enum nodeMode{STANDARD=0, ANCHOR};
+
     Node(uint_t dim, uint_t potNumberFactors = 5);
     virtual ~Node();
     /**
@@ -102,6 +113,12 @@ class Node{
     uint_t get_id() const {return id_;};
     void set_id(uint_t id) {id_ = id;};
     uint_t get_dim(void) const {return dim_;};
+    /**
+     * Node mode: STANDARD (default) or ANCHOR, where the node is excluded from
+     * the optimization and its state remains constant.
+     */
+    void set_node_mode(nodeMode mode) {nodeMode_ = mode;};
+    nodeMode get_node_mode() const {return nodeMode_;};
     /**
      * Adds a factor to the list of factors connected to this node.
      */
@@ -120,6 +137,7 @@ class Node{
     std::vector<std::shared_ptr<Factor> > neighbourFactors_;
     uint_t id_;
     uint_t dim_;
+    nodeMode nodeMode_;
     /**
      * On this pure abstract class we can't define a vector state,
      * but we will return and process Ref<> to dynamic matrices.
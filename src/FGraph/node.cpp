@@ -26,7 +26,7 @@
 using namespace mrob;
 
 Node::Node(uint_t dim, uint_t potNumberFactors):
-		 id_(0), dim_(dim)
+		 id_(0), dim_(dim), nodeMode_(STANDARD)
 {
     neighbourFactors_.reserve( potNumberFactors );
 }
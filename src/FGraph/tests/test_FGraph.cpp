@@ -0,0 +1,298 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_FGraph.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+// Eigen checks heap allocations when they are disabled: this test, FGraph and its dependencies
+// are compiled with EIGEN_RUNTIME_NO_MALLOC and asserts (see tests/CMakeLists.txt)
+
+#include "mrob/factor_graph_solve_dense.hpp"
+#include "mrob/factor_graph_solve_dense_fixed.hpp"
+#include "mrob/factor_graph_solve_batch.hpp"
+#include "mrob/factor_graph_solve.hpp"
+#include "mrob/factors/nodePose2d.hpp"
+#include "mrob/factors/nodePose3d.hpp"
+#include "mrob/factors/factor1Pose3d.hpp"
+#include "mrob/factors/factor2Poses3d.hpp"
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+
+
+using namespace mrob;
+
+typedef FGraphSolveDenseFixed<54> FGraphFixed;
+
+static int failures = 0;
+
+void check(bool condition, const char *name)
+{
+    std::cout << (condition ? "[  OK  ] " : "[ FAIL ] ") << name << std::endl;
+    if (!condition)
+        failures++;
+}
+
+// Pose graph of a loop of numberNodes poses with noisy odometry, the first pose is the anchor
+template<class Graph>
+void build_loop(Graph &graph, uint_t seed, uint_t numberNodes = 10)
+{
+    std::srand(seed);
+    std::shared_ptr<Node> n0(new NodePose3d(SE3()));
+    n0->set_node_mode(Node::ANCHOR);
+    graph.add_node(n0);
+    Mat6 W = Mat6::Identity();
+    std::shared_ptr<Node> previous = n0;
+    SE3 odometry;
+    for (uint_t i = 1; i < numberNodes; ++i)
+    {
+        std::shared_ptr<Node> n(new NodePose3d(SE3()));
+        graph.add_node(n);
+        Mat61 obs = Mat61::Random()*0.01;
+        obs(3) += 1.0;
+        odometry = odometry * SE3(obs);
+        // the node is initialized by the odometry
+        std::shared_ptr<Factor> f(new Factor2Poses3d(SE3(obs), previous, n, W, true));
+        graph.add_factor(f);
+        previous = n;
+    }
+    // the loop closure disagrees with the accumulated odometry
+    Mat61 noise = Mat61::Random()*0.05;
+    std::shared_ptr<Factor> f(new Factor2Poses3d(odometry * SE3(noise), n0, previous, W));
+    graph.add_factor(f);
+}
+
+// Access to the dense Hessian for comparison
+class FGraphDenseTest: public FGraphSolveDense
+{
+  public:
+    const MatX& get_dense_hessian() const {return hessian_;}
+    // step for lambda2 on a Hessian already solved for lambda1 (LM rejected step), and by a new factorization
+    void retry_steps(optimMethod method, matData_t lambda1, matData_t lambda2, MatX1 &dxRetry, MatX1 &dxFactorized)
+    {
+        optimization_method_ = method;
+        calculate_gradient_hessian();
+        lambda_ = lambda1;
+        solve_step(true, true);
+        lambda_ = lambda2;
+        solve_step(true, false);
+        dxRetry = dx_;
+        calculate_gradient_hessian();
+        solve_step(true, true);
+        dxFactorized = dx_;
+    }
+};
+
+// Access to the steps of DenseFixed, as FGraphDenseTest
+class FGraphFixedTest: public FGraphFixed
+{
+  public:
+    void retry_steps(Optimizer::optimMethod method, matData_t lambda1, matData_t lambda2, GradientType &dxRetry, GradientType &dxFactorized)
+    {
+        optimization_method_ = method;
+        calculate_gradient_hessian();
+        lambda_ = lambda1;
+        solve_step(true, true);
+        lambda_ = lambda2;
+        solve_step(true, false);
+        dxRetry = dx_;
+        solve_step(true, true);
+        dxFactorized = dx_;
+    }
+};
+
+int main()
+{
+    // 1) FGraphSolveDenseFixed is the same problem as FGraphSolveDense, on every method
+    for (auto method : {Optimizer::NEWTON_RAPHSON, Optimizer::LEVENBERG_MARQUARDT_SPHER, Optimizer::LEVENBERG_MARQUARDT_ELLIP})
+    {
+        FGraphSolveDense dense;
+        build_loop(dense, 1);
+        FGraphFixed fixed;
+        build_loop(fixed, 1);
+        dense.optimize(method, 1e-3);
+        fixed.optimize(method, 1e-3);
+        double chi2Dense = dense.calculate_error(), chi2Fixed = fixed.calculate_error();
+        check(std::fabs(chi2Dense - chi2Fixed) < 1e-8 * (1.0 + chi2Dense), "DenseFixed converges to the chi2 of Dense");
+    }
+    {
+        FGraphDenseTest dense;
+        build_loop(dense, 3);
+        FGraphFixed fixed;
+        build_loop(fixed, 3);
+        dense.calculate_gradient_hessian();
+        fixed.calculate_gradient_hessian();
+        check((fixed.get_hessian() - dense.get_dense_hessian()).norm() < 1e-9, "DenseFixed Hessian equals Dense Hessian");
+    }
+
+    // 1.1) LM retries solved by the eigendecomposition are the steps of the damped factorization
+    for (auto method : {Optimizer::LEVENBERG_MARQUARDT_SPHER, Optimizer::LEVENBERG_MARQUARDT_ELLIP})
+    {
+        FGraphDenseTest dense;
+        build_loop(dense, 4);
+        MatX1 dxRetry, dxFactorized;
+        dense.retry_steps(method, 1e-3, 1e-1, dxRetry, dxFactorized);
+        check((dxRetry - dxFactorized).norm() < 1e-9 * (1.0 + dxFactorized.norm()), "LM rejected step reuses the Hessian eigendecomposition");
+    }
+
+    // 1.2) the same for DenseFixed, without heap allocations. First order methods are not available
+    for (auto method : {Optimizer::LEVENBERG_MARQUARDT_SPHER, Optimizer::LEVENBERG_MARQUARDT_ELLIP})
+    {
+        FGraphFixedTest fixed;
+        build_loop(fixed, 4);
+        FGraphFixedTest::GradientType dxRetry, dxFactorized;
+        fixed.calculate_gradient_hessian();
+        Eigen::internal::set_is_malloc_allowed(false);
+        fixed.retry_steps(method, 1e-3, 1e-1, dxRetry, dxFactorized);
+        Eigen::internal::set_is_malloc_allowed(true);
+        check((dxRetry - dxFactorized).norm() < 1e-9 * (1.0 + dxFactorized.norm()), "DenseFixed LM rejected step reuses the Hessian eigendecomposition");
+    }
+    for (auto method : {Optimizer::LBFGS, Optimizer::NONLINEAR_CG})
+    {
+        FGraphFixed fixed;
+        build_loop(fixed, 4);
+        bool thrown = false;
+        try
+        {
+            fixed.optimize(method);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        check(thrown, "DenseFixed with a first order method throws");
+    }
+
+    // 2) once the graph is built, DenseFixed iterates without heap allocations, including the
+    //    factors and the geometry (Eigen aborts otherwise), and reaches the solution of Dense
+    for (auto method : {Optimizer::LEVENBERG_MARQUARDT_ELLIP, Optimizer::NEWTON_RAPHSON})
+    {
+        FGraphSolveDense dense;
+        build_loop(dense, 5);
+        dense.optimize(method, 1e-3);
+        FGraphFixed fixed;
+        build_loop(fixed, 5);
+        fixed.calculate_gradient_hessian();
+        Eigen::internal::set_is_malloc_allowed(false);
+        fixed.optimize(method, 1e-3);
+        matData_t chi2Fixed = fixed.calculate_error();
+        Eigen::internal::set_is_malloc_allowed(true);
+        double chi2Dense = dense.calculate_error();
+        check(std::fabs(chi2Dense - chi2Fixed) < 1e-8 * (1.0 + chi2Dense), "DenseFixed optimizes without heap allocations to the chi2 of Dense");
+    }
+
+    // 3) the linear solvers of Dense reach the same solution
+    {
+        double chi2[3];
+        for (auto solver : {Optimizer::DENSE_LDLT, Optimizer::DENSE_CHOLESKY, Optimizer::SPARSE_LDLT})
+        {
+            FGraphSolveDense dense;
+            build_loop(dense, 7, 30);
+            dense.set_linear_solver(solver);
+            dense.optimize(Optimizer::LEVENBERG_MARQUARDT_ELLIP, 1e-3);
+            chi2[solver] = dense.calculate_error();
+        }
+        check(std::fabs(chi2[0] - chi2[1]) < 1e-8 * (1.0 + chi2[0]) && std::fabs(chi2[0] - chi2[2]) < 1e-8 * (1.0 + chi2[0]),
+              "Dense LDLT, Cholesky and sparse LDLT reach the same chi2");
+    }
+
+    // 3.1) first order methods reach the solution of LM without building a Hessian
+    for (auto method : {Optimizer::LBFGS, Optimizer::NONLINEAR_CG})
+    {
+        FGraphSolveDense reference;
+        build_loop(reference, 2);
+        reference.optimize(Optimizer::LEVENBERG_MARQUARDT_ELLIP, 1e-3);
+        double chi2Reference = reference.calculate_error();
+        FGraphDenseTest dense;
+        build_loop(dense, 2);
+        dense.set_max_iterations(1000);
+        dense.optimize(method);
+        double chi2 = dense.calculate_error();
+        check(std::fabs(chi2 - chi2Reference) < 1e-2 * chi2Reference && dense.get_dense_hessian().size() == 0,
+              method == Optimizer::LBFGS ? "L-BFGS converges on FGraphSolveDense without a Hessian" :
+                                           "Nonlinear CG converges on FGraphSolveDense without a Hessian");
+    }
+
+    // 4) iteration limit and L-BFGS memory
+    {
+        FGraphSolveDense dense;
+        build_loop(dense, 9);
+        dense.set_max_iterations(1);
+        check(dense.optimize(Optimizer::NEWTON_RAPHSON) == 1, "NR stops at the maximum number of iterations");
+        bool thrown = false;
+        try
+        {
+            dense.set_lbfgs_memory(0);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        check(thrown, "L-BFGS memory of 0 throws");
+    }
+
+    // 5) a batch of graphs solved in parallel equals solving each graph sequentially
+    {
+        const uint_t numberGraphs = 32;
+        FGraphSolveBatch<FGraphFixed> batch(numberGraphs);
+        std::vector<std::shared_ptr<FGraphFixed>> sequential;
+        for (uint_t g = 0; g < numberGraphs; ++g)
+        {
+            std::shared_ptr<FGraphFixed> graph(new FGraphFixed());
+            build_loop(*graph, 100 + g);
+            batch.add_graph(graph);
+            sequential.emplace_back(new FGraphFixed());
+            build_loop(*sequential.back(), 100 + g);
+        }
+        const std::vector<uint_t> &iterations = batch.solve(Optimizer::LEVENBERG_MARQUARDT_ELLIP, 1e-3);
+        const std::vector<matData_t> &errors = batch.calculate_errors();
+        bool sameSolution = true;
+        for (uint_t g = 0; g < numberGraphs; ++g)
+        {
+            uint_t iters = sequential[g]->optimize(Optimizer::LEVENBERG_MARQUARDT_ELLIP, 1e-3);
+            matData_t chi2 = sequential[g]->calculate_error();
+            sameSolution &= iters == iterations[g] && std::fabs(chi2 - errors[g]) < 1e-12 * (1.0 + chi2);
+            for (uint_t n = 0; n < sequential[g]->number_nodes(); ++n)
+                sameSolution &= (sequential[g]->get_node(n)->get_state() - batch.get_graph(g)->get_node(n)->get_state()).norm() < 1e-12;
+        }
+        check(sameSolution, "FGraphSolveBatch equals solving each graph sequentially");
+    }
+
+    // 6) exported state buffers: one per state size, previous buffers stay valid after a reallocation
+    {
+        FGraphSolve graph;
+        build_loop(graph, 11);
+        std::shared_ptr<Node> n2d(new NodePose2d(Mat31(1.0, 2.0, 0.5)));
+        graph.add_node(n2d);
+        auto states3d = graph.get_estimated_state_buffer(16);
+        auto states2d = graph.get_estimated_state_buffer(3);
+        bool mixed = states3d->rows() == 11 && states2d->rows() == 11 && states3d != states2d &&
+                     (*states3d)(0,0) == 1.0 && std::isnan((*states3d)(10,0)) &&
+                     std::isnan((*states2d)(0,0)) && (*states2d)(10,1) == 2.0;
+        check(mixed, "2D and 3D state buffers are independent");
+        std::shared_ptr<Node> n3d(new NodePose3d(SE3()));
+        graph.add_node(n3d);
+        auto grown3d = graph.get_estimated_state_buffer(16);
+        check(grown3d->rows() == 12 && states3d->rows() == 11 && (*states3d)(0,0) == 1.0,
+              "a reallocated state buffer leaves the previous one valid");
+    }
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -25,57 +25,87 @@
 #include <Eigen/SVD>
 
 #include <memory>
+#include <vector>
+#include <algorithm>
 #include <iostream>
 #include "mrob/pc_registration.hpp"
 
 using namespace mrob;
 using namespace Eigen;
 
+namespace {
+
+// large point sets are accumulated in parallel blocks, merged in block order
+const long arunBlockSize = 4096;
+
+}
+
 int PCRegistration::arun(const Ref<const MatX> X, const Ref<const MatX> Y, SE3 &T)
 {
     assert(X.cols() == 3  && "PCRegistration::Arun: Incorrect sizing, we expect Nx3");
     assert(X.rows() >= 3  && "PCRegistration::Arun: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
     assert(Y.rows() == X.rows()  && "PCRegistration::Arun: Same number of correspondences");
-    uint_t N = X.rows();
+    const long N = X.rows();
+    ArunAccumulator accumulator;
+    if (N <= arunBlockSize)
+    {
+        for (long i = 0; i < N; ++i)
+            accumulator.add(X.row(i).transpose(), Y.row(i).transpose());
+        return accumulator.solve(T);
+    }
+    const long numberBlocks = (N + arunBlockSize - 1) / arunBlockSize;
+    std::vector<ArunAccumulator> blockAccumulators(numberBlocks);
+    #pragma omp parallel for schedule(static)
+    for (long b = 0; b < numberBlocks; ++b)
+        for (long i = b*arunBlockSize; i < std::min(N, (b+1)*arunBlockSize); ++i)
+            blockAccumulators[b].add(X.row(i).transpose(), Y.row(i).transpose());
+    for (auto &block : blockAccumulators)
+        accumulator.merge(block);
+    return accumulator.solve(T);
+}
+
+void PCRegistration::ArunAccumulator::merge(const ArunAccumulator &other)
+{
+    if (other.N_ == 0)
+        return;
+    if (N_ == 0)
+    {
+        *this = other;
+        return;
+    }
+    // sums of other are relative to its reference, x - x0 = (x - x0') + a, with a = x0' - x0
+    const Mat31 a = other.x0_ - x0_, b = other.y0_ - y0_;
+    sumXY_.noalias() += other.sumXY_ + other.sumX_ * b.transpose() + a * other.sumY_.transpose()
+                        + double(other.N_) * a * b.transpose();
+    sumX_ += other.sumX_ + double(other.N_) * a;
+    sumY_ += other.sumY_ + double(other.N_) * b;
+    N_ += other.N_;
+}
+
+int PCRegistration::ArunAccumulator::solve(SE3 &T) const
+{
+    assert(N_ >= 3  && "PCRegistration::ArunAccumulator::solve: at least 3 correspondences (not aligned)");
     /** Algorithm:
      *  1) calculate centroids cx = sum x_i. cy = sum y_i
-     *  2) calculate dispersion from centroids qx = x_i - cx
-     *  3) calculate matrix H = sum qx_i * qy_i^T
-     *  4) svd decomposition: H = U*D*V'
-     *      4.5) look for co-linear solutions, that is 2 of the 3 singular values are equal
-     *  5) Calculate the rotation solution R = V*U'
-     *      5.5) check for correct solution (det = +1) or reflection (det = -1)
-     *      step 5.5 is actually unnecessary IF applying Umeyama technique
-     *  6) calculate translation as: t = cy - R * cx
+     *  2) calculate matrix H = sum qx_i * qy_i^T, being qx = x_i - cx the dispersion from centroids,
+     *     as H = sum dx_i dy_i' - N mx my', where dx = x_i - x0 (accumulated) and mx = cx - x0
+     *  3) svd decomposition: H = U*D*V'
+     *      3.5) look for co-linear solutions, that is 2 of the 3 singular values are equal
+     *  4) Calculate the rotation solution R = V*U'
+     *      4.5) check for correct solution (det = +1) or reflection (det = -1)
+     *      step 4.5 is actually unnecessary IF applying Umeyama technique
+     *  5) calculate translation as: t = cy - R * cx
      */
-    // We have already asserted in base_T that they are 3xN matrices. (and the same length).
-
-    //std::cout << "X: \n" << X << "\nY:\n" << Y << std::endl;
-    // 1) calculate centroids cx = E{x_i}. cy = E{y_i}
-    //More efficient than creating a matrix of ones when on Release mode (not is Debug mode)
-    Mat13 cxm = X.colwise().sum();
-    cxm /= (double)N;
-    Mat13 cym = Y.colwise().sum();
-    cym /= (double)N;
+    // 1) calculate centroids cx = E{x_i}. cy = E{y_i}, relative to the first point
+    const Mat31 mx = sumX_ / double(N_), my = sumY_ / double(N_);
 
-    // 2)  calculate dispersion from centroids qx = x_i - cx
-    MatX qx = X.rowwise() - cxm;
-    MatX qy = Y.rowwise() - cym;
+    // 2) calculate matrix H = sum qx_i * qy_i^T
+    Mat3 H = sumXY_ - double(N_) * mx * my.transpose();
 
-
-    // 3) calculate matrix H = sum qx_i * qy_i^T (noting that we are obtaingin row vectors)
-    Mat3 H = qx.transpose() * qy;
-
-    // 4) svd decomposition: H = U*D*V'
+    // 3) svd decomposition: H = U*D*V'
     JacobiSVD<Matrix3d> SVD(H, ComputeFullU | ComputeFullV);//Full matrices indicate Square matrices
 
-    //test: prints results so far
-    /*std::cout << "Checking matrix SVD: \n" << SVD.singularValues() <<
-                 ",\n U = " << SVD.matrixU() <<
-                 ",\n V = " << SVD.matrixV() << std::endl;*/
-
-
-    // 4.5) look for co-linear solutions, that is 2 of the 3 singular values are equal
+    // 3.5) look for co-linear solutions, that is 2 of the 3 singular values are equal
     double l_prev = SVD.singularValues()(0), l;
     for(int i =1; i < 3; ++i)
     {
@@ -88,10 +118,10 @@ int PCRegistration::arun(const Ref<const MatX> X, const Ref<const MatX> Y, SE3 &
     }
 
 
-    // 5) Calculate the rotation solution R = V*U'
+    // 4) Calculate the rotation solution R = V*U'
     Mat3 R = SVD.matrixV() * SVD.matrixU().transpose();
 
-    // 5.5) check for correct solution (det = +1) or reflection (det = -1)
+    // 4.5) check for correct solution (det = +1) or reflection (det = -1)
     // that is, solve the problem for co-planar set of points and centroid, when is l1 > l2 > l3 = 0
     // Since H = D1*u1*v1' + D2*u2*v2' + D3*u3*v3',    and D3 = 0, we can swap signs in V
     // such as Vp = [v1,v2,-v3] and the solution is still minimal, but we want a valid rotation R \in SO(3)
@@ -100,16 +130,36 @@ int PCRegistration::arun(const Ref<const MatX> X, const Ref<const MatX> Y, SE3 &
         Mat3 Vn;
         Vn << SVD.matrixV().topLeftCorner<3,2>(), -SVD.matrixV().topRightCorner<3,1>();
         R << Vn * SVD.matrixU().transpose();
-        //std::cout << "R value = " << R << std::endl;
     }
 
-    // 6) calculate translation as: t = cy - R * cx
-    Mat31 t = cym.transpose() - R*cxm.transpose();
-    //std::cout << "t = " << t << std::endl;
+    // 5) calculate translation as: t = cy - R * cx
+    Mat31 t = (y0_ + my) - R*(x0_ + mx);
 
-    // 7) return result
+    // 6) return result
     T.ref2T() << R, t,
                  0,0,0,1;
 
     return 1;
 }
+
+uint_t PCRegistration::arun_batch(const Ref<const MatX> X, const Ref<const MatX> Y, const std::vector<uint_t> &offsets,
+        std::vector<SE3> &T, std::vector<int> &valid)
+{
+    assert(X.cols() == 3  && "PCRegistration::arun_batch: Incorrect sizing, we expect Nx3");
+    assert(Y.rows() == X.rows()  && "PCRegistration::arun_batch: Same number of correspondences");
+    assert(offsets.size() >= 1 && offsets.back() <= X.rows() && "PCRegistration::arun_batch: Incorrect offsets");
+    const long numberPairs = offsets.size() - 1;
+    T.resize(numberPairs);
+    valid.resize(numberPairs);
+    uint_t numberValid = 0;
+    #pragma omp parallel for schedule(dynamic) reduction(+:numberValid)
+    for (long k = 0; k < numberPairs; ++k)
+    {
+        ArunAccumulator accumulator;
+        for (uint_t i = offsets[k]; i < offsets[k+1]; ++i)
+            accumulator.add(X.row(i).transpose(), Y.row(i).transpose());
+        valid[k] = accumulator.get_number_points() >= 3 ? accumulator.solve(T[k]) : 0;
+        numberValid += valid[k];
+    }
+    return numberValid;
+}
@@ -21,59 +21,206 @@
  *              Mobile Robotics Lab, Skoltech 
  */
 
-#include <Eigen/LU> // for inverse and determinant
+#include <Eigen/Cholesky>
 
 #include <memory>
+#include <vector>
 #include <iostream>
 #include "mrob/pc_registration.hpp" // GICP function is defined here
+#include "mrob/registration_solver.hpp"
 
 
 using namespace mrob;
 
+namespace {
+
+/**
+ * Points and covariances in a structure of arrays (SoA): each coordinate, and each of the
+ * 6 different elements of the symmetric covariances, is contiguous over all points.
+ * Then, the loop over points operates on consecutive memory and it can be vectorized.
+ */
+struct GicpData
+{
+    GicpData(const Eigen::Ref<const MatX> &X, const Eigen::Ref<const MatX> &Y,
+             const Eigen::Ref<const MatX> &covX, const Eigen::Ref<const MatX> &covY)
+    {
+        uint_t N = X.rows();
+        for (uint_t k = 0; k < 3; ++k)
+        {
+            x[k].resize(N);
+            y[k].resize(N);
+        }
+        for (uint_t k = 0; k < 6; ++k)
+        {
+            cx[k].resize(N);
+            cy[k].resize(N);
+        }
+        // symmetric covariances stored as xx, xy, xz, yy, yz, zz
+        const uint_t row[6] = {0, 0, 0, 1, 1, 2}, col[6] = {0, 1, 2, 1, 2, 2};
+        for (uint_t i = 0; i < N; ++i)
+        {
+            for (uint_t k = 0; k < 3; ++k)
+            {
+                x[k][i] = X(i,k);
+                y[k][i] = Y(i,k);
+            }
+            for (uint_t k = 0; k < 6; ++k)
+            {
+                cx[k][i] = covX(3*i + row[k], col[k]);
+                cy[k][i] = covY(3*i + row[k], col[k]);
+            }
+        }
+    }
+    std::vector<matData_t> x[3], y[3], cx[6], cy[6];
+};
+
+/**
+ * Accumulates the gradient and upper triangular Hessian of the points [start, end) at the
+ * current transformation (R,t), each point weighted by the robust kernel K on its Mahalanobis
+ * distance (c2 is the squared kernel width). The loop is written in scalars, without temporaries,
+ * such that the compiler can vectorize it over points (omp simd).
+ */
+template<PCRegistration::robustKernel K>
+void gicp_accumulate_block(const GicpData &data, const Mat3 &R, const Mat31 &t, matData_t c2,
+                           long start, long end, matData_t *acc)
+{
+    const matData_t r00 = R(0,0), r01 = R(0,1), r02 = R(0,2),
+                    r10 = R(1,0), r11 = R(1,1), r12 = R(1,2),
+                    r20 = R(2,0), r21 = R(2,1), r22 = R(2,2);
+    const matData_t t0 = t(0), t1 = t(1), t2 = t(2);
+    matData_t g0 = 0, g1 = 0, g2 = 0, g3 = 0, g4 = 0, g5 = 0;
+    matData_t h00 = 0, h01 = 0, h02 = 0, h03 = 0, h04 = 0, h05 = 0,
+                       h11 = 0, h12 = 0, h13 = 0, h14 = 0, h15 = 0,
+                                h22 = 0, h23 = 0, h24 = 0, h25 = 0,
+                                         h33 = 0, h34 = 0, h35 = 0,
+                                                  h44 = 0, h45 = 0,
+                                                           h55 = 0;
+    matData_t cost = 0, inliers = 0;
+    #pragma omp simd reduction(+:cost,inliers,g0,g1,g2,g3,g4,g5,h00,h01,h02,h03,h04,h05,h11,h12,h13,h14,h15,h22,h23,h24,h25,h33,h34,h35,h44,h45,h55)
+    for (long i = start; i < end; ++i)
+    {
+        // 1) transformed point p = Rx + t and residual r = y - p
+        const matData_t x0 = data.x[0][i], x1 = data.x[1][i], x2 = data.x[2][i];
+        const matData_t p0 = r00*x0 + r01*x1 + r02*x2 + t0;
+        const matData_t p1 = r10*x0 + r11*x1 + r12*x2 + t1;
+        const matData_t p2 = r20*x0 + r21*x1 + r22*x2 + t2;
+        const matData_t e0 = data.y[0][i] - p0, e1 = data.y[1][i] - p1, e2 = data.y[2][i] - p2;
+
+        // 2) joint covariance C = covY + R covX R' (symmetric), B = R covX
+        const matData_t a00 = data.cx[0][i], a01 = data.cx[1][i], a02 = data.cx[2][i],
+                        a11 = data.cx[3][i], a12 = data.cx[4][i], a22 = data.cx[5][i];
+        const matData_t b00 = r00*a00 + r01*a01 + r02*a02, b01 = r00*a01 + r01*a11 + r02*a12, b02 = r00*a02 + r01*a12 + r02*a22;
+        const matData_t b10 = r10*a00 + r11*a01 + r12*a02, b11 = r10*a01 + r11*a11 + r12*a12, b12 = r10*a02 + r11*a12 + r12*a22;
+        const matData_t b20 = r20*a00 + r21*a01 + r22*a02, b21 = r20*a01 + r21*a11 + r22*a12, b22 = r20*a02 + r21*a12 + r22*a22;
+        const matData_t c00 = data.cy[0][i] + b00*r00 + b01*r01 + b02*r02;
+        const matData_t c01 = data.cy[1][i] + b00*r10 + b01*r11 + b02*r12;
+        const matData_t c02 = data.cy[2][i] + b00*r20 + b01*r21 + b02*r22;
+        const matData_t c11 = data.cy[3][i] + b10*r10 + b11*r11 + b12*r12;
+        const matData_t c12 = data.cy[4][i] + b10*r20 + b11*r21 + b12*r22;
+        const matData_t c22 = data.cy[5][i] + b20*r20 + b21*r21 + b22*r22;
+
+        // 3) closed form inverse of the symmetric C, L = adj(C) / det(C)
+        const matData_t i00 = c11*c22 - c12*c12, i01 = c02*c12 - c01*c22, i02 = c01*c12 - c02*c11;
+        const matData_t invDet = 1.0 / (c00*i00 + c01*i01 + c02*i02);
+        matData_t l00 = i00 * invDet, l01 = i01 * invDet, l02 = i02 * invDet;
+        matData_t l11 = (c00*c22 - c02*c02) * invDet;
+        matData_t l12 = (c01*c02 - c00*c12) * invDet;
+        matData_t l22 = (c00*c11 - c01*c01) * invDet;
+
+        // 4) robust weight from the Mahalanobis distance s = r' L r, the information L is scaled by it
+        matData_t u0 = l00*e0 + l01*e1 + l02*e2;
+        matData_t u1 = l01*e0 + l11*e1 + l12*e2;
+        matData_t u2 = l02*e0 + l12*e1 + l22*e2;
+        const matData_t s = e0*u0 + e1*u1 + e2*u2;
+        const matData_t w = PCRegistration::robust_weight<K>(s, c2);
+        cost += PCRegistration::robust_cost<K>(s, c2);
+        inliers += s < c2 ? 1.0 : 0.0;
+        u0 *= w; u1 *= w; u2 *= w;
+        l00 *= w; l01 *= w; l02 *= w;
+        l11 *= w; l12 *= w; l22 *= w;
+
+        // 5) gradient J = r' L Jr, with Jr = [p^, -I], for a = L r: J = [(a x p)', -a']
+        g0 += u1*p2 - u2*p1;
+        g1 += u2*p0 - u0*p2;
+        g2 += u0*p1 - u1*p0;
+        g3 -= u0;
+        g4 -= u1;
+        g5 -= u2;
+
+        // 6) Hessian Jr' L Jr = [P'LP, -P'L; -LP, L], with P = p^. Being K = LP,
+        //    P'LP = P'K and -P'L = -K' (L symmetric)
+        const matData_t k00 = l01*p2 - l02*p1, k01 = l02*p0 - l00*p2, k02 = l00*p1 - l01*p0;
+        const matData_t k10 = l11*p2 - l12*p1, k11 = l12*p0 - l01*p2, k12 = l01*p1 - l11*p0;
+        const matData_t k20 = l12*p2 - l22*p1, k21 = l22*p0 - l02*p2, k22 = l02*p1 - l12*p0;
+        // P' rows: (0, p2, -p1), (-p2, 0, p0), (p1, -p0, 0)
+        h00 += p2*k10 - p1*k20;
+        h01 += p2*k11 - p1*k21;
+        h02 += p2*k12 - p1*k22;
+        h11 += p0*k21 - p2*k01;
+        h12 += p0*k22 - p2*k02;
+        h22 += p1*k02 - p0*k12;
+        h03 -= k00; h04 -= k10; h05 -= k20;
+        h13 -= k01; h14 -= k11; h15 -= k21;
+        h23 -= k02; h24 -= k12; h25 -= k22;
+        h33 += l00; h34 += l01; h35 += l02;
+        h44 += l11; h45 += l12;
+        h55 += l22;
+    }
+    const matData_t res[PCRegistration::registrationAccumulatorSize] = {g0, g1, g2, g3, g4, g5,
+            h00, h01, h02, h03, h04, h05, h11, h12, h13, h14, h15, h22, h23, h24, h25, h33, h34, h35, h44, h45, h55, cost, inliers};
+    for (uint_t k = 0; k < PCRegistration::registrationAccumulatorSize; ++k)
+        acc[k] = res[k];
+}
+
+}
+
 int PCRegistration::gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
            const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY, SE3 &T, double tol)
+{
+    RegistrationOptions options;
+    options.tol = tol;
+    return gicp(X, Y, covX, covY, T, options).iterations; // number of iterations
+}
+
+PCRegistration::RegistrationStats PCRegistration::gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+           const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY, SE3 &T,
+           const RegistrationOptions &options)
 {
     assert(X.cols() == 3  && "PCRegistration::Gicp: Incorrect sizing, we expect Nx3");
     assert(X.rows() >= 3  && "PCRegistration::Gicp: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
     assert(Y.rows() == X.rows()  && "PCRegistration::Gicp: Same number of correspondences");
-    uint_t N = X.rows();
+    assert(covX.rows() == 3*X.rows() && covY.rows() == 3*Y.rows() && "PCRegistration::Gicp: Incorrect sizing of covariances");
+    const long N = X.rows();
     // TODO precalculation of T by reduced Arun
-    // TODO different number of iterations and convergence criterion
-
-    // Initialize Jacobian and Hessian
-    Mat61 J = Mat61::Zero();
-    Mat6 H = Mat6::Zero();
-    uint_t iters = 0;
-    double deltaUpdate = 1e3;
-    do
+
+    // Points and covariances are rearranged once (SoA), and accumulated per block in parallel
+    GicpData data(X, Y, covX, covY);
+    std::vector<matData_t> blockAccumulators;
+    const matData_t c2 = options.kernelWidth * options.kernelWidth;
+
+    auto evaluate = [&](const SE3 &T, Mat61 &J, Mat6 &H, uint_t &inliers) -> double
     {
-        J.setZero();
-        H.setZero();
-        // not vectoried operations (due to Jacobian)
-        for ( uint_t i = 0; i < N ; ++i)
+        const Mat3 R = T.R();
+        const Mat31 t = T.t();
+        auto accumulate_block = [&](long start, long end, matData_t *acc)
         {
-            // 1) Calculate residual r = y - Tx and the inverse of joint covariance
-            Mat31 Txi = T.transform(X.row(i));
-            Mat31 r = Y.row(i).transpose() - Txi;
-            Mat3 Li = (covY.block<3,3>(3*i,0) + T.R() * covX.block<3,3>(3*i,0) * T.R().transpose()).inverse();
-
-            // 2) Calculate Jacobian for residual Jf = df1/d xi = r1' Li * Jr, where Jr = [(Tx)^ ; -I])
-            Mat<3,6> Jr;
-            Jr << hat3(Txi) , -Mat3::Identity();
-            Mat<1,6> Ji = r.transpose() * Li * Jr;
-            J += Ji;//Eigen manages this for us
-
-            // 3) Hessian Hi ~ Jr' * Li * Jr
-            Mat6 Hi = Jr.transpose() * Li * Jr;
-            H += Hi;
-        }
-        // 4) Update Solution
-        Mat61 dxi = -H.inverse()*J;
-        T.update_lhs(dxi); //Left side update
-        deltaUpdate = dxi.norm();
-        iters++;
-
-    }while(deltaUpdate > tol && iters < 20);
+            switch (options.kernel)
+            {
+                case HUBER:
+                    gicp_accumulate_block<HUBER>(data, R, t, c2, start, end, acc);
+                    break;
+                case CAUCHY:
+                    gicp_accumulate_block<CAUCHY>(data, R, t, c2, start, end, acc);
+                    break;
+                case GEMAN_MCCLURE:
+                    gicp_accumulate_block<GEMAN_MCCLURE>(data, R, t, c2, start, end, acc);
+                    break;
+                default:
+                    gicp_accumulate_block<QUADRATIC>(data, R, t, c2, start, end, acc);
+            }
+        };
+        return reduce_blocks(N, accumulate_block, blockAccumulators, J, H, inliers);
+    };
 
-    return iters; // number of iterations
+    return solve_registration(evaluate, T, N, options);
 }
@@ -0,0 +1,283 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * icp.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <vector>
+#include <cassert>
+#include "mrob/pc_registration.hpp"
+
+
+using namespace mrob;
+
+namespace {
+/**
+ * Transforms X by T and finds the correspondences on Y. Returns the number of
+ * correspondences and their indexes on X (matchX) and Y (matchY)
+ */
+uint_t find_correspondences(const Eigen::Ref<const MatX> &X, const SpatialIndex &indexY, const SE3 &T,
+                            double maxDistance, MatX &TX, std::vector<int> &nearest,
+                            std::vector<matData_t> &squaredDistances,
+                            std::vector<uint_t> &matchX, std::vector<uint_t> &matchY)
+{
+    const long N = X.rows();
+    TX.resize(N, 3);
+    #pragma omp parallel for
+    for (long i = 0; i < N; ++i)
+        TX.row(i) = T.transform(X.row(i).transpose()).transpose();
+    indexY.nearest_batch(TX, nearest, squaredDistances, maxDistance);
+    matchX.clear();
+    matchY.clear();
+    for (long i = 0; i < N; ++i)
+    {
+        if (nearest[i] < 0)
+            continue;
+        matchX.push_back(i);
+        matchY.push_back(nearest[i]);
+    }
+    return matchX.size();
+}
+
+/**
+ * ICP with nearest neighbour data association on Y, see icp_driver(). The normals or covariances
+ * of X and Y are only required by the registration method that uses them, otherwise they are empty.
+ */
+PCRegistration::RegistrationStats icp_nearest(const Eigen::Ref<const MatX> &X, const Eigen::Ref<const MatX> &Y,
+        const SpatialIndex &indexY, const Eigen::Ref<const MatX> &normalsX, const Eigen::Ref<const MatX> &normalsY,
+        const Eigen::Ref<const MatX> &covX, const Eigen::Ref<const MatX> &covY, SE3 &T,
+        PCRegistration::registrationMethod method, double maxDistance, double tol, uint_t maxIters,
+        const PCRegistration::RegistrationOptions &options, uint_t minCorrespondences)
+{
+    using namespace PCRegistration;
+    MatX TX;
+    std::vector<int> nearest;
+    std::vector<matData_t> squaredDistances;
+    std::vector<uint_t> matchX, matchY;
+    auto associate = [&](const SE3 &current, Correspondences &c) -> uint_t
+    {
+        uint_t M = find_correspondences(X, indexY, current, maxDistance, TX, nearest, squaredDistances, matchX, matchY);
+        c.X.resize(M, 3);
+        c.Y.resize(M, 3);
+        for (uint_t i = 0; i < M; ++i)
+        {
+            c.X.row(i) = X.row(matchX[i]);
+            c.Y.row(i) = Y.row(matchY[i]);
+        }
+        switch (method)
+        {
+            case POINT_PLANE:
+                c.normalsY.resize(M, 3);
+                for (uint_t i = 0; i < M; ++i)
+                    c.normalsY.row(i) = normalsY.row(matchY[i]);
+                break;
+            case SYMMETRIC_POINT_PLANE:
+                c.normalsX.resize(M, 3);
+                c.normalsY.resize(M, 3);
+                for (uint_t i = 0; i < M; ++i)
+                {
+                    c.normalsX.row(i) = normalsX.row(matchX[i]);
+                    c.normalsY.row(i) = normalsY.row(matchY[i]);
+                }
+                break;
+            case GICP:
+                c.covX.resize(3*M, 3);
+                c.covY.resize(3*M, 3);
+                for (uint_t i = 0; i < M; ++i)
+                {
+                    c.covX.block<3,3>(3*i, 0) = covX.block<3,3>(3*matchX[i], 0);
+                    c.covY.block<3,3>(3*i, 0) = covY.block<3,3>(3*matchY[i], 0);
+                }
+                break;
+            default:
+                break;
+        }
+        return M;
+    };
+    return icp_driver(associate, T, method, tol, maxIters, options, minCorrespondences);
+}
+
+}
+
+PCRegistration::RegistrationStats PCRegistration::icp_driver(const std::function<uint_t(const SE3 &, Correspondences &)> &associate,
+        SE3 &T, registrationMethod method, double tol, uint_t maxIters, const RegistrationOptions &options,
+        uint_t minCorrespondences)
+{
+    RegistrationStats stats;
+    Correspondences c;
+    uint_t iters = 0;
+    double deltaUpdate;
+    do
+    {
+        // 1) data association at the current solution
+        uint_t M = associate(T, c);
+        if (M < minCorrespondences)
+        {
+            stats.iterations = 0;
+            return stats;
+        }
+
+        // 2) registration of the correspondences
+        SE3 Tprev = T;
+        switch (method)
+        {
+            case POINT_PLANE:
+                stats = point_to_plane(c.X, c.Y, c.normalsY, T, options);
+                break;
+            case SYMMETRIC_POINT_PLANE:
+                stats = symmetric_point_plane(c.X, c.Y, c.normalsX, c.normalsY, T, options);
+                break;
+            case GICP:
+                stats = gicp(c.X, c.Y, c.covX, c.covY, T, options);
+                break;
+            default:
+                stats = weighted_point(c.X, c.Y, MatX1::Ones(M), T, options);
+        }
+        deltaUpdate = (T * Tprev.inv()).ln_vee().norm();
+        iters++;
+    }while(deltaUpdate > tol && iters < maxIters);
+
+    stats.iterations = iters;
+    return stats;
+}
+
+int PCRegistration::icp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, const SpatialIndex &indexY, SE3 &T,
+        double maxDistance, double tol, uint_t maxIters)
+{
+    assert(X.cols() == 3  && "PCRegistration::icp: Incorrect sizing, we expect Nx3");
+    assert(Y.cols() == 3  && "PCRegistration::icp: Incorrect sizing, we expect Nx3");
+    assert(indexY.get_number_points() == Y.rows() && "PCRegistration::icp: the spatial index does not correspond to Y");
+    RegistrationOptions options;
+    options.tol = tol;
+    return icp_nearest(X, Y, indexY, MatX(), MatX(), MatX(), MatX(), T, POINT_POINT,
+                       maxDistance, tol, maxIters, options, 3).iterations;
+}
+
+int PCRegistration::icp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T,
+        double maxDistance, double tol, uint_t maxIters)
+{
+    KDTree indexY(Y);
+    return PCRegistration::icp(X, Y, indexY, T, maxDistance, tol, maxIters);
+}
+
+int PCRegistration::icp_gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY,
+        const SpatialIndex &indexY, SE3 &T,
+        double maxDistance, double tol, uint_t maxIters)
+{
+    assert(X.cols() == 3  && "PCRegistration::icp_gicp: Incorrect sizing, we expect Nx3");
+    assert(Y.cols() == 3  && "PCRegistration::icp_gicp: Incorrect sizing, we expect Nx3");
+    assert(covX.rows() == 3*X.rows() && covY.rows() == 3*Y.rows() && "PCRegistration::icp_gicp: Incorrect sizing of covariances");
+    assert(indexY.get_number_points() == Y.rows() && "PCRegistration::icp_gicp: the spatial index does not correspond to Y");
+    RegistrationOptions options;
+    options.tol = tol;
+    return icp_nearest(X, Y, indexY, MatX(), MatX(), covX, covY, T, GICP,
+                       maxDistance, tol, maxIters, options, 3).iterations;
+}
+
+int PCRegistration::icp_gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY, SE3 &T,
+        double maxDistance, double tol, uint_t maxIters)
+{
+    KDTree indexY(Y);
+    return PCRegistration::icp_gicp(X, Y, covX, covY, indexY, T, maxDistance, tol, maxIters);
+}
+
+std::vector<PCRegistration::PyramidLevel> PCRegistration::create_pyramid_levels(uint_t numberLevels, double voxelSize,
+        double minVoxelSize, double factor)
+{
+    assert(numberLevels > 0 && "PCRegistration::create_pyramid_levels: at least one level");
+    std::vector<PyramidLevel> levels(numberLevels);
+    double size = voxelSize;
+    for (uint_t l = numberLevels; l-- > 0; )
+    {
+        levels[l].voxelSize = size;
+        levels[l].maxDistance = 3.0 * (size > 0.0 ? size : minVoxelSize);
+        size = size > 0.0 ? factor * size : minVoxelSize;
+    }
+    return levels;
+}
+
+namespace {
+
+/**
+ * ICP on one level of the pyramid, the spatial index, normals or covariances required
+ * by the method are calculated once for the level
+ */
+PCRegistration::RegistrationStats icp_level(const MatX &X, const MatX &Y, SE3 &T,
+        const PCRegistration::PyramidLevel &level, PCRegistration::registrationMethod method)
+{
+    using namespace PCRegistration;
+    KDTree indexY(Y);
+    MatX normalsX, normalsY, covX, covY;
+    switch (method)
+    {
+        case POINT_PLANE:
+            normalsY = estimate_normals(Y, indexY, level.neighbours);
+            break;
+        case SYMMETRIC_POINT_PLANE:
+            normalsX = estimate_normals(X, level.neighbours);
+            normalsY = estimate_normals(Y, indexY, level.neighbours);
+            break;
+        case GICP:
+            covX = estimate_covariances(X, level.neighbours);
+            covY = estimate_covariances(Y, indexY, level.neighbours);
+            break;
+        default:
+            break;
+    }
+
+    // at least 6 correspondences for planar residuals
+    return icp_nearest(X, Y, indexY, normalsX, normalsY, covX, covY, T, method,
+                       level.maxDistance, level.tol, level.maxIters, level.options, 6);
+}
+
+}
+
+std::vector<PCRegistration::RegistrationStats> PCRegistration::icp_pyramid(const Eigen::Ref<const MatX> X,
+        const Eigen::Ref<const MatX> Y, SE3 &T, const std::vector<PyramidLevel> &levels, registrationMethod method)
+{
+    assert(X.cols() == 3  && "PCRegistration::icp_pyramid: Incorrect sizing, we expect Nx3");
+    assert(Y.cols() == 3  && "PCRegistration::icp_pyramid: Incorrect sizing, we expect Nx3");
+    const uint_t L = levels.size();
+
+    // 1) pyramid from fine to coarse, each level downsampled from the previous (finer) one
+    std::vector<MatX> pyramidX(L), pyramidY(L);
+    for (uint_t l = L; l-- > 0; )
+    {
+        const double voxelSize = levels[l].voxelSize;
+        const bool finest = l + 1 == L;
+        const Eigen::Ref<const MatX> finerX = finest ? X : Eigen::Ref<const MatX>(pyramidX[l+1]);
+        const Eigen::Ref<const MatX> finerY = finest ? Y : Eigen::Ref<const MatX>(pyramidY[l+1]);
+        if (voxelSize > 0.0)
+        {
+            pyramidX[l] = voxel_downsample(finerX, voxelSize);
+            pyramidY[l] = voxel_downsample(finerY, voxelSize);
+        }
+        else
+        {
+            pyramidX[l] = finerX;
+            pyramidY[l] = finerY;
+        }
+    }
+
+    // 2) coarse to fine registration, warm-started from the previous level
+    std::vector<RegistrationStats> stats(L);
+    for (uint_t l = 0; l < L; ++l)
+        stats[l] = icp_level(pyramidX[l], pyramidY[l], T, levels[l], method);
+    return stats;
+}
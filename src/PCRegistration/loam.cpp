@@ -0,0 +1,396 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * loam.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/loam.hpp"
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <cmath>
+#include <cassert>
+
+using namespace mrob;
+
+namespace {
+
+// Parameters from the original LOAM implementation
+const int curvatureNeighbours = 5;// at each side of the point
+const uint_t numberSectors = 6;
+const uint_t maxSharp = 2, maxLessSharp = 20, maxFlat = 4;
+const uint_t correspondenceNeighbours = 5;
+const matData_t odometryMaxDistance = 5.0, mappingMaxDistance = 1.0;
+const uint_t minTargetPoints = 5;
+
+/**
+ * Target of the registration (previous scan or map): number of points and their k nearest
+ * neighbours of a query, closer than maxDistance. Returns the number of neighbours found
+ */
+struct FeatureTarget
+{
+    uint_t numberPoints;
+    std::function<uint_t(const Mat31 &query, uint_t k, Mat31 *neighbours, matData_t maxDistance)> knn;
+};
+
+FeatureTarget scan_target(const MatX &points, const KDTree &index)
+{
+    auto knn = [&points, &index](const Mat31 &query, uint_t k, Mat31 *neighbours, matData_t maxDistance) -> uint_t
+    {
+        int indexes[correspondenceNeighbours];
+        matData_t distances[correspondenceNeighbours];
+        uint_t n = index.knn(query, k, indexes, distances, maxDistance);
+        for (uint_t j = 0; j < n; ++j)
+            neighbours[j] = points.row(indexes[j]).transpose();
+        return n;
+    };
+    return FeatureTarget{(uint_t)points.rows(), knn};
+}
+
+FeatureTarget map_target(const VoxelMap &map)
+{
+    auto knn = [&map](const Mat31 &query, uint_t k, Mat31 *neighbours, matData_t maxDistance) -> uint_t
+    {
+        matData_t distances[correspondenceNeighbours];
+        return map.knn(query, k, neighbours, distances, maxDistance);
+    };
+    return FeatureTarget{map.get_number_voxels(), knn};
+}
+
+/**
+ * Registration of edge and planar points against the edges and planes of a target (previous
+ * scan or map), by their 5 nearest neighbours. Each edge provides two rows, the planes orthogonal
+ * to the line, so the point to plane residual is the distance to the line.
+ * Data association is repeated iters times or until the update is below tol.
+ */
+void register_features(const MatX &edges, const MatX &planes,
+                       const FeatureTarget &targetEdges, const FeatureTarget &targetPlanes,
+                       SE3 &T, matData_t maxDistance, uint_t iters,
+                       const PCRegistration::RegistrationOptions &options, double tol = 1e-3)
+{
+    const long Ne = targetEdges.numberPoints >= minTargetPoints ? edges.rows() : 0;
+    const long Np = targetPlanes.numberPoints >= minTargetPoints ? planes.rows() : 0;
+    // fixed slots per query: 2 per edge and 1 per plane
+    MatX X(2*Ne + Np, 3), Y(2*Ne + Np, 3), normals(2*Ne + Np, 3);
+    std::vector<char> valid(2*Ne + Np);
+    MatX Xm, Ym, normalsM;
+    for (uint_t it = 0; it < iters; ++it)
+    {
+        // 1) correspondences in parallel
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < Ne + Np; ++i)
+        {
+            const bool isEdge = i < Ne;
+            const Mat31 x = isEdge ? Mat31(edges.row(i).transpose()) : Mat31(planes.row(i - Ne).transpose());
+            const long slot = isEdge ? 2*i : Ne + i;
+            valid[slot] = 0;
+            if (isEdge)
+                valid[slot + 1] = 0;
+            Mat31 neighbours[correspondenceNeighbours];
+            const FeatureTarget &target = isEdge ? targetEdges : targetPlanes;
+            uint_t n = target.knn(T.transform(x), correspondenceNeighbours, neighbours, maxDistance);
+            if (n < correspondenceNeighbours)
+                continue;
+            Mat31 centroid = Mat31::Zero();
+            for (uint_t j = 0; j < n; ++j)
+                centroid += neighbours[j];
+            centroid /= (matData_t)n;
+            Mat3 covariance = Mat3::Zero();
+            for (uint_t j = 0; j < n; ++j)
+            {
+                Mat31 d = neighbours[j] - centroid;
+                covariance += d * d.transpose();
+            }
+            Eigen::SelfAdjointEigenSolver<Mat3> es;
+            es.computeDirect(covariance / (matData_t)n);
+            if (isEdge)
+            {
+                // a line, when the largest eigenvalue dominates
+                if (es.eigenvalues()(2) < 3.0 * es.eigenvalues()(1))
+                    continue;
+                for (uint_t k = 0; k < 2; ++k)
+                {
+                    X.row(slot + k) = x.transpose();
+                    Y.row(slot + k) = centroid.transpose();
+                    normals.row(slot + k) = es.eigenvectors().col(k).transpose();
+                    valid[slot + k] = 1;
+                }
+            }
+            else
+            {
+                // a plane, when all neighbours are close to it
+                Mat31 normal = es.eigenvectors().col(0);
+                bool isPlane = true;
+                for (uint_t j = 0; j < n; ++j)
+                    if (std::fabs(normal.dot(neighbours[j] - centroid)) > 0.2)
+                        isPlane = false;
+                if (!isPlane)
+                    continue;
+                X.row(slot) = x.transpose();
+                Y.row(slot) = centroid.transpose();
+                normals.row(slot) = normal.transpose();
+                valid[slot] = 1;
+            }
+        }
+
+        // 2) compact and solve
+        const long M = std::count(valid.begin(), valid.end(), 1);
+        if (M < 6)
+            break;
+        Xm.resize(M, 3);
+        Ym.resize(M, 3);
+        normalsM.resize(M, 3);
+        for (long i = 0, j = 0; i < (long)valid.size(); ++i)
+        {
+            if (!valid[i])
+                continue;
+            Xm.row(j) = X.row(i);
+            Ym.row(j) = Y.row(i);
+            normalsM.row(j) = normals.row(i);
+            j++;
+        }
+        SE3 Tprev = T;
+        PCRegistration::point_to_plane(Xm, Ym, normalsM, T, options);
+        if ((T * Tprev.inv()).ln_vee().norm() < tol)
+            break;
+    }
+}
+
+}// namespace
+
+
+Loam::Loam(double edgeThreshold, double planarThreshold, double mapVoxelSize, double mapRadius):
+        edgeThreshold_(edgeThreshold), planarThreshold_(planarThreshold),
+        mapVoxelSize_(mapVoxelSize), mapRadius_(mapRadius),
+        odometryIters_(10), mappingIters_(10),
+        mapEdges_(mapVoxelSize, mapRadius, 1, 1e-3, VoxelMap::MEANS),
+        mapPlanes_(mapVoxelSize, mapRadius, 1, 1e-3, VoxelMap::MEANS)
+{
+    options_.maxIters = 3;
+    options_.kernel = PCRegistration::HUBER;
+    options_.kernelWidth = 0.1;
+}
+
+Loam::~Loam()
+{
+}
+
+uint_t Loam::extract_features(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &rings)
+{
+    assert(points.cols() == 3  && "Loam::extract_features: Incorrect sizing, we expect Nx3");
+    assert(points.rows() == (long)rings.size() && "Loam::extract_features: incorrect number of rings");
+    uint_t numberRings = rings.empty() ? 0 : *std::max_element(rings.begin(), rings.end()) + 1;
+    std::vector<std::vector<uint_t>> ringIndexes(numberRings);
+    for (uint_t i = 0; i < rings.size(); ++i)
+        ringIndexes[rings[i]].push_back(i);
+
+    // 1) features of each ring, in parallel. Less flat points are downsampled per ring
+    std::vector<std::vector<uint_t>> sharp(numberRings), lessSharp(numberRings), flat(numberRings), lessFlat(numberRings);
+    std::vector<MatX> lessFlatRing(numberRings);
+    #pragma omp parallel for schedule(dynamic)
+    for (long r = 0; r < (long)numberRings; ++r)
+    {
+        std::vector<uint_t> &ring = ringIndexes[r];
+        std::vector<matData_t> azimuth(ring.size());
+        for (uint_t i = 0; i < ring.size(); ++i)
+            azimuth[i] = std::atan2(points(ring[i],1), points(ring[i],0));
+        std::vector<uint_t> order(ring.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&azimuth](uint_t a, uint_t b){return azimuth[a] < azimuth[b];});
+        for (uint_t i = 0; i < order.size(); ++i)
+            order[i] = ring[order[i]];
+        ring.swap(order);
+        extract_ring_features(points, ring, sharp[r], lessSharp[r], flat[r], lessFlat[r]);
+        MatX ringPoints(lessFlat[r].size(), 3);
+        for (uint_t i = 0; i < lessFlat[r].size(); ++i)
+            ringPoints.row(i) = points.row(lessFlat[r][i]);
+        lessFlatRing[r] = PCRegistration::voxel_downsample(ringPoints, 0.5 * mapVoxelSize_);
+    }
+
+    // 2) features are concatenated in the order of the rings
+    auto concatenate = [&points](const std::vector<std::vector<uint_t>> &indexes, MatX &output)
+    {
+        uint_t N = 0;
+        for (auto &v : indexes)
+            N += v.size();
+        output.resize(N, 3);
+        uint_t j = 0;
+        for (auto &v : indexes)
+            for (auto i : v)
+                output.row(j++) = points.row(i);
+    };
+    concatenate(sharp, sharp_);
+    concatenate(lessSharp, lessSharp_);
+    concatenate(flat, flat_);
+    uint_t N = 0;
+    for (auto &m : lessFlatRing)
+        N += m.rows();
+    lessFlat_.resize(N, 3);
+    N = 0;
+    for (auto &m : lessFlatRing)
+    {
+        lessFlat_.middleRows(N, m.rows()) = m;
+        N += m.rows();
+    }
+    return sharp_.rows() + flat_.rows();
+}
+
+void Loam::extract_ring_features(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &ring,
+                                 std::vector<uint_t> &sharp, std::vector<uint_t> &lessSharp,
+                                 std::vector<uint_t> &flat, std::vector<uint_t> &lessFlat) const
+{
+    const int K = curvatureNeighbours;
+    const int N = ring.size();
+    if (N < 2*K + (int)numberSectors)
+        return;
+    auto point = [&points, &ring](int i) -> Mat31 {return points.row(ring[i]).transpose();};
+
+    // 1) curvature, c = || sum (p_j - p_i) ||^2 over the K neighbours at each side
+    std::vector<matData_t> curvature(N, 0.0);
+    std::vector<char> picked(N, 0), edge(N, 0);
+    for (int i = K; i < N - K; ++i)
+    {
+        Mat31 diff = -2.0 * K * point(i);
+        for (int j = 1; j <= K; ++j)
+            diff += point(i - j) + point(i + j);
+        curvature[i] = diff.squaredNorm();
+    }
+
+    // 2) unreliable points: occluded regions and surfaces parallel to the beam
+    for (int i = K; i < N - K - 1; ++i)
+    {
+        const Mat31 p = point(i), next = point(i + 1);
+        const matData_t d2 = (next - p).squaredNorm();
+        if (d2 > 0.1)
+        {
+            const matData_t depth1 = p.norm(), depth2 = next.norm();
+            if (depth1 > depth2)
+            {
+                if ((next - p * depth2 / depth1).norm() / depth2 < 0.1)
+                    std::fill(picked.begin() + i - K, picked.begin() + i + 1, 1);
+            }
+            else
+            {
+                if ((next * depth1 / depth2 - p).norm() / depth1 < 0.1)
+                    std::fill(picked.begin() + i + 1, picked.begin() + i + K + 2, 1);
+            }
+        }
+        const matData_t r2 = p.squaredNorm();
+        if ((p - point(i - 1)).squaredNorm() > 0.0002 * r2 && d2 > 0.0002 * r2)
+            picked[i] = 1;
+    }
+
+    // marks the neighbours of a selected feature, unless there is a discontinuity
+    auto mark_neighbours = [&](int i)
+    {
+        picked[i] = 1;
+        for (int j = 1; j <= K && i + j < N; ++j)
+        {
+            if ((point(i + j) - point(i + j - 1)).squaredNorm() > 0.05)
+                break;
+            picked[i + j] = 1;
+        }
+        for (int j = 1; j <= K && i - j >= 0; ++j)
+        {
+            if ((point(i - j) - point(i - j + 1)).squaredNorm() > 0.05)
+                break;
+            picked[i - j] = 1;
+        }
+    };
+
+    // 3) features on each sector, sorted by curvature
+    std::vector<int> order;
+    for (uint_t s = 0; s < numberSectors; ++s)
+    {
+        const int start = K + (N - 2*K) * s / numberSectors;
+        const int end = K + (N - 2*K) * (s + 1) / numberSectors;
+        order.resize(end - start);
+        std::iota(order.begin(), order.end(), start);
+        std::sort(order.begin(), order.end(), [&curvature](int a, int b){return curvature[a] < curvature[b];});
+
+        uint_t count = 0;
+        for (auto it = order.rbegin(); it != order.rend() && count < maxLessSharp; ++it)
+        {
+            const int i = *it;
+            if (curvature[i] <= edgeThreshold_)
+                break;
+            if (picked[i])
+                continue;
+            if (count < maxSharp)
+                sharp.push_back(ring[i]);
+            lessSharp.push_back(ring[i]);
+            edge[i] = 1;
+            mark_neighbours(i);
+            count++;
+        }
+        count = 0;
+        for (auto it = order.begin(); it != order.end() && count < maxFlat; ++it)
+        {
+            const int i = *it;
+            if (curvature[i] >= planarThreshold_)
+                break;
+            if (picked[i])
+                continue;
+            flat.push_back(ring[i]);
+            mark_neighbours(i);
+            count++;
+        }
+        for (int i = start; i < end; ++i)
+            if (!edge[i])
+                lessFlat.push_back(ring[i]);
+    }
+}
+
+SE3 Loam::add_scan(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &rings)
+{
+    extract_features(points, rings);
+    const uint_t t = trajectory_.size();
+    SE3 T;
+    if (t == 0)
+    {
+        odometry_.push_back(T);
+    }
+    else
+    {
+        // 1) scan to scan odometry, relative transformation initialized by a constant velocity model
+        SE3 Trel;
+        if (t >= 2)
+            Trel = trajectory_[t-2].inv() * trajectory_[t-1];
+        register_features(sharp_, flat_, scan_target(previousLessSharp_, previousEdgesIndex_),
+                          scan_target(previousLessFlat_, previousPlanesIndex_), Trel, odometryMaxDistance, odometryIters_, options_);
+        odometry_.push_back(odometry_[t-1] * Trel);
+
+        // 2) scan to map, initialized by the odometry. Planar points are downsampled to the map resolution
+        T = trajectory_[t-1] * Trel;
+        MatX planes = PCRegistration::voxel_downsample(lessFlat_, mapVoxelSize_);
+        register_features(lessSharp_, planes, map_target(mapEdges_), map_target(mapPlanes_),
+                          T, mappingMaxDistance, mappingIters_, options_);
+        T.regenerate();
+    }
+    trajectory_.push_back(T);
+
+    // 3) map update and features of this scan as target for the next one
+    mapEdges_.insert(lessSharp_, T);
+    mapPlanes_.insert(lessFlat_, T);
+    previousLessSharp_ = lessSharp_;
+    previousLessFlat_ = lessFlat_;
+    previousEdgesIndex_.build(previousLessSharp_);
+    previousPlanesIndex_.build(previousLessFlat_);
+    return T;
+}
@@ -24,12 +24,107 @@
 #ifndef SRC_PCREGISTRATION_MROB_LOAM_HPP_
 #define SRC_PCREGISTRATION_MROB_LOAM_HPP_
 
+#include "mrob/matrix_base.hpp"
+#include "mrob/SE3.hpp"
+#include "mrob/pc_registration.hpp"
+#include "mrob/spatial_index.hpp"
+#include "mrob/voxel_map.hpp"
+
+#include <vector>
+#include <cstdint>
+
+
+namespace mrob{
 
 /**
  * This is an implementation of the LOAM work
  * to benchmark with our plane smoother factor
  *
+ * J. Zhang and S. Singh, "LOAM: Lidar Odometry and Mapping in Real-time", 2014.
+ *
+ * Each scan is processed as:
+ *  1) Feature extraction, per ring and in parallel across rings: points on a ring are sorted
+ *     by azimuth and the curvature is the squared norm of sum (p_j - p_i) over the 5 neighbours
+ *     at each side. Occluded points and points on surfaces parallel to the beam are discarded.
+ *     Each ring is divided in 6 sectors where the points of largest curvature are edges (sharp,
+ *     up to 2, and less sharp, up to 20) and the points of smallest curvature are planar (flat, up to 4).
+ *     The rest of non-edge points, voxel downsampled, are less flat.
+ *  2) Scan to scan odometry: sharp and flat points are registered against the less sharp and
+ *     less flat points of the previous scan, initialized by constant velocity.
+ *  3) Scan to map: less sharp and less flat points (downsampled to mapVoxelSize) are registered
+ *     against the map, initialized by the odometry, and then added to it.
+ *
+ * Correspondences are the 5 nearest neighbours in the target: edges are lines, when the
+ * largest eigenvalue of their covariance is 3 times the second, and planar points are planes,
+ * when all neighbours lie close to it. Both are solved by point_to_plane(), edges as the two
+ * planes orthogonal to the line (distance to the line).
+ *
+ * The map keeps the mean of the edge and planar points in voxels of mapVoxelSize, within
+ * mapRadius from the sensor, so it has a bounded size (VoxelMap in MEANS mode). Neighbours
+ * on the map are found by voxel lookups, so the map is never rebuilt.
+ * Scans are assumed to be compensated of motion distortion.
  */
+class Loam{
+
+  public:
+    Loam(double edgeThreshold = 0.1, double planarThreshold = 0.1, double mapVoxelSize = 0.4, double mapRadius = 100.0);
+    ~Loam();
+
+    /**
+     * Extracts the features of a scan, a N x 3 matrix of points in the sensor frame, and the ring
+     * (laser) of each point. Returns the number of sharp and flat points.
+     */
+    uint_t extract_features(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &rings);
+    /**
+     * Adds a new scan (same input as extract_features): features, scan to scan odometry and
+     * scan to map registration. Returns the estimated pose of the new scan.
+     */
+    SE3 add_scan(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &rings);
+
+    uint_t get_number_poses() const {return trajectory_.size();};
+    const std::vector<SE3>& get_trajectory() const {return trajectory_;};
+    /**
+     * Returns the pose after scan to scan odometry, before the scan to map refinement
+     */
+    const std::vector<SE3>& get_odometry() const {return odometry_;};
+    /**
+     * Features of the last scan, in the sensor frame
+     */
+    const MatX& get_sharp_points() const {return sharp_;};
+    const MatX& get_less_sharp_points() const {return lessSharp_;};
+    const MatX& get_flat_points() const {return flat_;};
+    const MatX& get_less_flat_points() const {return lessFlat_;};
+    /**
+     * Map of edges and planar points
+     */
+    MatX get_map_edge_points() const {return mapEdges_.get_means();};
+    MatX get_map_planar_points() const {return mapPlanes_.get_means();};
+    /**
+     * Iterations of data association for scan to scan and scan to map, and the options of the
+     * registration for each of them (by default Huber kernel and 3 iterations)
+     */
+    void set_iterations(uint_t odometryIters, uint_t mappingIters) {odometryIters_ = odometryIters; mappingIters_ = mappingIters;};
+    void set_registration_options(const PCRegistration::RegistrationOptions &options) {options_ = options;};
+
+  protected:
+    /**
+     * Features of one ring, indexes ordered by azimuth, appended to the output vectors
+     */
+    void extract_ring_features(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &ring,
+                               std::vector<uint_t> &sharp, std::vector<uint_t> &lessSharp,
+                               std::vector<uint_t> &flat, std::vector<uint_t> &lessFlat) const;
+
+    double edgeThreshold_, planarThreshold_, mapVoxelSize_, mapRadius_;
+    uint_t odometryIters_, mappingIters_;
+    PCRegistration::RegistrationOptions options_;
 
+    std::vector<SE3> trajectory_, odometry_;
+    MatX sharp_, lessSharp_, flat_, lessFlat_;
+    // previous scan, target of scan to scan odometry
+    MatX previousLessSharp_, previousLessFlat_;
+    KDTree previousEdgesIndex_, previousPlanesIndex_;
+    VoxelMap mapEdges_, mapPlanes_;
+};
 
+}// namespace
 #endif /* SRC_PCREGISTRATION_MROB_LOAM_HPP_ */
@@ -26,6 +26,10 @@
 
 #include "mrob/matrix_base.hpp"
 #include "mrob/SE3.hpp"
+#include "mrob/spatial_index.hpp"
+
+#include <vector>
+#include <functional>
 
 namespace mrob{
 /**
@@ -50,10 +54,151 @@ namespace PCRegistration{
  *  3 points in x and y are the minimum requirements, and provide the right solution IF
  *  there is no noise.
  *
+ *  The centroids and the cross-covariance are accumulated in a single pass (see ArunAccumulator),
+ *  in parallel blocks for large point sets, without centered copies of the points.
+ *
  *  Returns 0 if failed and 1 if a correct solution was found
  */
 int arun(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T);
 
+/**
+ * Streaming Arun: correspondences (x,y) are added one by one, accumulating their sums and
+ * cross-covariance in a single pass, without storing the points, and solved at any time.
+ * Sums are taken relative to the first correspondence, to avoid the cancellation of
+ * H = sum x y' - N cx cy' for points far from the origin.
+ */
+class ArunAccumulator
+{
+  public:
+    ArunAccumulator() {clear();}
+    void clear()
+    {
+        N_ = 0;
+        x0_.setZero();
+        y0_.setZero();
+        sumX_.setZero();
+        sumY_.setZero();
+        sumXY_.setZero();
+    }
+    void add(const Mat31 &x, const Mat31 &y)
+    {
+        if (N_ == 0)
+        {
+            x0_ = x;
+            y0_ = y;
+        }
+        const Mat31 dx = x - x0_, dy = y - y0_;
+        sumX_ += dx;
+        sumY_ += dy;
+        sumXY_.noalias() += dx * dy.transpose();
+        N_++;
+    }
+    /**
+     * Adds all the correspondences accumulated in other
+     */
+    void merge(const ArunAccumulator &other);
+    uint_t get_number_points() const {return N_;}
+    /**
+     * Same as arun(), at least 3 correspondences. Returns 0 if failed and 1 if a correct solution was found
+     */
+    int solve(SE3 &T) const;
+
+  protected:
+    uint_t N_;
+    Mat31 x0_, y0_, sumX_, sumY_;
+    Mat3 sumXY_;
+};
+
+/**
+ * Batched Arun, solves in parallel many independent alignments. The pairs (X,Y) are stacked
+ * vertically and pair k is given by the rows [offsets[k], offsets[k+1]), so offsets has
+ * one more element than the number of pairs.
+ *
+ * Outputs the solution of each pair in T and in valid whether it was correctly solved.
+ * Returns the number of pairs correctly solved.
+ */
+uint_t arun_batch(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, const std::vector<uint_t> &offsets,
+        std::vector<SE3> &T, std::vector<int> &valid);
+
+/**
+ * Parameters of ransac_arun():
+ *  - threshold: a correspondence is an inlier if || y - Tx || < threshold
+ *  - maxIterations: maximum number of hypotheses
+ *  - confidence: probability of having sampled an all-inlier set, to stop earlier
+ *  - prosac: correspondences are sorted by quality (best first) and samples are drawn
+ *    progressively from the top ranked ones (PROSAC, Chum and Matas 2005)
+ *  - sprt: early rejection of bad hypotheses by the Sequential Probability Ratio Test
+ *    (Optimal Randomized RANSAC, Chum and Matas 2008)
+ *  - sprtDelta: initial probability of a correspondence being consistent with a bad hypothesis
+ *  - sprtModelCost: cost of generating a hypothesis, in units of verifying one correspondence
+ *  - seed: the random sequence of samples, so the result does not depend on the number of threads
+ */
+struct RansacOptions
+{
+    double threshold = 0.1;
+    uint_t maxIterations = 10000;
+    double confidence = 0.999;
+    bool prosac = false;
+    bool sprt = true;
+    double sprtDelta = 0.01;
+    double sprtModelCost = 200.0;
+    uint_t seed = 0;
+};
+
+/**
+ * RANSAC over the minimal (3 points) Arun solver, for correspondences with outliers, e.g. feature matches.
+ * Hypotheses are generated and scored in parallel batches, and the best one is refined by
+ * Arun over all its inliers until the set of inliers does not change.
+ *
+ * Outputs the solution T and the indexes of the inliers (empty if no hypothesis was found).
+ * Returns the number of hypotheses evaluated.
+ */
+int ransac_arun(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T,
+        std::vector<uint_t> &inliers, const RansacOptions &options = RansacOptions());
+
+
+/**
+ * Robust kernels rho(s) for the registration solvers, where s is the squared (Mahalanobis) residual
+ * of each correspondence and c the kernel width:
+ *  - QUADRATIC:      rho = s/2 (no robust kernel)
+ *  - HUBER:          rho = s/2 if s < c^2, else c sqrt(s) - c^2/2
+ *  - CAUCHY:         rho = c^2/2 log(1 + s/c^2)
+ *  - GEMAN_MCCLURE:  rho = s/2 c^2/(c^2 + s)
+ * They are solved by iteratively reweighted least squares, weighting each correspondence by rho'(s)/rho'_quadratic.
+ */
+enum robustKernel{QUADRATIC = 0, HUBER, CAUCHY, GEMAN_MCCLURE};
+
+/**
+ * Parameters of the registration solvers (gicp and weighted_point):
+ *  - maxIters: maximum number of iterations, including rejected LM steps
+ *  - tol: convergence when the norm of the update is smaller than tol
+ *  - useLM: Levenberg-Marquardt (ellipsoidal) damping H + lambda diag(H), otherwise Gauss-Newton
+ *  - lambda: initial LM damping
+ *  - kernel and kernelWidth: robust kernel. Correspondences with sqrt(s) < kernelWidth are counted as inliers
+ */
+struct RegistrationOptions
+{
+    uint_t maxIters = 20;
+    double tol = 1e-4;
+    bool useLM = false;
+    double lambda = 1e-4;
+    robustKernel kernel = QUADRATIC;
+    double kernelWidth = 1.0;
+};
+
+/**
+ * Summary of the registration: iterations, robust cost sum rho(s) at the initial and at the
+ * final transformation, ratio of inliers at the solution and whether tol was reached.
+ */
+struct RegistrationStats
+{
+    uint_t iterations = 0;
+    double initialCost = 0.0;
+    double finalCost = 0.0;
+    double inlierRatio = 0.0;
+    bool converged = false;
+};
+
 
 
 
@@ -69,12 +214,21 @@ int arun(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T)
  * T = min sum || y - Tx ||_S^2
  *
  * The covariances provided are of the form S = R diag(e,1,1) R', so they MUST have been already processed.
- * The right way is a block matrix of covariances of the form Cov = [Cov_1, Cov_2,..., Cov_N], i.e, Cov \in R^{3x3N}
+ * The right way is a block matrix of covariances stacked vertically Cov = [Cov_1; Cov_2;...; Cov_N], i.e, Cov \in R^{3Nx3}
+ * (see estimate_covariances())
  *
  * Returns the number of iterations until convergence
  */
 int gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
         const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY, SE3 &T, double tol = 1e-4);
+/**
+ * GICP with robust kernel, LM damping and iteration limits given by options.
+ * The kernel is applied to the Mahalanobis distance of each correspondence.
+ * Returns the statistics of the optimization.
+ */
+RegistrationStats gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY, SE3 &T,
+        const RegistrationOptions &options);
 
 
 /**
@@ -94,7 +248,190 @@ int gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
  */
 int weighted_point(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
         const Eigen::Ref<const MatX1> w, SE3 &T, double tol = 1e-4);
+/**
+ * Weighted point registration with robust kernel, LM damping and iteration limits given by options.
+ * The kernel is applied to s = w || y - Tx ||^2 of each correspondence.
+ * Returns the statistics of the optimization.
+ */
+RegistrationStats weighted_point(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX1> w, SE3 &T, const RegistrationOptions &options);
+
+/**
+ * Point to plane registration using SE3 optimization, for associated points x and y,
+ * where y lies on a surface of (unit) normal n_y:
+ *
+ * T = min sum ( n_y' (y - Tx) )^2
+ *
+ * Normals are a N x 3 matrix (see estimate_normals()), points with zero normal do not contribute.
+ *
+ * Returns the number of iterations until convergence
+ */
+int point_to_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsY, SE3 &T, double tol = 1e-4);
+/**
+ * Same as above, with robust kernel, LM damping and iteration limits given by options.
+ * Returns the statistics of the optimization.
+ */
+RegistrationStats point_to_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsY, SE3 &T, const RegistrationOptions &options);
+
+/**
+ * Symmetric point to plane registration (Rusinkiewicz 2019), the residual is projected on
+ * the sum of the normals of both points:
+ *
+ * T = min sum ( (n_y + R n_x)' (y - Tx) )^2
+ *
+ * Normals are not required to have a consistent orientation, R n_x is oriented as n_y.
+ *
+ * Returns the number of iterations until convergence
+ */
+int symmetric_point_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsX, const Eigen::Ref<const MatX> normalsY, SE3 &T, double tol = 1e-4);
+/**
+ * Same as above, with robust kernel, LM damping and iteration limits given by options.
+ * Returns the statistics of the optimization.
+ */
+RegistrationStats symmetric_point_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsX, const Eigen::Ref<const MatX> normalsY, SE3 &T,
+        const RegistrationOptions &options);
+
+
+/**
+ * Voxel grid downsampling: each voxel of size voxelSize is replaced by the centroid of its points.
+ * Returns a M x 3 matrix of points
+ */
+MatX voxel_downsample(const Eigen::Ref<const MatX> X, double voxelSize);
+
+/**
+ * Estimates the covariance of each point in X (N x 3) from its k nearest neighbours, indexed in indexX,
+ * regularized as a plane, in the form required by gicp():
+ *      Cov_i = R diag(e,1,1) R',
+ * where the first column of R is the normal (eigenvector of the minimum eigenvalue) of the local covariance.
+ * Points with less than 3 neighbours (within maxDistance) are given the identity.
+ * Runs in parallel and returns a 3N x 3 matrix with the covariances stacked vertically.
+ */
+MatX estimate_covariances(const Eigen::Ref<const MatX> X, const SpatialIndex &indexX, uint_t k = 20,
+        double e = 1e-3, double maxDistance = std::numeric_limits<double>::infinity());
+/**
+ * Same as above, building a KDTree on X
+ */
+MatX estimate_covariances(const Eigen::Ref<const MatX> X, uint_t k = 20, double e = 1e-3,
+        double maxDistance = std::numeric_limits<double>::infinity());
+/**
+ * Estimates the normal of each point in X (N x 3) from its k nearest neighbours, indexed in indexX,
+ * as the eigenvector of the minimum eigenvalue of their covariance. Points with less than 3
+ * neighbours (within maxDistance) are given a zero normal.
+ * Runs in parallel and returns a N x 3 matrix of unit normals, with arbitrary orientation.
+ */
+MatX estimate_normals(const Eigen::Ref<const MatX> X, const SpatialIndex &indexX, uint_t k = 20,
+        double maxDistance = std::numeric_limits<double>::infinity());
+/**
+ * Same as above, building a KDTree on X
+ */
+MatX estimate_normals(const Eigen::Ref<const MatX> X, uint_t k = 20,
+        double maxDistance = std::numeric_limits<double>::infinity());
+
+
+/**
+ * Iterative Closest Point, when data association is unknown. Alternates:
+ *  1) correspondences: nearest neighbour in Y of each point T*x, at a distance smaller than maxDistance
+ *  2) registration of the associated pairs, by weighted_point() (unit weights) starting from the current T
+ * until the update of T is smaller than tol, or maxIters.
+ *
+ * The spatial index of Y (KDTree or VoxelHashGrid) is built once by the caller, so it can
+ * be reused for many point clouds X. T is the initial guess and the solution.
+ *
+ * Returns the number of iterations, or 0 if there were less than 3 correspondences
+ */
+int icp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, const SpatialIndex &indexY, SE3 &T,
+        double maxDistance = 1.0, double tol = 1e-4, uint_t maxIters = 30);
+/**
+ * Same as above, building a KDTree on Y
+ */
+int icp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T,
+        double maxDistance = 1.0, double tol = 1e-4, uint_t maxIters = 30);
 
+/**
+ * ICP where the registration step is gicp(), so the covariances of both point clouds
+ * are required, in the same format as gicp().
+ */
+int icp_gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY,
+        const SpatialIndex &indexY, SE3 &T,
+        double maxDistance = 1.0, double tol = 1e-4, uint_t maxIters = 30);
+/**
+ * Same as above, building a KDTree on Y
+ */
+int icp_gicp(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> covX, const Eigen::Ref<const MatX> covY, SE3 &T,
+        double maxDistance = 1.0, double tol = 1e-4, uint_t maxIters = 30);
+
+/**
+ * Registration methods available for the ICP pyramid, on each level the required
+ * normals or covariances are estimated from the k nearest neighbours.
+ */
+enum registrationMethod{POINT_POINT = 0, POINT_PLANE, SYMMETRIC_POINT_PLANE, GICP};
+
+/**
+ * Correspondences of an ICP iteration: associated points of the source (X) and the target (Y),
+ * and the normals or covariances required by the registration method, in the format of
+ * point_to_plane(), symmetric_point_plane() or gicp().
+ */
+struct Correspondences
+{
+    MatX X, Y, normalsX, normalsY, covX, covY;
+};
+
+/**
+ * ICP for any data association, alternates:
+ *  1) associate(T, correspondences): fills the correspondences at the current T and returns their number
+ *  2) registration of the correspondences by method, starting from the current T, with options
+ * until the update of T is smaller than tol, or maxIters.
+ *
+ * Returns the statistics, where iterations are the ICP iterations and the rest correspond to
+ * the last registration. Iterations are 0 if there were less than minCorrespondences.
+ */
+RegistrationStats icp_driver(const std::function<uint_t(const SE3 &, Correspondences &)> &associate, SE3 &T,
+        registrationMethod method, double tol, uint_t maxIters, const RegistrationOptions &options,
+        uint_t minCorrespondences);
+
+/**
+ * Parameters of each level of the pyramid:
+ *  - voxelSize: point clouds are voxel downsampled to this size, 0 for full resolution
+ *  - maxDistance: maximum distance of the correspondences
+ *  - maxIters and tol: ICP iterations (data association), until the update is smaller than tol
+ *  - neighbours: number of neighbours to estimate normals and covariances
+ *  - options: registration at each ICP iteration (kernel, LM, iterations)
+ */
+struct PyramidLevel
+{
+    double voxelSize = 0.0;
+    double maxDistance = 1.0;
+    uint_t maxIters = 30;
+    double tol = 1e-4;
+    uint_t neighbours = 10;
+    RegistrationOptions options;
+};
+
+/**
+ * Levels from coarse to fine, the finest has voxelSize (0 for full resolution, then the next
+ * is minVoxelSize) and each coarser level is factor times larger. The maximum distance of
+ * correspondences is 3 times the voxel size.
+ */
+std::vector<PyramidLevel> create_pyramid_levels(uint_t numberLevels, double voxelSize, double minVoxelSize = 0.05,
+        double factor = 2.0);
+
+/**
+ * Coarse to fine ICP: the point clouds are downsampled into a voxel pyramid (each level
+ * from the previous finer level) and registered from the coarsest level, each level
+ * warm-starting the next finer one. Levels are ordered from coarse to fine.
+ *
+ * T is the initial guess and the solution. Returns the statistics of each level,
+ * where iterations are the ICP iterations and the rest correspond to the last registration
+ * of the level. A level with less than 6 correspondences is skipped (0 iterations).
+ */
+std::vector<RegistrationStats> icp_pyramid(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T,
+        const std::vector<PyramidLevel> &levels, registrationMethod method = POINT_PLANE);
 
 }}//namespace
 #endif /* PC_REGISTRATION_HPP_ */
@@ -38,24 +38,65 @@ namespace mrob{
  * class Plane stores a vector of point clouds from different observations
  * and  provides the gradients with respect to those poses.
  *
- * It requires the exact number of poses that it is being considering.
- * This is a design limitation, to be solved soon.
+ * Observations are keyed by their time stamp t (the index of the pose in the trajectory),
+ * which need not be consecutive: the plane keeps an ordered list of the times it has been observed
+ * and only those hold points and S/Q matrices. New observations can be added at any time,
+ * for instance when the trajectory grows.
  *
+ * Points can be stored in two modes:
+ *  - STORE_POINTS (default): all points are kept, and the matrices S
+ *    are calculated from them when required.
+ *  - SUFFICIENT_STATISTICS: points are not stored, they are folded into
+ *    S_t = sum p*p' as they arrive. This is all the optimization requires, and
+ *    memory is O(poses) instead of O(points). Points can not be recovered.
  */
 class Plane{
   public:
-    Plane(uint_t timeLength);
+    enum pointsMode{STORE_POINTS=0, SUFFICIENT_STATISTICS};
+    /**
+     * Constructor. The input timeLength is the expected number of observations,
+     * only used for reserving memory.
+     */
+    Plane(uint_t timeLength = 0, pointsMode mode = STORE_POINTS);
     ~Plane();
 
-    void reserve(uint_t d, uint_t t);//XXX not used
+    /**
+     * Reserves memory for d points at time t, creating the observation if needed.
+     */
+    void reserve(uint_t d, uint_t t);
     Mat41 get_plane(void) {return planeEstimation_;};
     /**
      * This function is intended to add a point that belongs to the plane at time t
      * Internally, we will save a copy of them
      */
     void push_back_point(Mat31 &point, uint_t t);
+    /**
+     * Adds a batch of points, a N x 3 matrix, that belong to the plane at time t.
+     * On SUFFICIENT_STATISTICS mode the S matrix is updated as a matrix product over
+     * all the batch (vectorized), otherwise points are stored as in push_back_point().
+     */
+    void push_back_points(const Eigen::Ref<const MatX> &points, uint_t t);
+    /**
+     * Adds directly the matrix S = sum [p;1][p;1]' of the points observed at time t,
+     * for instance from a plane segmentation. Only on SUFFICIENT_STATISTICS mode.
+     */
+    void push_back_matrix_S(const Mat4 &S, uint_t t);
+    /**
+     * Returns the points at time t. On SUFFICIENT_STATISTICS mode, or if
+     * the plane was not observed at time t, this vector is empty
+     */
     std::vector<Mat31>& get_points(uint_t t);
-    uint_t get_number_points(uint_t t) {return allPlanePoints_[t].size();};
+    /**
+     * Returns the number of points observed at time t, zero if not observed
+     */
+    uint_t get_number_points(uint_t t) const;
+    /**
+     * Returns the ordered list of time stamps where the plane was observed.
+     */
+    const std::vector<uint_t>& get_observed_times() const {return timeIndex_;};
+    uint_t get_number_observations() const {return timeIndex_.size();};
+    bool is_observed(uint_t t) const {return find_observation(t) < timeIndex_.size();};
+    pointsMode get_points_mode() const {return pointsMode_;};
     uint_t get_total_number_points() {return numberPoints_;};
     void clear_points();
     void set_trajectory(const std::shared_ptr<const std::vector<SE3>> &trajectory) {trajectory_ = trajectory;};
@@ -85,10 +126,11 @@ class Plane{
 
     /**
      *  calculates the matrix S = sum(p*p'), where p = [x,y,z,1]
-     * for all planes, as an aggregation of the outer product of all
-     * homogeneous points
-     * If reset = true, clears all information and recalculates S
-     * If reset = false (default) only calculates S if there is no calculation yet
+     * for all observations, as an aggregation of the outer product of all
+     * homogeneous points.
+     *
+     * S matrices are accumulated as points arrive, so they are always up to date.
+     * If reset = true, and points are stored, S is recalculated from the points.
      */
     void calculate_all_matrices_S(bool reset=false);
     /**
@@ -110,7 +152,7 @@ class Plane{
     /**
      * calculate gradient at time t, returns the Jacobian over the EF from SVD of Q  = U D V'
      * as d lamda = v' * dQ * v
-     *
+     * If the plane was not observed at time t, the gradient is zero.
      */
     Mat61 calculate_gradient(uint_t t);
 
@@ -118,18 +160,51 @@ class Plane{
      * calculates the Hessian of the eigen factor, as described in the paper.
      * It requires to FIRST calculate gradient.
      * Output is an upper traingular view of the symetric hessian matrix
+     * If the plane was not observed at time t, the Hessian is zero.
      */
     Mat6 calculate_hessian(uint_t t);
 
 
+    /**
+     * Calculates the gradient and the Hessian of the plane error w.r.t. the consecutive poses
+     * at times [tFirst, tFirst + numberPoses), and adds them to the accumulators
+     * gradient (6N x 1) and hessian (6N x 6N, complete). Other observations and the
+     * prior are constant.
+     *
+     * Unlike calculate_hessian(t), this is the Gauss-Newton approximation of the joint
+     * problem (poses, plane) after the Schur complement of the plane, so it includes
+     * the cross terms between poses observing the plane.
+     * It requires the matrices Q to be updated, e.g. by estimate_plane().
+     */
+    void add_gradient_hessian_window(uint_t tFirst, uint_t numberPoses,
+                                     Eigen::Ref<MatX1> gradient, Eigen::Ref<MatX> hessian) const;
+    /**
+     * Marginalizes all observations before time t: their matrices Q_t = T_t * S_t * T_t',
+     * with the current trajectory, are accumulated into a constant prior and the
+     * observations (S, points) are removed. The plane estimation is the same, but
+     * these poses can not be optimized anymore.
+     */
+    void marginalize_observations(uint_t t);
+    const Mat4& get_prior() const {return priorQ_;};
+
     void reset();
     void print() const;
 
 
   protected:
-    // max index of time, or trajectory length
-    uint_t timeLength_;
-    //std::vector<uint_t> timeIndex_;// not used now, but it would be useful for non-consecutive obs
+    /**
+     * Returns the position of the observation at time t, or the number of
+     * observations if the plane was not observed at t.
+     */
+    uint_t find_observation(uint_t t) const;
+    /**
+     * Returns the position of the observation at time t, creating it if it does not exist
+     */
+    uint_t add_observation(uint_t t);
+
+    pointsMode pointsMode_;
+    // ordered time stamps of the observations. The following containers (points, S, Q) are aligned to it
+    std::vector<uint_t> timeIndex_;
 
     // Overparametrized plane, as a transformation in SE3 TODO needed?
     //SE3 plane_;
@@ -139,6 +214,8 @@ class Plane{
 
     // subset of pointcloud for the given plane
     std::vector< std::vector<Mat31> > allPlanePoints_;
+    std::vector<Mat31> emptyPoints_;
+    std::vector<uint_t> numberPointsTime_;
     uint_t numberPoints_;
 
     // Transformations. We shared it across all planes that need it.
@@ -147,6 +224,7 @@ class Plane{
     // gradient calculation Q
     std::vector<Mat4> matrixS_, matrixQ_;
     Mat4 accumulatedQ_;//Q matrix of accumulated values for the incremental update of the error.
+    Mat4 priorQ_;// Q matrices from marginalized observations, already in the global frame
 
     // Store last gradients calculated (for Hessian)
     std::vector<Mat4> gradQ_, lieGenerativeMatrices_;//TODO move this to a common library utility, replicating this every time is terrible.
@@ -0,0 +1,98 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_blocks.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef PLANE_BLOCKS_HPP_
+#define PLANE_BLOCKS_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/plane.hpp"
+#include <algorithm>
+#include <vector>
+#include <memory>
+
+namespace mrob{
+
+/**
+ * Evaluation of a set of planes in parallel by blocks of consecutive planes.
+ * Each block accumulates its own result and the blocks are reduced in order,
+ * so results are deterministic regardless of the number of threads.
+ *
+ * The block accumulators are kept between calls to avoid reallocations.
+ * Used by PlaneRegistration and PlaneOdometry.
+ */
+class PlaneBlocks
+{
+public:
+    /**
+     * Estimates all planes and returns the sum of their errors
+     */
+    double estimate_planes(const std::vector<std::shared_ptr<Plane>> &planes);
+    /**
+     * Accumulates the gradient (N x 1) and, if calculateHessian, the Hessian (N x N)
+     * of all planes. For each plane, addPlane(plane, gradient, hessian) adds its terms
+     * to the block accumulators, as Eigen::Ref<MatX1> and Eigen::Ref<MatX>
+     * (the Hessian is empty when not required).
+     */
+    template<typename AddPlane>
+    void accumulate_gradient_hessian(const std::vector<std::shared_ptr<Plane>> &planes, uint_t N,
+                                     bool calculateHessian, AddPlane addPlane,
+                                     MatX1 &gradient, MatX &hessian);
+
+protected:
+    static constexpr long blockSize_ = 8;
+    std::vector<double> blockErrors_;
+    MatX blockGradients_, blockHessians_;
+};
+
+template<typename AddPlane>
+void PlaneBlocks::accumulate_gradient_hessian(const std::vector<std::shared_ptr<Plane>> &planes, uint_t N,
+                                              bool calculateHessian, AddPlane addPlane,
+                                              MatX1 &gradient, MatX &hessian)
+{
+    // 1) each block of planes accumulates its gradient and Hessian
+    const long numberPlanes = planes.size();
+    const long numberBlocks = (numberPlanes + blockSize_ - 1) / blockSize_;
+    const long hessianRows = calculateHessian ? N : 0;
+    // block gradients are rows (MatX is row major), contiguous, so each block accumulates in place without allocations
+    blockGradients_.setZero(numberBlocks, N);
+    blockHessians_.setZero(hessianRows*numberBlocks, hessianRows);
+    #pragma omp parallel for schedule(dynamic)
+    for (long b = 0; b < numberBlocks; ++b)
+    {
+        for (long i = b*blockSize_; i < std::min(numberPlanes, (b+1)*blockSize_); ++i)
+            addPlane(*planes[i], blockGradients_.row(b).transpose(),
+                     blockHessians_.block(hessianRows*b, 0, hessianRows, hessianRows));
+    }
+
+    // 2) reduction in block order
+    gradient.setZero(N);
+    if (calculateHessian)
+        hessian.setZero(N, N);
+    for (long b = 0; b < numberBlocks; ++b)
+    {
+        gradient += blockGradients_.row(b).transpose();
+        if (calculateHessian)
+            hessian += blockHessians_.block(N*b, 0, N, N);
+    }
+}
+
+}//namespace
+
+#endif /* PLANE_BLOCKS_HPP_ */
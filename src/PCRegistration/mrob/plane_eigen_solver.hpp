@@ -0,0 +1,77 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_eigen_solver.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef PLANE_EIGEN_SOLVER_HPP_
+#define PLANE_EIGEN_SOLVER_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include <vector>
+
+namespace mrob{
+
+/**
+ * Calculates the minimum eigenvalue and its eigenvector of a 4x4 symmetric
+ * positive semi-definite matrix Q, as required for plane estimation
+ * (Q = sum T S T', the plane is the eigenvector and the error the eigenvalue).
+ *
+ * The input v is used as a warm start (e.g. the plane from the previous iteration)
+ * and it is refined by inverse iteration, solving (Q + eps*I) v' = v with a single
+ * Cholesky factorization. For planes, lambda_min << lambda_2, so the convergence
+ * (proportional to lambda_min / lambda_2) is very fast, usually 1 or 2 iterations.
+ *
+ * If the warm start is zero, the residual |Q v - lambda v| does not converge in
+ * maxIters (ill-conditioned or degenerate planes), or Q is not PSD, it falls back
+ * to the complete eigen decomposition.
+ *
+ * Input Q, matrix 4x4
+ * Input/Output v: warm start and output unitary eigenvector
+ * Returns the minimum eigenvalue
+ */
+double min_eigenpair_4x4(const Mat4 &Q, Mat41 &v, uint_t maxIters = 8);
+
+/**
+ * Batch version of min_eigenpair_4x4, over a set of matrices Q (e.g. all planes).
+ * Input/Output v: warm start and eigenvectors, same size as Q
+ * Output lambda: minimum eigenvalues
+ */
+void min_eigenpair_4x4_batch(const std::vector<Mat4> &Q, std::vector<Mat41> &v, std::vector<double> &lambda, uint_t maxIters = 8);
+
+/**
+ * Gradient and Hessian of the plane error, the minimum eigenvalue of Q = sum_a Q_a (+ constant
+ * terms), w.r.t. the poses a observing the plane (left update). The plane is eliminated by the
+ * Schur complement of the Gauss-Newton joint Hessian (poses, plane), see PlaneFactor:
+ *
+ *   g_a  = 2 * W'Q_a pi
+ *   H_ab = 2 * delta_ab * W'Q_a W - 2 * sum_k (W'Q_a v_k)(W'Q_b v_k)' / lambda_k
+ *
+ * where W = [G_1'pi, ..., G_6'pi] and pi, (v_k, lambda_k) the eigenpairs of Q.
+ * Degenerate directions (points on a line) are not eliminated.
+ *
+ * Input Q: accumulated matrix, including the poses that are not derived (constant)
+ * Input matricesQ: Q_a = T_a S_a T_a' of the M poses derived
+ * Output gradient (6M x 1), hessian (6M x 6M) and plane pi
+ * Returns the plane error (minimum eigenvalue)
+ */
+double plane_schur_gradient_hessian(const Mat4 &Q, const std::vector<const Mat4*> &matricesQ,
+                                    MatX1 &gradient, MatX &hessian, Mat41 &plane);
+
+}//namespace
+
+#endif /* PLANE_EIGEN_SOLVER_HPP_ */
@@ -0,0 +1,113 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_odometry.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef PLANE_ODOMETRY_HPP_
+#define PLANE_ODOMETRY_HPP_
+
+#include "mrob/SE3.hpp"
+#include "mrob/plane.hpp"
+#include "mrob/plane_blocks.hpp"
+#include "mrob/optimizer.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+
+namespace mrob{
+
+/**
+ * class PlaneOdometry estimates online the trajectory of a sensor observing planes,
+ * with a constant cost per scan (sliding window).
+ *
+ * Each new scan adds a pose, predicted by a constant velocity model, and the poses in the
+ * window are jointly optimized (the oldest pose in the window is fixed), by LM over the
+ * plane errors (see Plane::add_gradient_hessian_window).
+ *
+ * When the window is full, the oldest pose is marginalized: planes accumulate the
+ * observations of the poses leaving the window into a prior Q, constant from then on,
+ * and only keep the S matrices of the poses inside the window. Planes without
+ * observations on the window are kept apart (inactive) and they are only
+ * evaluated again if they are re-observed. Thus, the cost per scan depends on
+ * the window size and the number of planes observed, not on the length of the sequence.
+ */
+class PlaneOdometry: public Optimizer{
+
+  public:
+    PlaneOdometry(uint_t windowSize = 5, Plane::pointsMode mode = Plane::SUFFICIENT_STATISTICS);
+    ~PlaneOdometry();
+
+    // Function from the parent class Optimizer
+    virtual matData_t calculate_error() override;
+    virtual void calculate_gradient_hessian() override;
+    virtual void update_state(const MatX1 &dx) override;
+    virtual void bookkeep_state() override;
+    virtual void update_state_from_bookkeep() override;
+
+    /**
+     * Adds a new scan, a N x 3 matrix of points in the sensor frame, and the plane id of each point.
+     * It optimizes the window and, if full, marginalizes the oldest pose.
+     * Returns the estimated pose of the new scan.
+     */
+    SE3 add_scan(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &planeIds);
+
+    uint_t get_number_poses() const {return trajectory_->size();};
+    uint_t get_window_size() const {return windowSize_;};
+    uint_t get_number_active_planes() const {return planes_.size();};
+    uint_t get_number_planes() const {return planes_.size() + inactivePlanes_.size();};
+    /**
+     * Returns the pose at time t, poses that left the window are not modified anymore
+     */
+    SE3 get_pose(uint_t t) const;
+    const std::vector<SE3>& get_trajectory() const {return *trajectory_;};
+    /**
+     * Sets the optimization method (LM by default) and the initial lambda for each scan
+     */
+    void set_optimization_method(optimMethod method, double lambda = 1e-3) {method_ = method; initialLambda_ = lambda;};
+    uint_t get_last_iterations() const {return iterations_;};
+
+  protected:
+    /**
+     * Marginalizes the oldest pose of the window and moves away planes without observations
+     */
+    void marginalize_oldest_pose();
+    /**
+     * Updates the vector of active planes for parallel (indexed) access
+     */
+    void update_planes_index();
+
+    uint_t windowSize_;
+    Plane::pointsMode pointsMode_;
+    uint_t firstWindowPose_;//time of the oldest pose in the window, which is fixed
+    std::shared_ptr<std::vector<SE3>> trajectory_;
+    std::unordered_map<uint_t, std::shared_ptr<Plane>> planes_, inactivePlanes_;
+    std::vector<SE3> bookkeptWindow_;
+
+    // Planes for parallel evaluation
+    std::vector<std::shared_ptr<Plane>> planesIndex_;
+    PlaneBlocks planeBlocks_;
+
+    optimMethod method_;
+    double initialLambda_;
+    uint_t iterations_;
+};
+
+}// namespace
+#endif /* PLANE_ODOMETRY_HPP_ */
@@ -28,6 +28,7 @@
 #include "mrob/SE3.hpp"
 #include <Eigen/StdVector>
 #include "mrob/plane.hpp"
+#include "mrob/plane_blocks.hpp"
 #include "mrob/optimizer.hpp"
 #include "mrob/time_profiling.hpp"
 
@@ -55,7 +56,9 @@ class PlaneRegistration: public Optimizer{
                    GN_HESSIAN,
                    GN_CLAMPED_HESSIAN,
                    LM_SPHER,
-                   LM_ELLIP};
+                   LM_ELLIP,
+                   GRADIENT_LBFGS,
+                   GRADIENT_CG};
 
   public:
     PlaneRegistration();
@@ -65,6 +68,7 @@ class PlaneRegistration: public Optimizer{
     // Function from the parent class Optimizer
     virtual matData_t calculate_error() override;
     virtual void calculate_gradient_hessian() override;
+    virtual void calculate_gradient() override;
     virtual void update_state(const MatX1 &dx) override;
     virtual void bookkeep_state() override;
     virtual void update_state_from_bookkeep() override;
@@ -120,6 +124,12 @@ class PlaneRegistration: public Optimizer{
      * Sets the trajectory (current solution) by addint the last pose
      */
     void set_last_pose(SE3 &last);
+    /**
+     * Appends a new pose at the end of the trajectory (online), and returns its time index.
+     * Planes and points already in the structure are kept, and new points can be
+     * observed from this pose.
+     */
+    uint_t add_pose(const SE3 &pose);
 
     /**
      * add_plane adds a plane structure already initialized and filled with data
@@ -135,8 +145,19 @@ class PlaneRegistration: public Optimizer{
      * add a point to the new plane. An ALTERNATIVE (for py) to add points into the sover
      * class (instead of adding the point fully as in add_plane())
      *
+     * Points observed at a time t beyond the current trajectory extend it,
+     * initialized with the last pose (see add_pose()).
      */
     void plane_push_back_point(uint_t id, uint_t t, Mat31 &point);
+    /**
+     * add a batch of points (N x 3 matrix) to the plane, observed at time t.
+     */
+    void plane_push_back_points(uint_t id, uint_t t, const Eigen::Ref<const MatX> &points);
+    /**
+     * Sets how new planes (add_new_plane) keep their points, see Plane::pointsMode.
+     * SUFFICIENT_STATISTICS does not store points, only their S matrices.
+     */
+    void set_points_mode(Plane::pointsMode mode) {pointsMode_ = mode;};
 
     uint_t calculate_total_number_points();
     std::shared_ptr<Plane> & get_plane(uint_t id);
@@ -166,8 +187,14 @@ class PlaneRegistration: public Optimizer{
     /**
      * add point_cloud requires a complete set of points observed at a given time
      * stamp (XXX now only an integer) and fills in the registration structure.
+     * Planes that do not exist are created.
      */
     void add_point_cloud_planes(uint_t time, std::vector<Mat31>& points, std::vector<uint_t>& point_ids);
+    /**
+     * Adds the matrices S of the planes observed at a given time (see PlaneSegmentation).
+     * Planes that do not exist are created on SUFFICIENT_STATISTICS mode, existing planes must be on this mode.
+     */
+    void add_planes_matrix_S(uint_t time, const std::vector<uint_t>& plane_ids, const std::vector<Mat4>& S);
     /**
      * get_point_cloud gets all raw point, according to the current time index
      * from trajectory. It does not distinguish between planes.
@@ -176,13 +203,34 @@ class PlaneRegistration: public Optimizer{
     std::vector<Mat31> get_point_plane_ids(uint_t time);
 
   protected:
+    /**
+     * Calculates the gradient and, if required, the Hessian, by accumulating all planes.
+     * Planes are evaluated in parallel by blocks of planesBlockSize_ planes, each block
+     * with its own accumulator. Blocks are fixed, independently of the number of threads,
+     * and they are reduced in order, so the result is deterministic.
+     */
+    void accumulate_gradient_hessian(bool calculateHessian);
+    /**
+     * Updates the vector of planes for parallel (indexed) access
+     */
+    void update_planes_index() const;
+    /**
+     * Extends the trajectory, if required, such that the pose at time exists.
+     * New poses are initialized as the last pose
+     */
+    void extend_trajectory(uint_t time);
+
     // flag for detecting when is has been solved
     uint_t numberPlanes_, numberPoses_, numberPoints_;
     uint_t isSolved_;
     PlaneRegistration::TrajectoryMode trajMode_;
     uint_t time_;
     std::unordered_map<uint_t, std::shared_ptr<Plane>> planes_;
+    Plane::pointsMode pointsMode_;
     std::shared_ptr<std::vector<SE3>> trajectory_;
+    // Planes for parallel evaluation, indexed in the same order as planes_
+    mutable std::vector<std::shared_ptr<Plane>> planesIndex_;
+    mutable PlaneBlocks planeBlocks_;
     SE3 bookept_trajectory_;//last pose is stored/bookept
     double tau_;//variable for weighting the number of poses in traj
     uint_t solveIters_;
@@ -190,7 +238,6 @@ class PlaneRegistration: public Optimizer{
     // 1st order parameters methods if used
     PlaneRegistration::SolveMode solveMode_;
     std::vector<Mat61> previousState_;
-    double c1_, c2_;    //parameters for the Wolfe conditions DEPRECATED?
     double alpha_, beta_;
 
 
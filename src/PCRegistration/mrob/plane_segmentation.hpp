@@ -0,0 +1,107 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_segmentation.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef PLANE_SEGMENTATION_HPP_
+#define PLANE_SEGMENTATION_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/voxel_key.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+
+namespace mrob{
+
+/**
+ * class PlaneSegmentation extracts planes from an (unorganized) point cloud,
+ * by region growing over a voxel hash:
+ *  1) points are distributed in voxels of size voxelSize, indexed by a hash table
+ *  2) for each voxel (in parallel), the matrix S = sum [p;1][p;1]' is accumulated and
+ *     the voxel is planar if it has enough points and its thickness, the square root of the
+ *     minimum eigenvalue of the covariance, is smaller than maxDistance.
+ *  3) planar voxels are merged with their 26 neighbours, starting from the thinnest voxels, if
+ *     their normals are aligned (maxAngle) and their centroid is at a distance smaller than
+ *     maxDistance from the current plane of the region.
+ *  4) regions with enough points are planes, sorted by number of points.
+ *
+ * The output are the plane ids of each point and the matrix S of each plane, which are
+ * the sufficient statistics required by Plane (see PlaneRegistration::add_planes_matrix_S()).
+ * Plane ids are local to each point cloud, its association between point clouds
+ * is not solved here.
+ */
+class PlaneSegmentation{
+
+  public:
+    /**
+     * Id of the points that do not belong to any plane
+     */
+    static constexpr uint_t NO_PLANE = std::numeric_limits<uint_t>::max();
+
+    PlaneSegmentation(double voxelSize = 0.5, double maxDistance = 0.05, double maxAngle = 0.17,
+                      uint_t minPointsVoxel = 10, uint_t minPointsPlane = 100);
+    ~PlaneSegmentation();
+
+    /**
+     * Segments a N x 3 point cloud. Returns the number of planes
+     */
+    uint_t segment(const Eigen::Ref<const MatX> &points);
+
+    uint_t get_number_planes() const {return matrixS_.size();};
+    /**
+     * Returns the plane id of each point of the last point cloud, or NO_PLANE
+     */
+    const std::vector<uint_t>& get_point_ids() const {return pointIds_;};
+    /**
+     * Returns the matrix S = sum [p;1][p;1]' of each plane
+     */
+    const std::vector<Mat4>& get_matrices_S() const {return matrixS_;};
+    /**
+     * Returns the planes [n', d]', with unit normal, such that n'p + d = 0
+     */
+    const std::vector<Mat41>& get_planes() const {return planes_;};
+
+  protected:
+    /**
+     * Normal, centroid and thickness (minimum eigenvalue of the covariance) from a matrix S
+     */
+    static matData_t fit_plane(const Mat4 &S, Mat31 &normal, Mat31 &centroid);
+
+    double voxelSize_, maxDistance_, cosMaxAngle_;
+    uint_t minPointsVoxel_, minPointsPlane_;
+
+    // voxels, points are indexed by voxel (counting sort) as voxelPoints_[voxelStart_[v] : voxelStart_[v+1]]
+    std::unordered_map<uint64_t, uint_t> voxelIndex_;
+    std::vector<uint64_t> voxelKeys_;
+    std::vector<uint_t> voxelStart_, voxelPoints_, pointVoxel_;
+    std::vector<Mat4> voxelS_;
+    std::vector<Mat31> voxelNormal_, voxelCentroid_;
+    std::vector<matData_t> voxelThickness_;
+    std::vector<uint_t> voxelRegion_;
+
+    // output
+    std::vector<uint_t> pointIds_;
+    std::vector<Mat4> matrixS_;
+    std::vector<Mat41> planes_;
+};
+
+}// namespace
+#endif /* PLANE_SEGMENTATION_HPP_ */
@@ -0,0 +1,258 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * registration_solver.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef REGISTRATION_SOLVER_HPP_
+#define REGISTRATION_SOLVER_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/SE3.hpp"
+#include "mrob/pc_registration.hpp"
+#include "mrob/optimizer.hpp"
+
+#include <Eigen/Cholesky>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace mrob{
+namespace PCRegistration{
+
+/**
+ * IRLS weight rho'(s)/rho'_quadratic of the robust kernel K (see robustKernel), for the
+ * squared residual s and the squared kernel width c2.
+ * The kernel is a template parameter, so loops over points do not branch on it.
+ */
+template<robustKernel K>
+inline matData_t robust_weight(matData_t s, matData_t c2)
+{
+    switch (K)
+    {
+        case HUBER:
+            return s < c2 ? 1.0 : std::sqrt(c2 / s);
+        case CAUCHY:
+            return c2 / (c2 + s);
+        case GEMAN_MCCLURE:
+        {
+            const matData_t d = c2 / (c2 + s);
+            return d * d;
+        }
+        default:
+            return 1.0;
+    }
+}
+
+/**
+ * Robust cost rho(s) of the kernel K, same arguments as robust_weight()
+ */
+template<robustKernel K>
+inline matData_t robust_cost(matData_t s, matData_t c2)
+{
+    switch (K)
+    {
+        case HUBER:
+            return s < c2 ? 0.5 * s : std::sqrt(c2 * s) - 0.5 * c2;
+        case CAUCHY:
+            return 0.5 * c2 * std::log1p(s / c2);
+        case GEMAN_MCCLURE:
+            return 0.5 * s * c2 / (c2 + s);
+        default:
+            return 0.5 * s;
+    }
+}
+
+// gradient (6), upper triangular part of the Hessian (21), robust cost and number of inliers
+const uint_t registrationAccumulatorSize = 29;
+// points are processed in blocks, each block accumulates its own gradient and Hessian and
+// they are reduced in block order, so the result does not depend on the number of threads
+const long registrationBlockSize = 512;
+
+/**
+ * Runs accumulate_block(start, end, acc) in parallel over blocks of the N points, where acc
+ * are the registrationAccumulatorSize values of the block, and reduces them in block order.
+ * Outputs the gradient, the (symmetric) Hessian and the number of inliers and returns the cost.
+ */
+template<typename AccumulateBlock>
+double reduce_blocks(long N, const AccumulateBlock &accumulate_block, std::vector<matData_t> &blockAccumulators,
+        Mat61 &gradient, Mat6 &hessian, uint_t &inliers)
+{
+    const long numberBlocks = (N + registrationBlockSize - 1) / registrationBlockSize;
+    blockAccumulators.resize(numberBlocks * registrationAccumulatorSize);
+    #pragma omp parallel for schedule(static)
+    for (long b = 0; b < numberBlocks; ++b)
+        accumulate_block(b*registrationBlockSize, std::min(N, (b+1)*registrationBlockSize),
+                         &blockAccumulators[b*registrationAccumulatorSize]);
+
+    matData_t acc[registrationAccumulatorSize] = {0};
+    for (long b = 0; b < numberBlocks; ++b)
+        for (uint_t k = 0; k < registrationAccumulatorSize; ++k)
+            acc[k] += blockAccumulators[b*registrationAccumulatorSize + k];
+    for (uint_t k = 0; k < 6; ++k)
+        gradient(k) = acc[k];
+    for (uint_t i = 0, k = 6; i < 6; ++i)
+        for (uint_t j = i; j < 6; ++j, ++k)
+        {
+            hessian(i,j) = acc[k];
+            hessian(j,i) = acc[k];
+        }
+    inliers = static_cast<uint_t>(acc[28]);
+    return acc[27];
+}
+
+/**
+ * Scalar residual r of a correspondence and its Jacobian j = dr/dxi (1x6)
+ */
+struct ResidualRow
+{
+    matData_t r, j0, j1, j2, j3, j4, j5;
+};
+
+/**
+ * Accumulates the points [start, end) of a method with scalar residuals (e.g. point to plane),
+ * given by the functor ResidualRow residual(i). Each point adds w r j' to the gradient and
+ * w j' j to the Hessian, being w the robust weight of s = r^2. The loop is written in scalars,
+ * such that the compiler can vectorize it over points (omp simd) once the functor is inlined.
+ */
+template<robustKernel K, typename Residual>
+void accumulate_scalar_residuals_block(const Residual &residual, matData_t c2, long start, long end, matData_t *acc)
+{
+    matData_t g0 = 0, g1 = 0, g2 = 0, g3 = 0, g4 = 0, g5 = 0;
+    matData_t h00 = 0, h01 = 0, h02 = 0, h03 = 0, h04 = 0, h05 = 0,
+                       h11 = 0, h12 = 0, h13 = 0, h14 = 0, h15 = 0,
+                                h22 = 0, h23 = 0, h24 = 0, h25 = 0,
+                                         h33 = 0, h34 = 0, h35 = 0,
+                                                  h44 = 0, h45 = 0,
+                                                           h55 = 0;
+    matData_t cost = 0, inliers = 0;
+    #pragma omp simd reduction(+:cost,inliers,g0,g1,g2,g3,g4,g5,h00,h01,h02,h03,h04,h05,h11,h12,h13,h14,h15,h22,h23,h24,h25,h33,h34,h35,h44,h45,h55)
+    for (long i = start; i < end; ++i)
+    {
+        const ResidualRow row = residual(i);
+        const matData_t s = row.r * row.r;
+        const matData_t w = robust_weight<K>(s, c2);
+        cost += robust_cost<K>(s, c2);
+        inliers += s < c2 ? 1.0 : 0.0;
+        const matData_t wr = w * row.r;
+        g0 += wr*row.j0; g1 += wr*row.j1; g2 += wr*row.j2;
+        g3 += wr*row.j3; g4 += wr*row.j4; g5 += wr*row.j5;
+        const matData_t w0 = w*row.j0, w1 = w*row.j1, w2 = w*row.j2, w3 = w*row.j3, w4 = w*row.j4, w5 = w*row.j5;
+        h00 += w0*row.j0; h01 += w0*row.j1; h02 += w0*row.j2; h03 += w0*row.j3; h04 += w0*row.j4; h05 += w0*row.j5;
+        h11 += w1*row.j1; h12 += w1*row.j2; h13 += w1*row.j3; h14 += w1*row.j4; h15 += w1*row.j5;
+        h22 += w2*row.j2; h23 += w2*row.j3; h24 += w2*row.j4; h25 += w2*row.j5;
+        h33 += w3*row.j3; h34 += w3*row.j4; h35 += w3*row.j5;
+        h44 += w4*row.j4; h45 += w4*row.j5;
+        h55 += w5*row.j5;
+    }
+    const matData_t res[registrationAccumulatorSize] = {g0, g1, g2, g3, g4, g5,
+            h00, h01, h02, h03, h04, h05, h11, h12, h13, h14, h15, h22, h23, h24, h25, h33, h34, h35, h44, h45, h55,
+            cost, inliers};
+    for (uint_t k = 0; k < registrationAccumulatorSize; ++k)
+        acc[k] = res[k];
+}
+
+/**
+ * Same as above, the kernel is selected at run time
+ */
+template<typename Residual>
+void accumulate_scalar_residuals_block(robustKernel kernel, const Residual &residual, matData_t c2,
+        long start, long end, matData_t *acc)
+{
+    switch (kernel)
+    {
+        case HUBER:
+            accumulate_scalar_residuals_block<HUBER>(residual, c2, start, end, acc);
+            break;
+        case CAUCHY:
+            accumulate_scalar_residuals_block<CAUCHY>(residual, c2, start, end, acc);
+            break;
+        case GEMAN_MCCLURE:
+            accumulate_scalar_residuals_block<GEMAN_MCCLURE>(residual, c2, start, end, acc);
+            break;
+        default:
+            accumulate_scalar_residuals_block<QUADRATIC>(residual, c2, start, end, acc);
+    }
+}
+
+/**
+ * Gauss-Newton or Levenberg-Marquardt iterations over SE3 (left update, T <- exp(dxi) T),
+ * common to the registration methods. The method is given by the functor
+ *      double evaluate(const SE3 &T, Mat61 &gradient, Mat6 &hessian, uint_t &inliers),
+ * which returns the robust cost at T, its (IRLS) gradient and Hessian and the number of inliers.
+ *
+ * On LM, a step is accepted only if it decreases the cost, otherwise the damping is
+ * increased and the gradient and Hessian are reused. The damping is updated by the trust
+ * region of Optimizer::update_lambda, as all LM implementations. In both methods the
+ * evaluation at the new transformation provides the gradient and Hessian for the next iteration.
+ */
+template<typename Evaluate>
+RegistrationStats solve_registration(const Evaluate &evaluate, SE3 &T, uint_t numberCorrespondences,
+        const RegistrationOptions &options)
+{
+    RegistrationStats stats;
+    Mat61 gradient, newGradient;
+    Mat6 hessian, newHessian;
+    uint_t inliers = 0, newInliers = 0;
+    double cost = evaluate(T, gradient, hessian, inliers);
+    stats.initialCost = cost;
+    double lambda = options.lambda;
+    while (stats.iterations < options.maxIters)
+    {
+        stats.iterations++;
+        Mat6 damped = hessian;
+        if (options.useLM)
+            damped.diagonal() *= 1.0 + lambda;
+        Mat61 dxi = -damped.ldlt().solve(gradient);
+        SE3 newT(T);
+        newT.update_lhs(dxi);
+        double newCost = evaluate(newT, newGradient, newHessian, newInliers);
+        if (options.useLM && newCost > cost)
+        {
+            // step rejected. A negligible step not decreasing the cost is a minimum
+            lambda = Optimizer::update_lambda(lambda, cost - newCost, 0.0);
+            if (dxi.norm() < options.tol)
+            {
+                stats.converged = true;
+                break;
+            }
+            continue;
+        }
+        if (options.useLM)
+        {
+            // decrease predicted by the damped quadratic model -dxi'*grad - 0.5*dxi'*(H + lambda*D)*dxi
+            double modelDecrease = -dxi.dot(gradient) - 0.5*dxi.dot(damped*dxi);
+            lambda = Optimizer::update_lambda(lambda, cost - newCost, modelDecrease);
+        }
+        T = newT;
+        cost = newCost;
+        gradient = newGradient;
+        hessian = newHessian;
+        inliers = newInliers;
+        if (dxi.norm() < options.tol)
+        {
+            stats.converged = true;
+            break;
+        }
+    }
+    stats.finalCost = cost;
+    stats.inlierRatio = numberCorrespondences > 0 ? double(inliers) / numberCorrespondences : 0.0;
+    return stats;
+}
+
+}}//namespace
+#endif /* REGISTRATION_SOLVER_HPP_ */
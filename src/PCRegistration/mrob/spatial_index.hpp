@@ -0,0 +1,153 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * spatial_index.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef SPATIAL_INDEX_HPP_
+#define SPATIAL_INDEX_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/voxel_key.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+
+namespace mrob{
+
+/**
+ * class SpatialIndex is the interface for nearest neighbour searches on a static
+ * point cloud (N x 3), indexed once and queried many times (e.g., ICP).
+ *
+ * Queries in batch are distributed among threads (OpenMP, if available).
+ * Neighbours are returned sorted by distance, as their index in the original
+ * point cloud and squared distance. When less than k neighbours are found (within
+ * maxDistance) the remaining indexes are -1 and distances infinity.
+ */
+class SpatialIndex{
+
+  public:
+    SpatialIndex();
+    virtual ~SpatialIndex();
+
+    /**
+     * Indexes a N x 3 point cloud. Points are copied, so the input can be released afterwards.
+     */
+    virtual void build(const Eigen::Ref<const MatX> &points) = 0;
+    /**
+     * k nearest neighbours of a single query, at a distance smaller than maxDistance.
+     * indexes and squaredDistances must have (at least) k elements.
+     * Returns the number of neighbours found.
+     */
+    virtual uint_t knn(const Mat31 &query, uint_t k, int *indexes, matData_t *squaredDistances,
+                       matData_t maxDistance = std::numeric_limits<matData_t>::infinity()) const = 0;
+    /**
+     * k nearest neighbours of a batch of queries (M x 3), in parallel.
+     * Output: indexes (M x k) and squared distances (M x k)
+     */
+    void knn_batch(const Eigen::Ref<const MatX> &queries, uint_t k, MatXi &indexes, MatX &squaredDistances,
+                   matData_t maxDistance = std::numeric_limits<matData_t>::infinity()) const;
+    /**
+     * Nearest neighbour of each query (M x 3), in parallel. Output: indexes (-1 if not found)
+     * and squared distances, M x 1
+     */
+    void nearest_batch(const Eigen::Ref<const MatX> &queries, std::vector<int> &indexes, std::vector<matData_t> &squaredDistances,
+                       matData_t maxDistance = std::numeric_limits<matData_t>::infinity()) const;
+
+    uint_t get_number_points() const {return indexes_.size();};
+
+  protected:
+    /**
+     * Sorted insertion of a candidate on the list of k best neighbours, of current size n.
+     * Returns the new size of the list
+     */
+    static uint_t insert_neighbour(int index, matData_t squaredDistance, uint_t k, uint_t n,
+                                   int *indexes, matData_t *squaredDistances);
+
+    // Points are stored contiguously (x,y,z) in the order of the index, such that
+    // neighbouring points are close in memory, and indexes_ keeps their position in the original point cloud
+    std::vector<matData_t> points_;
+    std::vector<uint_t> indexes_;
+};
+
+
+/**
+ * class KDTree is a static (balanced) KD-tree, built by median splits along the
+ * dimension of largest extent. Nodes are stored in a flat array and points are
+ * reordered such that each leaf contains a contiguous set of at most leafSize points.
+ * The leaf size must be positive, otherwise the constructors throw std::invalid_argument.
+ */
+class KDTree: public SpatialIndex{
+
+  public:
+    KDTree(uint_t leafSize = 16);
+    KDTree(const Eigen::Ref<const MatX> &points, uint_t leafSize = 16);
+    ~KDTree();
+
+    void build(const Eigen::Ref<const MatX> &points) override;
+    uint_t knn(const Mat31 &query, uint_t k, int *indexes, matData_t *squaredDistances,
+               matData_t maxDistance = std::numeric_limits<matData_t>::infinity()) const override;
+
+  protected:
+    struct Node
+    {
+        uint_t start, end;// range of points
+        int axis;// -1 for leaves
+        matData_t split;
+        uint_t left, right;// children
+    };
+    uint_t build_node(uint_t start, uint_t end);
+
+    uint_t leafSize_;
+    std::vector<Node> nodes_;
+};
+
+
+/**
+ * class VoxelHashGrid indexes points in a hash table of voxels of size voxelSize.
+ * A query searches the 27 voxels around it, so the result is exact for neighbours
+ * at a distance smaller than voxelSize, and the maximum distance is bounded by voxelSize.
+ * It is faster than the KD-tree to build and query when the search radius is known and
+ * small (e.g., ICP once initialized).
+ */
+class VoxelHashGrid: public SpatialIndex{
+
+  public:
+    VoxelHashGrid(matData_t voxelSize = 1.0);
+    VoxelHashGrid(const Eigen::Ref<const MatX> &points, matData_t voxelSize = 1.0);
+    ~VoxelHashGrid();
+
+    void build(const Eigen::Ref<const MatX> &points) override;
+    uint_t knn(const Mat31 &query, uint_t k, int *indexes, matData_t *squaredDistances,
+               matData_t maxDistance = std::numeric_limits<matData_t>::infinity()) const override;
+    uint_t get_number_voxels() const {return voxelIndex_.size();};
+    /**
+     * Returns the centroid of the points of each voxel (M x 3), i.e., a voxel downsampling.
+     */
+    MatX get_voxel_centroids() const;
+
+  protected:
+    matData_t voxelSize_;
+    // points of voxel v are in [voxelStart_[v], voxelStart_[v+1])
+    std::unordered_map<uint64_t, uint_t> voxelIndex_;
+    std::vector<uint_t> voxelStart_;
+};
+
+}// namespace
+#endif /* SPATIAL_INDEX_HPP_ */
@@ -0,0 +1,77 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * voxel_key.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef VOXEL_KEY_HPP_
+#define VOXEL_KEY_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include <cstdint>
+#include <cmath>
+
+namespace mrob{
+
+/**
+ * Keys of voxels for hash tables.
+ * The integer coordinates of a voxel are packed in 21 bits each, centered at 2^20,
+ * so that negative coordinates are valid, up to 2^20 voxels from the origin.
+ */
+constexpr int64_t voxelKeyOffset = 1 << 20;
+constexpr uint64_t voxelKeyMask = (1 << 21) - 1;
+
+/**
+ * Integer coordinates of the voxel containing p
+ */
+inline void voxel_coordinates(const Mat31 &p, matData_t voxelSize, int64_t &x, int64_t &y, int64_t &z)
+{
+    x = (int64_t)std::floor(p(0) / voxelSize);
+    y = (int64_t)std::floor(p(1) / voxelSize);
+    z = (int64_t)std::floor(p(2) / voxelSize);
+}
+
+inline uint64_t voxel_key(int64_t x, int64_t y, int64_t z)
+{
+    return  ((uint64_t)(x + voxelKeyOffset) & voxelKeyMask) |
+           (((uint64_t)(y + voxelKeyOffset) & voxelKeyMask) << 21) |
+           (((uint64_t)(z + voxelKeyOffset) & voxelKeyMask) << 42);
+}
+
+/**
+ * Key of the voxel containing p
+ */
+inline uint64_t voxel_key(const Mat31 &p, matData_t voxelSize)
+{
+    int64_t x, y, z;
+    voxel_coordinates(p, voxelSize, x, y, z);
+    return voxel_key(x, y, z);
+}
+
+/**
+ * Integer coordinates of a voxel from its key, the inverse of voxel_key(x, y, z)
+ */
+inline void voxel_key_coordinates(uint64_t key, int64_t &x, int64_t &y, int64_t &z)
+{
+    x = (int64_t)(key & voxelKeyMask) - voxelKeyOffset;
+    y = (int64_t)((key >> 21) & voxelKeyMask) - voxelKeyOffset;
+    z = (int64_t)((key >> 42) & voxelKeyMask) - voxelKeyOffset;
+}
+
+}//namespace
+
+#endif /* VOXEL_KEY_HPP_ */
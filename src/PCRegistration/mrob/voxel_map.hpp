@@ -0,0 +1,130 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * voxel_map.hpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef VOXEL_MAP_HPP_
+#define VOXEL_MAP_HPP_
+
+#include "mrob/matrix_base.hpp"
+#include "mrob/voxel_key.hpp"
+#include "mrob/SE3.hpp"
+#include "mrob/pc_registration.hpp"
+
+#include <vector>
+#include <unordered_map>
+
+
+namespace mrob{
+
+/**
+ * class VoxelMap is a persistent local map for scan to map registration (e.g., lidar odometry).
+ * Points are distributed in a hash table of voxels of size voxelSize, each voxel keeping
+ * the incremental mean and covariance of its points (Welford updates), so inserting a scan
+ * costs amortized O(1) per point and the map is never rebuilt.
+ *
+ * Voxels with at least minPointsVoxel points are Gaussians with the plane regularized
+ * covariance of GICP, R diag(e,1,1) R', updated only on the voxels modified by each scan.
+ * The map is bounded to a sliding radius around the sensor: a pass over all voxels removes
+ * the farther ones. This pass costs O(number of voxels), so it only runs when the sensor has
+ * moved a tenth of the radius (and at least a voxel) since the last pass, and its cost is
+ * amortized over the scans along that distance. Between passes, voxels out of the radius
+ * (by up to a tenth of it) remain in the map.
+ *
+ * Scans are registered against the voxel Gaussians: each transformed point is associated
+ * to the closest mean on its 27 neighbouring voxels, by O(1) lookups, and the pose is
+ * solved by gicp() (point to distribution, the points have zero covariance).
+ *
+ * In MEANS mode only the mean of each voxel is kept (a voxel downsampled map, e.g. for LOAM),
+ * queried by knn() on the voxel means.
+ */
+class VoxelMap{
+
+  public:
+    enum mapMode{GAUSSIANS = 0, MEANS};
+    VoxelMap(double voxelSize = 1.0, double radius = 50.0, uint_t minPointsVoxel = 5, double e = 1e-3,
+             VoxelMap::mapMode mode = GAUSSIANS);
+    ~VoxelMap();
+
+    /**
+     * Inserts a scan (N x 3) observed at pose T, i.e., points in the sensor frame,
+     * and removes the voxels out of the radius from the sensor.
+     */
+    void insert(const Eigen::Ref<const MatX> &points, const SE3 &T);
+    /**
+     * Registers a scan (N x 3, sensor frame) against the map, T is the initial guess and the solution.
+     * Iterates association and gicp() until the update is smaller than tol or maxIters.
+     * Returns the statistics, where iterations are the ICP iterations and the rest correspond to
+     * the last registration. Iterations are 0 if there were not enough associations (6).
+     */
+    PCRegistration::RegistrationStats register_scan(const Eigen::Ref<const MatX> &points, SE3 &T,
+            uint_t maxIters = 30, double tol = 1e-4,
+            const PCRegistration::RegistrationOptions &options = PCRegistration::RegistrationOptions()) const;
+    /**
+     * k nearest voxel means of a query, of voxels with at least minPointsVoxel points, at a distance
+     * smaller than maxDistance. Neighbouring voxels are looked up by rings of increasing distance,
+     * until the k-th neighbour is closer than the next ring.
+     * maxDistance can be infinite, rings are bounded by the bounding box of the voxels.
+     * means and squaredDistances must have (at least) k elements, sorted by distance.
+     * Returns the number of neighbours found.
+     */
+    uint_t knn(const Mat31 &query, uint_t k, Mat31 *means, matData_t *squaredDistances, matData_t maxDistance) const;
+    void clear();
+
+    uint_t get_number_voxels() const {return voxels_.size();};
+    /**
+     * Returns the mean of the voxels with enough points, M x 3
+     */
+    MatX get_means() const;
+    /**
+     * Returns the regularized covariances of the voxels with enough points, stacked vertically 3M x 3
+     */
+    MatX get_covariances() const;
+
+  protected:
+    struct Voxel
+    {
+        uint_t N = 0;
+        Mat31 mean = Mat31::Zero();
+        Mat3 M2 = Mat3::Zero();// sum of squared differences to the mean, covariance is M2 / N
+        Mat3 covariance = Mat3::Identity();// regularized
+        bool updated = false;
+    };
+    /**
+     * Voxel with the closest mean to p, within a distance of voxelSize. Returns nullptr if none
+     */
+    const Voxel* find_closest_voxel(const Mat31 &p) const;
+    /**
+     * Bounding box of the voxels, in voxel coordinates. It grows with new voxels and it is
+     * recomputed on each removal pass
+     */
+    void reset_box();
+    void update_box(uint64_t key);
+
+    double voxelSize_, radius_, e_;
+    uint_t minPointsVoxel_;
+    VoxelMap::mapMode mode_;
+    std::unordered_map<uint64_t, Voxel> voxels_;
+    std::vector<Voxel*> updatedVoxels_;
+    Mat31 lastRemoval_;
+    bool removed_;
+    int64_t boxMin_[3], boxMax_[3];
+};
+
+}// namespace
+#endif /* VOXEL_MAP_HPP_ */
@@ -0,0 +1,125 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * pc_preprocessing.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <Eigen/Eigenvalues>
+
+#include <vector>
+#include <cassert>
+#include "mrob/pc_registration.hpp"
+
+
+using namespace mrob;
+
+MatX PCRegistration::voxel_downsample(const Eigen::Ref<const MatX> X, double voxelSize)
+{
+    assert(X.cols() == 3  && "PCRegistration::voxel_downsample: Incorrect sizing, we expect Nx3");
+    VoxelHashGrid grid(X, voxelSize);
+    return grid.get_voxel_centroids();
+}
+
+namespace {
+
+/**
+ * Normal of the plane fitted to the n points of X given by indexes: eigenvector of
+ * the minimum eigenvalue of their covariance
+ */
+Mat31 local_normal(const Eigen::Ref<const MatX> &X, const int *indexes, uint_t n)
+{
+    Mat31 mean = Mat31::Zero();
+    for (uint_t j = 0; j < n; ++j)
+        mean += X.row(indexes[j]).transpose();
+    mean /= (matData_t)n;
+    Mat3 C = Mat3::Zero();
+    for (uint_t j = 0; j < n; ++j)
+    {
+        Mat31 q = X.row(indexes[j]).transpose() - mean;
+        C.noalias() += q * q.transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Mat3> es(C);
+    return es.eigenvectors().col(0);
+}
+
+}
+
+MatX PCRegistration::estimate_covariances(const Eigen::Ref<const MatX> X, const SpatialIndex &indexX, uint_t k,
+        double e, double maxDistance)
+{
+    assert(X.cols() == 3  && "PCRegistration::estimate_covariances: Incorrect sizing, we expect Nx3");
+    assert(indexX.get_number_points() == X.rows() && "PCRegistration::estimate_covariances: the spatial index does not correspond to X");
+    const long N = X.rows();
+    MatX cov(3*N, 3);
+    #pragma omp parallel
+    {
+        // neighbours buffers per thread
+        std::vector<int> indexes(k);
+        std::vector<matData_t> squaredDistances(k);
+        #pragma omp for schedule(dynamic, 256)
+        for (long i = 0; i < N; ++i)
+        {
+            uint_t n = indexX.knn(X.row(i).transpose(), k, indexes.data(), squaredDistances.data(), maxDistance);
+            if (n < 3)
+            {
+                cov.block<3,3>(3*i, 0) = Mat3::Identity();
+                continue;
+            }
+            // plane regularization, R diag(e,1,1) R' = I - (1-e) n n', n the normal
+            Mat31 normal = local_normal(X, indexes.data(), n);
+            cov.block<3,3>(3*i, 0) = Mat3::Identity() - (1.0 - e) * normal * normal.transpose();
+        }
+    }
+    return cov;
+}
+
+MatX PCRegistration::estimate_covariances(const Eigen::Ref<const MatX> X, uint_t k, double e, double maxDistance)
+{
+    KDTree indexX(X);
+    return PCRegistration::estimate_covariances(X, indexX, k, e, maxDistance);
+}
+
+MatX PCRegistration::estimate_normals(const Eigen::Ref<const MatX> X, const SpatialIndex &indexX, uint_t k,
+        double maxDistance)
+{
+    assert(X.cols() == 3  && "PCRegistration::estimate_normals: Incorrect sizing, we expect Nx3");
+    assert(indexX.get_number_points() == X.rows() && "PCRegistration::estimate_normals: the spatial index does not correspond to X");
+    const long N = X.rows();
+    MatX normals(N, 3);
+    #pragma omp parallel
+    {
+        // neighbours buffers per thread
+        std::vector<int> indexes(k);
+        std::vector<matData_t> squaredDistances(k);
+        #pragma omp for schedule(dynamic, 256)
+        for (long i = 0; i < N; ++i)
+        {
+            uint_t n = indexX.knn(X.row(i).transpose(), k, indexes.data(), squaredDistances.data(), maxDistance);
+            if (n < 3)
+                normals.row(i).setZero();
+            else
+                normals.row(i) = local_normal(X, indexes.data(), n).transpose();
+        }
+    }
+    return normals;
+}
+
+MatX PCRegistration::estimate_normals(const Eigen::Ref<const MatX> X, uint_t k, double maxDistance)
+{
+    KDTree indexX(X);
+    return PCRegistration::estimate_normals(X, indexX, k, maxDistance);
+}
@@ -24,7 +24,10 @@
 
 
 #include "mrob/plane.hpp"
+#include "mrob/plane_eigen_solver.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 //#include <Eigen/SVD>
 //#include <Eigen/LU>
 #include <Eigen/Eigenvalues>
@@ -33,19 +36,15 @@
 
 using namespace mrob;
 
-Plane::Plane(uint_t timeLength):
-        timeLength_(timeLength), isPlaneEstimated_(false), numberPoints_(0)
+Plane::Plane(uint_t timeLength, pointsMode mode):
+        pointsMode_(mode), isPlaneEstimated_(false), numberPoints_(0),
+        priorQ_(Mat4::Zero())
 {
-    allPlanePoints_.reserve(timeLength_);
-    // there should be an individual reservation of points
-    for (uint_t i = 0; i < timeLength_; ++i)
-    {
-        allPlanePoints_.push_back(std::vector<Mat31>());
-        // estimated number of points per observation TODO
-        allPlanePoints_[i].reserve(512);
-    }
-    matrixS_.reserve(timeLength_);
-    matrixQ_.reserve(timeLength_);
+    timeIndex_.reserve(timeLength);
+    allPlanePoints_.reserve(timeLength);
+    numberPointsTime_.reserve(timeLength);
+    matrixS_.reserve(timeLength);
+    matrixQ_.reserve(timeLength);
 
     //Initialize matrices for calculating Hessian
     gradQ_.reserve(6);// one matrix for each dimension
@@ -91,52 +90,157 @@ Plane::~Plane()
 
 void Plane::reserve(uint_t d, uint_t t)
 {
-    if (t < timeLength_)
-        allPlanePoints_[t].reserve(d);
+    if (pointsMode_ == STORE_POINTS)
+        allPlanePoints_[add_observation(t)].reserve(d);
+}
+
+uint_t Plane::find_observation(uint_t t) const
+{
+    auto it = std::lower_bound(timeIndex_.begin(), timeIndex_.end(), t);
+    if (it == timeIndex_.end() || *it != t)
+        return timeIndex_.size();
+    return it - timeIndex_.begin();
+}
+
+uint_t Plane::add_observation(uint_t t)
+{
+    // Q matrices, once calculated, stay aligned with the observations. The new observation
+    // has S = 0 and hence Q = 0, so the accumulated Q remains valid for the incremental updates.
+    const bool alignQ = !matrixQ_.empty();
+    // usual case, observations arrive in order
+    if (timeIndex_.empty() || timeIndex_.back() < t)
+    {
+        timeIndex_.push_back(t);
+        allPlanePoints_.push_back(std::vector<Mat31>());
+        numberPointsTime_.push_back(0);
+        matrixS_.push_back(Mat4::Zero());
+        if (alignQ)
+            matrixQ_.push_back(Mat4::Zero());
+        return timeIndex_.size() - 1;
+    }
+    auto it = std::lower_bound(timeIndex_.begin(), timeIndex_.end(), t);
+    uint_t i = it - timeIndex_.begin();
+    if (*it != t)
+    {
+        timeIndex_.insert(it, t);
+        allPlanePoints_.insert(allPlanePoints_.begin() + i, std::vector<Mat31>());
+        numberPointsTime_.insert(numberPointsTime_.begin() + i, 0);
+        matrixS_.insert(matrixS_.begin() + i, Mat4::Zero());
+        if (alignQ)
+            matrixQ_.insert(matrixQ_.begin() + i, Mat4::Zero());
+    }
+    return i;
 }
 
 void Plane::push_back_point(Mat31 &point, uint_t t)
 {
-    // XXX for now it only works on consecutive observations TODO if t> time length increase
-    if (t < timeLength_)
+    uint_t i = add_observation(t);
+    // S is always accumulated, points are only kept if required
+    Mat41 pHomog;
+    pHomog << point, 1.0;
+    matrixS_[i].noalias() += pHomog * pHomog.transpose();
+    if (pointsMode_ == STORE_POINTS)
+        allPlanePoints_[i].push_back(point);
+    ++numberPointsTime_[i];
+    ++numberPoints_;
+}
+
+void Plane::push_back_points(const Eigen::Ref<const MatX> &points, uint_t t)
+{
+    assert(points.cols() == 3 && "Plane::push_back_points: points must be a N x 3 matrix");
+    uint_t i = add_observation(t);
+    uint_t N = points.rows();
+    // S = sum [p;1]*[p;1]' = [P'P  P'1
+    //                         1'P   N ]
+    Mat3 PtP;
+    PtP.noalias() = points.transpose() * points;
+    Mat31 sumP = points.colwise().sum().transpose();
+    Mat4 &S = matrixS_[i];
+    S.topLeftCorner<3,3>() += PtP;
+    S.topRightCorner<3,1>() += sumP;
+    S.bottomLeftCorner<1,3>() += sumP.transpose();
+    S(3,3) += N;
+    if (pointsMode_ == STORE_POINTS)
     {
-        //homogeneousPoint << point, 1.0;
-        //allPlanePoints_[t].push_back(homogeneousPoint);
-        allPlanePoints_[t].push_back(point);
-        ++numberPoints_;
+        allPlanePoints_[i].reserve(allPlanePoints_[i].size() + N);
+        for (uint_t j = 0; j < N; ++j)
+            allPlanePoints_[i].push_back(points.row(j).transpose());
     }
+    numberPointsTime_[i] += N;
+    numberPoints_ += N;
 }
 
+void Plane::push_back_matrix_S(const Mat4 &S, uint_t t)
+{
+    assert(pointsMode_ == SUFFICIENT_STATISTICS && "Plane::push_back_matrix_S: points can not be stored from S");
+    uint_t i = add_observation(t);
+    matrixS_[i] += S;
+    // the number of points is the last element of S
+    uint_t N = std::round(S(3,3));
+    numberPointsTime_[i] += N;
+    numberPoints_ += N;
+}
 std::vector<Mat31>& Plane::get_points(uint_t t)
 {
-    if (t >= timeLength_)
-        return allPlanePoints_.back();
-    return allPlanePoints_[t];
+    uint_t i = find_observation(t);
+    if (i == timeIndex_.size())
+        return emptyPoints_;
+    return allPlanePoints_[i];
+}
+
+uint_t Plane::get_number_points(uint_t t) const
+{
+    uint_t i = find_observation(t);
+    if (i == timeIndex_.size())
+        return 0;
+    return numberPointsTime_[i];
 }
 
 void Plane::clear_points()
 {
+    timeIndex_.clear();
     allPlanePoints_.clear();
+    numberPointsTime_.clear();
+    matrixS_.clear();
+    matrixQ_.clear();
+    numberPoints_ = 0;
+    priorQ_.setZero();
+}
+
+void Plane::marginalize_observations(uint_t t)
+{
+    uint_t n = std::lower_bound(timeIndex_.begin(), timeIndex_.end(), t) - timeIndex_.begin();
+    if (n == 0)
+        return;
+    for (uint_t i = 0; i < n; ++i)
+    {
+        const Mat4 &T = trajectory_->at(timeIndex_[i]).T();
+        priorQ_.noalias() += T * matrixS_[i] * T.transpose();
+        numberPoints_ -= numberPointsTime_[i];
+    }
+    timeIndex_.erase(timeIndex_.begin(), timeIndex_.begin() + n);
+    allPlanePoints_.erase(allPlanePoints_.begin(), allPlanePoints_.begin() + n);
+    numberPointsTime_.erase(numberPointsTime_.begin(), numberPointsTime_.begin() + n);
+    matrixS_.erase(matrixS_.begin(), matrixS_.begin() + n);
+    if (matrixQ_.size() >= n)
+        matrixQ_.erase(matrixQ_.begin(), matrixQ_.begin() + n);
 }
 
 
 double Plane::estimate_plane()
 {
-    calculate_all_matrices_S();
     calculate_all_matrices_Q();
-    accumulatedQ_ = Mat4::Zero();
+    accumulatedQ_ = priorQ_;
     for (Mat4 &Qi: matrixQ_)
     {
         accumulatedQ_ += Qi;
         //std::cout << Qi << std::endl;
     }
 
-    // Eigen::SelfAdjointEigenSolver return sorted elements from min(0) to max (3)
-    Eigen::SelfAdjointEigenSolver<Mat4> eigs(accumulatedQ_);
-    planeEstimation_ = eigs.eigenvectors().col(0);
-    //std::cout << eigs.eigenvectors() << "\n and solution \n" << planeEstimation_ <<  std::endl;
-    //std::cout << "plane estimation error: " << eigs.eigenvalues() <<  std::endl;
-    lambda_ = eigs.eigenvalues()(0);
+    // minimum eigenpair, warm started from the previous estimation (if any)
+    if (!isPlaneEstimated_)
+        planeEstimation_.setZero();
+    lambda_ = min_eigenpair_4x4(accumulatedQ_, planeEstimation_);
 
     // new estimation is done, set flags TODO why?
     isPlaneEstimated_ = true;
@@ -147,60 +251,65 @@ double Plane::estimate_plane()
 // Is this really used anywhere?
 double Plane::estimate_plane_incrementally(uint_t t)
 {
-    accumulatedQ_ -= matrixQ_[t];
-    accumulatedQ_ +=  trajectory_->at(t).T() * matrixS_[t] * trajectory_->at(t).T().transpose();
+    uint_t i = find_observation(t);
+    assert(matrixQ_.size() == timeIndex_.size() && "Plane::estimate_plane_incrementally: matrices Q are not calculated");
+    if (i == timeIndex_.size())
+        return lambda_;
+    accumulatedQ_ -= matrixQ_[i];
+    accumulatedQ_ +=  trajectory_->at(t).T() * matrixS_[i] * trajectory_->at(t).T().transpose();
     //std::cout << "new acc Q " << accumulatedQ_ << std::endl;
-    Eigen::SelfAdjointEigenSolver<Mat4> eigs(accumulatedQ_);
-    planeEstimation_ = eigs.eigenvectors().col(0);
-    return eigs.eigenvalues()(0);
+    return min_eigenpair_4x4(accumulatedQ_, planeEstimation_);
 }
 
 double Plane::get_error_incremental(uint_t t) const
 {
+    uint_t i = find_observation(t);
+    assert(matrixQ_.size() == timeIndex_.size() && "Plane::get_error_incremental: matrices Q are not calculated");
+    if (i == timeIndex_.size())
+        return lambda_;
     Mat4 Q = accumulatedQ_;
     //std::cout << "accumulated Q from prev version " << accumulatedQ_ << std::endl;
-    Q -= matrixQ_[t];
+    Q -= matrixQ_[i];
     //std::cout << "substract: Q " << Q << std::endl;
-    Q +=  trajectory_->at(t).T() * matrixS_[t] * trajectory_->at(t).T().transpose();
+    Q +=  trajectory_->at(t).T() * matrixS_[i] * trajectory_->at(t).T().transpose();
     //std::cout << "new acc Q " << Q << std::endl;
-    Eigen::SelfAdjointEigenSolver<Mat4> eigs(Q);
-    return eigs.eigenvalues()(0);
+    Mat41 v = planeEstimation_;
+    return min_eigenpair_4x4(Q, v);
 }
 
 void Plane::calculate_all_matrices_S(bool reset)
 {
-    if (reset)
-        matrixS_.clear();
-    if (matrixS_.empty())
+    // S is already accumulated, it is only recalculated if points are available
+    if (!reset || pointsMode_ == SUFFICIENT_STATISTICS)
+        return;
+    for (uint_t i = 0; i < timeIndex_.size(); ++i)
     {
-        for (uint_t t = 0; t < timeLength_; ++t)
+        Mat4 S = Mat4::Zero();
+        for ( Mat31 &p : allPlanePoints_[i])
         {
-            Mat4 S = Mat4::Zero();
-            for ( Mat31 &p : allPlanePoints_[t])
-            {
-                Mat41 pHomog;
-                pHomog << p , 1.0;
-                S += pHomog * pHomog.transpose();
-            }
-            matrixS_.push_back(S);
+            Mat41 pHomog;
+            pHomog << p , 1.0;
+            S += pHomog * pHomog.transpose();
         }
+        matrixS_[i] = S;
     }
 }
 
 Mat31 Plane::get_mean_point(uint_t t)
 {
-    assert(!matrixS_.empty() && "Plane::get_mean_point: S matrix empty");
-    return matrixS_[t].topRightCorner<3,1>()/matrixS_[t](3,3);
+    uint_t i = find_observation(t);
+    assert(i < timeIndex_.size() && "Plane::get_mean_point: plane not observed at time t");
+    return matrixS_[i].topRightCorner<3,1>()/matrixS_[i](3,3);
 }
 
 void Plane::calculate_all_matrices_Q()
 {
-    matrixQ_.clear();
-    for (uint_t t = 0; t < timeLength_; ++t)
+    matrixQ_.resize(timeIndex_.size());
+    for (uint_t i = 0; i < timeIndex_.size(); ++i)
     {
-        Mat4 Q;
-        Q.noalias() = trajectory_->at(t).T() * matrixS_[t] * trajectory_->at(t).T().transpose();
-        matrixQ_.push_back(Q);
+        const uint_t t = timeIndex_[i];
+        assert(t < trajectory_->size() && "Plane::calculate_all_matrices_Q: observation time out of the trajectory");
+        matrixQ_[i].noalias() = trajectory_->at(t).T() * matrixS_[i] * trajectory_->at(t).T().transpose();
     }
 }
 
@@ -208,9 +317,12 @@ Mat61 Plane::calculate_gradient(uint_t t)
 {
     Mat61 jacobian;
     gradQ_.clear();//used for Hessian, we bookeep all calculated gradients
+    uint_t i = find_observation(t);
+    if (i == timeIndex_.size())
+        return Mat61::Zero();
 
     // calculate dQ/dxi for the submatrix S
-    Mat4 dQ, &Q = matrixQ_[t];
+    Mat4 dQ, &Q = matrixQ_[i];
 
     // dQ / d xi(0) = [0
     //               -q3
@@ -282,7 +394,10 @@ Mat61 Plane::calculate_gradient(uint_t t)
 Mat6 Plane::calculate_hessian(uint_t t)
 {
     Mat6 hessian = Mat6::Zero();
-    Mat4 ddQ, &Q = matrixQ_[t];
+    uint_t k = find_observation(t);
+    if (k == timeIndex_.size())
+        return hessian;
+    Mat4 ddQ, &Q = matrixQ_[k];
 
     // H = pi' * dd Q * pi, where dd Q = Bij + Bij' and
     // Bij = (Gi*Gj + Gj*Gi)Q*0.5 + Gi * dQ (previous gradient)
@@ -303,20 +418,49 @@ Mat6 Plane::calculate_hessian(uint_t t)
     return hessian;
 }
 
+void Plane::add_gradient_hessian_window(uint_t tFirst, uint_t numberPoses,
+                                        Eigen::Ref<MatX1> gradient, Eigen::Ref<MatX> hessian) const
+{
+    // 1) observations inside the window, the rest are constant
+    std::vector<const Mat4*> matricesQ;
+    std::vector<uint_t> positions;
+    for (uint_t i = 0; i < timeIndex_.size(); ++i)
+    {
+        if (timeIndex_[i] < tFirst || timeIndex_[i] >= tFirst + numberPoses)
+            continue;
+        matricesQ.push_back(&matrixQ_[i]);
+        positions.push_back(timeIndex_[i] - tFirst);
+    }
+
+    // 2) gradient and Hessian with the plane eliminated (see plane_schur_gradient_hessian),
+    //    added to the blocks of the poses in the window
+    MatX1 planeGradient;
+    MatX planeHessian;
+    Mat41 plane;
+    plane_schur_gradient_hessian(accumulatedQ_, matricesQ, planeGradient, planeHessian, plane);
+    for (uint_t i = 0; i < positions.size(); ++i)
+    {
+        gradient.segment<6>(6*positions[i]) += planeGradient.segment<6>(6*i);
+        for (uint_t j = 0; j < positions.size(); ++j)
+            hessian.block<6,6>(6*positions[i], 6*positions[j]) += planeHessian.block<6,6>(6*i, 6*j);
+    }
+}
+
 void Plane::print() const
 {
-    for (uint_t t = 0; t <  timeLength_; ++t)
+    for (uint_t i = 0; i < timeIndex_.size(); ++i)
     {
-        std::cout << "Plane time = " << t << std::endl;
-        for (Mat31 p : allPlanePoints_[t])
+        std::cout << "Plane time = " << timeIndex_[i] << std::endl;
+        for (Mat31 p : allPlanePoints_[i])
             std::cout << p(0) << ", " << p(1) << ", " << p(2) << std::endl;
     }
 }
 
 void Plane::reset()
 {
-    matrixS_.clear();
+    // S matrices are kept, they are the data of the plane
     matrixQ_.clear();
     accumulatedQ_ = Mat4::Zero();
     planeEstimation_ = Mat41::Zero();
+    isPlaneEstimated_ = false;
 }
@@ -0,0 +1,44 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_blocks.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/plane_blocks.hpp"
+
+using namespace mrob;
+
+
+double PlaneBlocks::estimate_planes(const std::vector<std::shared_ptr<Plane>> &planes)
+{
+    const long numberPlanes = planes.size();
+    const long numberBlocks = (numberPlanes + blockSize_ - 1) / blockSize_;
+    blockErrors_.resize(numberBlocks);
+    #pragma omp parallel for schedule(dynamic)
+    for (long b = 0; b < numberBlocks; ++b)
+    {
+        double error = 0.0;
+        for (long i = b*blockSize_; i < std::min(numberPlanes, (b+1)*blockSize_); ++i)
+            error += planes[i]->estimate_plane();
+        blockErrors_[b] = error;
+    }
+    double  totalError = 0.0;
+    for (double error : blockErrors_)
+        totalError += error;
+    return totalError;
+}
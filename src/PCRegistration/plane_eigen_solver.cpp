@@ -0,0 +1,114 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_eigen_solver.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include "mrob/plane_eigen_solver.hpp"
+#include "mrob/SO3.hpp"
+#include <Eigen/Cholesky>
+#include <Eigen/Eigenvalues>
+#include <cmath>
+#include <cassert>
+
+using namespace mrob;
+
+double mrob::min_eigenpair_4x4(const Mat4 &Q, Mat41 &v, uint_t maxIters)
+{
+    // Q is PSD, so its trace is the scale of the problem
+    double scale = Q.trace();
+    double norm = v.norm();
+    if (scale > 0.0 && norm > 0.0 && std::isfinite(norm))
+    {
+        // 1) small shift, so the factorization exists for singular Q (exact planes)
+        Mat4 Qs = Q;
+        Qs.diagonal().array() += 1e-12 * scale;
+        Eigen::LLT<Mat4> llt(Qs);
+        if (llt.info() == Eigen::Success)
+        {
+            // 2) inverse iteration, until the eigen residual is negligible
+            v /= norm;
+            for (uint_t i = 0; i < maxIters; ++i)
+            {
+                llt.solveInPlace(v);
+                v.normalize();
+                Mat41 Qv = Q * v;
+                double lambda = v.dot(Qv);
+                if ((Qv - lambda * v).norm() <= 1e-12 * scale)
+                    return lambda;
+            }
+        }
+    }
+    // 3) fallback, complete eigen decomposition. Eigenvalues are sorted from min(0) to max (3)
+    Eigen::SelfAdjointEigenSolver<Mat4> eigs(Q);
+    v = eigs.eigenvectors().col(0);
+    return eigs.eigenvalues()(0);
+}
+
+void mrob::min_eigenpair_4x4_batch(const std::vector<Mat4> &Q, std::vector<Mat41> &v, std::vector<double> &lambda, uint_t maxIters)
+{
+    assert(Q.size() == v.size() && "min_eigenpair_4x4_batch: incorrect size of warm start vectors");
+    const long N = Q.size();
+    lambda.resize(N);
+    #pragma omp parallel for
+    for (long i = 0; i < N; ++i)
+        lambda[i] = min_eigenpair_4x4(Q[i], v[i], maxIters);
+}
+
+double mrob::plane_schur_gradient_hessian(const Mat4 &Q, const std::vector<const Mat4*> &matricesQ,
+                                          MatX1 &gradient, MatX &hessian, Mat41 &plane)
+{
+    // 1) all eigenpairs are required for the Schur complement of the plane
+    Eigen::SelfAdjointEigenSolver<Mat4> es(Q);
+    const Mat4 &V = es.eigenvectors();
+    plane = V.col(0);
+
+    // 2) W = [G_1'pi, ..., G_6'pi], derivatives of the plane wrt the pose (left update)
+    Eigen::Matrix<matData_t,4,6> W = Eigen::Matrix<matData_t,4,6>::Zero();
+    Mat31 n = plane.head<3>();
+    W.topLeftCorner<3,3>() = hat3(n);
+    W.bottomRightCorner<1,3>() = n.transpose();
+
+    // 3) gradient and Hessian blocks per pose:
+    //    C_a = W'* Q_a * V, where the first column is half the gradient and
+    //    the rest are the cross terms pose-plane on the direction of each eigenvector v_k
+    const uint_t M = matricesQ.size();
+    gradient.resize(6*M);
+    hessian.setZero(6*M, 6*M);
+    MatX C(6*M, 3);
+    Eigen::Matrix<matData_t,6,4> Ca;
+    for (uint_t a = 0; a < M; ++a)
+    {
+        const Mat4 &Qa = *matricesQ[a];
+        Ca.noalias() = W.transpose() * Qa * V;
+        gradient.segment<6>(6*a) = 2.0 * Ca.col(0);
+        hessian.block<6,6>(6*a, 6*a).noalias() = 2.0 * W.transpose() * Qa * W;
+        C.block<6,3>(6*a, 0) = Ca.rightCols<3>();
+    }
+
+    // 4) Schur complement of the plane: H -= 2 C * diag(1/lambda_k) * C'
+    const matData_t eps = 1e-12 * Q.trace();
+    Mat31 invLambda;
+    for (uint_t k = 0; k < 3; ++k)
+    {
+        matData_t lambda = es.eigenvalues()(k+1);
+        invLambda(k) = lambda > eps ? 2.0 / lambda : 0.0;
+    }
+    MatX CL = C * invLambda.asDiagonal();
+    hessian.noalias() -= CL * C.transpose();
+    return es.eigenvalues()(0);
+}
@@ -0,0 +1,167 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_odometry.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/plane_odometry.hpp"
+#include <algorithm>
+#include <cassert>
+
+using namespace mrob;
+
+
+PlaneOdometry::PlaneOdometry(uint_t windowSize, Plane::pointsMode mode):
+        windowSize_(windowSize), pointsMode_(mode), firstWindowPose_(0),
+        trajectory_(new std::vector<SE3>()),
+        method_(LEVENBERG_MARQUARDT_ELLIP), initialLambda_(1e-3), iterations_(0)
+{
+    assert(windowSize_ >= 2 && "PlaneOdometry: window requires at least 2 poses");
+}
+
+PlaneOdometry::~PlaneOdometry()
+{
+}
+
+SE3 PlaneOdometry::add_scan(const Eigen::Ref<const MatX> &points, const std::vector<uint_t> &planeIds)
+{
+    assert(static_cast<uint_t>(points.rows()) == planeIds.size() && "PlaneOdometry::add_scan: incorrect number of ids");
+
+    // 1) new pose, by a constant velocity model T_t = T_t-1 * Exp(Ln(T_t-2^-1 * T_t-1)).
+    //    The prediction is regenerated, otherwise round-off errors are amplified at each new scan
+    uint_t t = trajectory_->size();
+    if (t == 0)
+        trajectory_->push_back(SE3());
+    else if (t == 1)
+        trajectory_->push_back(trajectory_->back());
+    else
+    {
+        Mat61 velocity = (trajectory_->at(t-2).inv() * trajectory_->at(t-1)).ln_vee();
+        SE3 prediction = trajectory_->at(t-1);
+        prediction.update_rhs(velocity);
+        prediction.regenerate();
+        trajectory_->push_back(prediction);
+    }
+
+    // 2) points to planes. Re-observed inactive planes are recovered with their prior
+    for (uint_t i = 0; i < planeIds.size(); ++i)
+    {
+        uint_t id = planeIds[i];
+        auto it = planes_.find(id);
+        if (it == planes_.end())
+        {
+            auto inactive = inactivePlanes_.find(id);
+            if (inactive != inactivePlanes_.end())
+            {
+                it = planes_.emplace(id, inactive->second).first;
+                inactivePlanes_.erase(inactive);
+            }
+            else
+            {
+                std::shared_ptr<Plane> plane(new Plane(windowSize_, pointsMode_));
+                plane->set_trajectory(trajectory_);
+                it = planes_.emplace(id, plane).first;
+            }
+        }
+        Mat31 p = points.row(i).transpose();
+        it->second->push_back_point(p, t);
+    }
+
+    // 3) optimize the window, the first pose is fixed
+    update_planes_index();
+    iterations_ = 0;
+    if (t > firstWindowPose_)
+        iterations_ = optimize(method_, initialLambda_);
+
+    // 4) marginalization of the oldest pose
+    if (trajectory_->size() - firstWindowPose_ > windowSize_)
+        marginalize_oldest_pose();
+
+    return trajectory_->back();
+}
+
+SE3 PlaneOdometry::get_pose(uint_t t) const
+{
+    assert(t < trajectory_->size() && "PlaneOdometry::get_pose: temporal index larger than number of poses\n");
+    return trajectory_->at(t);
+}
+
+void PlaneOdometry::marginalize_oldest_pose()
+{
+    ++firstWindowPose_;
+    // the new first pose is fixed, but its observations are kept, they do not change anymore
+    for (auto it = planes_.begin(); it != planes_.end(); )
+    {
+        it->second->marginalize_observations(firstWindowPose_);
+        if (it->second->get_number_observations() == 0)
+        {
+            inactivePlanes_.emplace(it->first, it->second);
+            it = planes_.erase(it);
+        }
+        else
+            ++it;
+    }
+    update_planes_index();
+}
+
+void PlaneOdometry::update_planes_index()
+{
+    planesIndex_.clear();
+    for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
+        planesIndex_.push_back(it->second);
+}
+
+matData_t PlaneOdometry::calculate_error()
+{
+    return planeBlocks_.estimate_planes(planesIndex_);
+}
+
+void PlaneOdometry::calculate_gradient_hessian()
+{
+    // planes estimated at the current state, required after undoing LM steps
+    calculate_error();
+
+    // each plane adds the gradient and Hessian of the free poses in the window
+    const uint_t numberPoses = trajectory_->size() - firstWindowPose_ - 1;
+    const uint_t tFirst = firstWindowPose_ + 1;
+    auto addPlane = [tFirst, numberPoses](Plane &plane, Eigen::Ref<MatX1> gradient, Eigen::Ref<MatX> hessian)
+    {
+        plane.add_gradient_hessian_window(tFirst, numberPoses, gradient, hessian);
+    };
+    planeBlocks_.accumulate_gradient_hessian(planesIndex_, 6*numberPoses, true, addPlane, gradient_, hessian_);
+}
+
+void PlaneOdometry::update_state(const MatX1 &dx)
+{
+    for (uint_t t = firstWindowPose_ + 1, i = 0; t < trajectory_->size(); ++t, ++i)
+    {
+        Mat61 dxi = dx.segment<6>(6*i);
+        trajectory_->at(t).update_lhs(dxi);
+    }
+}
+
+void PlaneOdometry::bookkeep_state()
+{
+    bookkeptWindow_.assign(trajectory_->begin() + firstWindowPose_ + 1, trajectory_->end());
+}
+
+void PlaneOdometry::update_state_from_bookkeep()
+{
+    std::copy(bookkeptWindow_.begin(), bookkeptWindow_.end(), trajectory_->begin() + firstWindowPose_ + 1);
+    // planes are not recalculated here, the optimizer evaluates the error on the restored window
+}
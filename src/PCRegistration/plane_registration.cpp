@@ -27,6 +27,7 @@
 #include <Eigen/LU> // for inverse and determinant
 #include <Eigen/Eigenvalues>
 #include <iostream>
+#include <algorithm>
 
 
 #include <chrono>
@@ -35,9 +36,10 @@ using namespace mrob;
 
 
 PlaneRegistration::PlaneRegistration():
-        numberPlanes_(0), numberPoses_(0),numberPoints_(0),isSolved_(0), trajectory_(new std::vector<SE3>(8,SE3())),
+        numberPlanes_(0), numberPoses_(0),numberPoints_(0),isSolved_(0),
+        pointsMode_(Plane::STORE_POINTS), trajectory_(new std::vector<SE3>()),
         solveMode_(SolveMode::GRADIENT),
-        c1_(1e-4), c2_(0.9), alpha_(0.75), beta_(0.1)
+        alpha_(0.75), beta_(0.1)
 {
     // Optmizer does not establish the size for this matrices and thus it is required
     gradient_.resize(6);
@@ -120,6 +122,16 @@ uint_t PlaneRegistration::solve(SolveMode mode, bool singleIteration)
             solveIters_ = optimize(LEVENBERG_MARQUARDT_ELLIP,1e-2);
             time_profiles_.stop();
             break;
+        case SolveMode::GRADIENT_LBFGS:
+            time_profiles_.start();
+            solveIters_ = optimize(LBFGS);
+            time_profiles_.stop();
+            break;
+        case SolveMode::GRADIENT_CG:
+            time_profiles_.start();
+            solveIters_ = optimize(NONLINEAR_CG);
+            time_profiles_.stop();
+            break;
         default:
             return 0;
     }
@@ -251,66 +263,51 @@ uint_t PlaneRegistration::solve_quaternion_plane()
 
 uint_t PlaneRegistration::solve_initialize()
 {
-    // Initialize matrices of , all points in the Y matrix
-    std::vector<Mat31> Y_points_all;
-    Y_points_all.reserve(numberPlanes_);
-
-    // update data structure for init. All point in the fist pose
-    for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
+    // Planes observed at the first pose, their mean points are the reference Y.
+    // Each pose t = 1, ... T is aligned to it by Arun, minimum 3 planes per pose.
+    // Poses are independent, so they are solved in parallel, and the correspondences
+    // are accumulated directly, without building the matrices X,Y
+    update_planes_index();
+    const long numberPlanes = planesIndex_.size();
+    std::vector<Mat31> Y_points_all(numberPlanes, Mat31::Zero());
+    std::vector<char> observedFirst(numberPlanes, 0);
+    for (long i = 0; i < numberPlanes; ++i)
     {
-        it->second->calculate_all_matrices_S();
-        if (it->second->get_number_points(0) > 0 )
-            Y_points_all.push_back(it->second->get_mean_point(0));
+        // correspondences require the plane observed at both times
+        if (planesIndex_[i]->get_number_points(0) > 0)
+        {
+            Y_points_all[i] = planesIndex_[i]->get_mean_point(0);
+            observedFirst[i] = 1;
+        }
     }
 
-    uint_t t = 0;
-    // create points Y,X, for t = 1, ... T, minimum 3 planes per pose
-    std::vector<Mat31> X_points, Y_points;
-    X_points.reserve(numberPlanes_);
-    Y_points.reserve(numberPlanes_);
-    uint_t number_points;
-
-    for (t = 1; t < numberPoses_; ++t)
+    const long numberPoses = numberPoses_;
+    uint_t solved = 1;
+    #pragma omp parallel for schedule(dynamic) reduction(&&:solved)
+    for (long t = 1; t < numberPoses; ++t)
     {
-        X_points.clear();
-        Y_points.clear();
-        number_points = 0;
-        uint_t cont =0;
-        for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
-        {
-            if (it->second->get_number_points(t) > 0 )
-            {
-                X_points.push_back(it->second->get_mean_point(t));
-                Y_points.push_back(Y_points_all[cont]);
-                number_points++;
-            }
-            cont++;
-        }
-        // Create the matrices X,Y
-        MatX X(number_points,3), Y(number_points,3);
-        for (uint_t i = 0; i < number_points; ++i)
+        PCRegistration::ArunAccumulator accumulator;
+        for (long i = 0; i < numberPlanes; ++i)
         {
-            X.row(i) = X_points[i];
-            Y.row(i) = Y_points[i];
+            if (observedFirst[i] && planesIndex_[i]->get_number_points(t) > 0)
+                accumulator.add(planesIndex_[i]->get_mean_point(t), Y_points_all[i]);
         }
         // Arun solver
         SE3 estimatedPose;
-        if (!PCRegistration::arun(X,Y,estimatedPose))
-            return 0;
-        trajectory_->at(t) = estimatedPose;
+        if (accumulator.get_number_points() >= 3 && accumulator.solve(estimatedPose))
+            trajectory_->at(t) = estimatedPose;
+        else
+            solved = 0;
     }
 
-
     // update current trajectory
-    return 1;
+    return solved;
 }
 
 double PlaneRegistration::get_current_error() const
 {
-    double  currentError = 0.0;
-    for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
-        currentError += it->second->estimate_plane();
-    return currentError;
+    update_planes_index();
+    return planeBlocks_.estimate_planes(planesIndex_);
 }
 
 void PlaneRegistration::set_last_pose(SE3 &last)
@@ -325,6 +322,23 @@ void PlaneRegistration::set_last_pose(SE3 &last)
     }
 }
 
+uint_t PlaneRegistration::add_pose(const SE3 &pose)
+{
+    trajectory_->push_back(pose);
+    previousState_.push_back(Mat61::Zero());
+    numberPoses_ = trajectory_->size();
+    return numberPoses_ - 1;
+}
+
+void PlaneRegistration::extend_trajectory(uint_t time)
+{
+    while (numberPoses_ <= time)
+    {
+        SE3 last = trajectory_->empty() ? SE3() : trajectory_->back();
+        add_pose(last);
+    }
+}
+
 void PlaneRegistration::add_plane(uint_t id, std::shared_ptr<Plane> &plane)
 {
     plane->set_trajectory(trajectory_);
@@ -333,16 +347,56 @@ void PlaneRegistration::add_plane(uint_t id, std::shared_ptr<Plane> &plane)
 
 void PlaneRegistration::add_new_plane(uint_t id)
 {
-    std::shared_ptr<Plane> plane(new Plane(numberPoses_));
+    std::shared_ptr<Plane> plane(new Plane(numberPoses_, pointsMode_));
     plane->set_trajectory(trajectory_);
     planes_.emplace(id, plane);
 }
 
 void PlaneRegistration::plane_push_back_point(uint_t id, uint_t t, Mat31 &point)
 {
+    extend_trajectory(t);
     planes_.at(id)->push_back_point(point,t);
 }
 
+std::shared_ptr<Plane> & PlaneRegistration::get_plane(uint_t id)
+{
+    return planes_.at(id);
+}
+
+void PlaneRegistration::plane_push_back_points(uint_t id, uint_t t, const Eigen::Ref<const MatX> &points)
+{
+    extend_trajectory(t);
+    planes_.at(id)->push_back_points(points,t);
+}
+
+void PlaneRegistration::add_point_cloud_planes(uint_t time, std::vector<Mat31>& points, std::vector<uint_t>& point_ids)
+{
+    assert(points.size() == point_ids.size() && "PlaneRegistration::add_point_cloud_planes: incorrect number of ids");
+    extend_trajectory(time);
+    for (uint_t i = 0; i < points.size(); ++i)
+    {
+        if (planes_.count(point_ids[i]) == 0)
+            add_new_plane(point_ids[i]);
+        planes_.at(point_ids[i])->push_back_point(points[i], time);
+    }
+}
+
+void PlaneRegistration::add_planes_matrix_S(uint_t time, const std::vector<uint_t>& plane_ids, const std::vector<Mat4>& S)
+{
+    assert(plane_ids.size() == S.size() && "PlaneRegistration::add_planes_matrix_S: incorrect number of ids");
+    extend_trajectory(time);
+    for (uint_t i = 0; i < plane_ids.size(); ++i)
+    {
+        // new planes keep only S, regardless of pointsMode_, since there are no points to store
+        if (planes_.count(plane_ids[i]) == 0)
+        {
+            std::shared_ptr<Plane> plane(new Plane(numberPoses_, Plane::SUFFICIENT_STATISTICS));
+            add_plane(plane_ids[i], plane);
+        }
+        planes_.at(plane_ids[i])->push_back_matrix_S(S[i], time);
+    }
+}
+
 uint_t PlaneRegistration::calculate_total_number_points()
 {
     numberPoints_ = 0;
@@ -427,6 +481,8 @@ std::vector<double> PlaneRegistration::print_evaluate()
         case SolveMode::GRADIENT:
         case SolveMode::GRADIENT_BENGIOS_NAG:
         case SolveMode::GRADIENT_ALL_POSES:
+        case SolveMode::GRADIENT_LBFGS:
+        case SolveMode::GRADIENT_CG:
             hessian__.setZero();
             break;
         case SolveMode::GN_HESSIAN:
@@ -476,25 +532,43 @@ matData_t PlaneRegistration::calculate_error()
 
 void PlaneRegistration::calculate_gradient_hessian()
 {
-    Mat61 gradient = Mat61::Zero();
-    Mat6 hessian = Mat6::Zero();
-    gradient_.setZero();
-    hessian_.setZero();
     get_current_error();//this recalculates the current planes estimation, required for LM proper undoing.
+    accumulate_gradient_hessian(true);
+}
+
+void PlaneRegistration::calculate_gradient()
+{
+    // Planes are already estimated by calculate_error() on the current state
+    accumulate_gradient_hessian(false);
+}
+
+void PlaneRegistration::accumulate_gradient_hessian(bool calculateHessian)
+{
+    // each plane adds the upper triangular Hessian of the poses observing it, the first pose is fixed
+    update_planes_index();
     double  tau = 1.0 / (double)(numberPoses_-1);
-    for (uint_t t = 1 ; t < numberPoses_; ++t)
+    auto addPlane = [tau, calculateHessian](Plane &plane, Eigen::Ref<MatX1> gradient, Eigen::Ref<MatX> hessian)
     {
-        gradient.setZero();
-        hessian.setZero();
-        for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
+        for (uint_t t : plane.get_observed_times())
         {
-            gradient += it->second->calculate_gradient(t);
-            hessian += it->second->calculate_hessian(t);
+            if (t == 0)
+                continue;
+            gradient += (tau * t) * plane.calculate_gradient(t);
+            if (calculateHessian)
+                hessian += (tau * t) * plane.calculate_hessian(t);
         }
-        // TODO this should be changed to time stamps later
-        gradient_ +=  (tau *  t)  * gradient;
-        hessian_ += (tau *  t) * hessian.selfadjointView<Eigen::Upper>();
-    }
+    };
+    MatX hessian;
+    planeBlocks_.accumulate_gradient_hessian(planesIndex_, 6, calculateHessian, addPlane, gradient_, hessian);
+    if (calculateHessian)
+        hessian_ = hessian.selfadjointView<Eigen::Upper>();
+}
+
+void PlaneRegistration::update_planes_index() const
+{
+    planesIndex_.clear();
+    for (auto it = planes_.cbegin();  it != planes_.cend(); ++it)
+        planesIndex_.push_back(it->second);
 }
 
 void PlaneRegistration::update_state(const MatX1 &dx)
@@ -526,7 +600,6 @@ void PlaneRegistration::update_state_from_bookkeep()
         dxi = tau * t * xiFinal;
         trajectory_->at(t) = SE3(dxi);
     }
-    calculate_error();// planes get recalculated, which is a requisite for later
-    //(this class construction, in general grad should be self-contained...)
+    // planes are not recalculated here, the optimizer evaluates the error on the restored state
 }
 
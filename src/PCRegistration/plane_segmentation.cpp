@@ -0,0 +1,228 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * plane_segmentation.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/plane_segmentation.hpp"
+#include <Eigen/Eigenvalues>
+#include <algorithm>
+#include <numeric>
+#include <deque>
+#include <cmath>
+#include <cassert>
+
+using namespace mrob;
+
+constexpr uint_t PlaneSegmentation::NO_PLANE;
+
+PlaneSegmentation::PlaneSegmentation(double voxelSize, double maxDistance, double maxAngle,
+                                     uint_t minPointsVoxel, uint_t minPointsPlane):
+        voxelSize_(voxelSize), maxDistance_(maxDistance), cosMaxAngle_(std::cos(maxAngle)),
+        minPointsVoxel_(minPointsVoxel), minPointsPlane_(minPointsPlane)
+{
+    assert(voxelSize_ > 0.0 && "PlaneSegmentation: voxel size must be positive");
+    assert(minPointsVoxel_ >= 3 && "PlaneSegmentation: at least 3 points per voxel are required");
+}
+
+PlaneSegmentation::~PlaneSegmentation()
+{
+}
+
+matData_t PlaneSegmentation::fit_plane(const Mat4 &S, Mat31 &normal, Mat31 &centroid)
+{
+    // covariance from S: C = P'P/N - mu*mu'
+    matData_t N = S(3,3);
+    centroid = S.topRightCorner<3,1>() / N;
+    Mat3 C = S.topLeftCorner<3,3>() / N - centroid * centroid.transpose();
+    Eigen::SelfAdjointEigenSolver<Mat3> es(C);
+    normal = es.eigenvectors().col(0);
+    return std::max(es.eigenvalues()(0), 0.0);
+}
+
+uint_t PlaneSegmentation::segment(const Eigen::Ref<const MatX> &points)
+{
+    assert(points.cols() == 3 && "PlaneSegmentation::segment: points must be a N x 3 matrix");
+    const long N = points.rows();
+
+    // 1) voxel of each point. Keys are calculated in parallel and the hash table is built sequentially
+    std::vector<uint64_t> pointKeys(N);
+    #pragma omp parallel for
+    for (long i = 0; i < N; ++i)
+        pointKeys[i] = voxel_key(points.row(i).transpose(), voxelSize_);
+    voxelIndex_.clear();
+    voxelKeys_.clear();
+    pointVoxel_.resize(N);
+    for (long i = 0; i < N; ++i)
+    {
+        auto res = voxelIndex_.emplace(pointKeys[i], voxelKeys_.size());
+        if (res.second)
+            voxelKeys_.push_back(pointKeys[i]);
+        pointVoxel_[i] = res.first->second;
+    }
+    const long numberVoxels = voxelKeys_.size();
+
+    // counting sort of the points by voxel
+    voxelStart_.assign(numberVoxels + 1, 0);
+    for (long i = 0; i < N; ++i)
+        ++voxelStart_[pointVoxel_[i] + 1];
+    std::partial_sum(voxelStart_.begin(), voxelStart_.end(), voxelStart_.begin());
+    voxelPoints_.resize(N);
+    {
+        std::vector<uint_t> position(voxelStart_.begin(), voxelStart_.end() - 1);
+        for (long i = 0; i < N; ++i)
+            voxelPoints_[position[pointVoxel_[i]]++] = i;
+    }
+
+    // 2) matrices S and planarity of each voxel, in parallel
+    voxelS_.resize(numberVoxels);
+    voxelNormal_.resize(numberVoxels);
+    voxelCentroid_.resize(numberVoxels);
+    voxelThickness_.resize(numberVoxels);
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long v = 0; v < numberVoxels; ++v)
+    {
+        Mat4 S = Mat4::Zero();
+        for (uint_t j = voxelStart_[v]; j < voxelStart_[v+1]; ++j)
+        {
+            Mat41 pHomog;
+            pHomog << points.row(voxelPoints_[j]).transpose(), 1.0;
+            S.noalias() += pHomog * pHomog.transpose();
+        }
+        voxelS_[v] = S;
+        voxelThickness_[v] = std::numeric_limits<matData_t>::infinity();
+        if (voxelStart_[v+1] - voxelStart_[v] >= minPointsVoxel_)
+            voxelThickness_[v] = std::sqrt(fit_plane(S, voxelNormal_[v], voxelCentroid_[v]));
+    }
+
+    // 3) region growing, seeds are the thinnest planar voxels
+    std::vector<uint_t> seeds;
+    for (long v = 0; v < numberVoxels; ++v)
+        if (voxelThickness_[v] <= maxDistance_)
+            seeds.push_back(v);
+    std::sort(seeds.begin(), seeds.end(),
+              [this](uint_t a, uint_t b){return voxelThickness_[a] < voxelThickness_[b];});
+    voxelRegion_.assign(numberVoxels, NO_PLANE);
+    std::vector<Mat4> regionS;
+    std::deque<uint_t> queue;
+    for (uint_t seed : seeds)
+    {
+        if (voxelRegion_[seed] != NO_PLANE)
+            continue;
+        uint_t region = regionS.size();
+        Mat4 S = voxelS_[seed];
+        Mat31 normal = voxelNormal_[seed], centroid = voxelCentroid_[seed];
+        voxelRegion_[seed] = region;
+        queue.push_back(seed);
+        while (!queue.empty())
+        {
+            uint_t v = queue.front();
+            queue.pop_front();
+            int64_t x, y, z;
+            voxel_key_coordinates(voxelKeys_[v], x, y, z);
+            for (int64_t dx = -1; dx <= 1; ++dx)
+              for (int64_t dy = -1; dy <= 1; ++dy)
+                for (int64_t dz = -1; dz <= 1; ++dz)
+                {
+                    auto it = voxelIndex_.find(voxel_key(x + dx, y + dy, z + dz));
+                    if (it == voxelIndex_.end())
+                        continue;
+                    uint_t u = it->second;
+                    if (voxelRegion_[u] != NO_PLANE || voxelThickness_[u] > maxDistance_)
+                        continue;
+                    if (std::fabs(normal.dot(voxelNormal_[u])) < cosMaxAngle_ ||
+                        std::fabs(normal.dot(voxelCentroid_[u] - centroid)) > maxDistance_)
+                        continue;
+                    voxelRegion_[u] = region;
+                    S += voxelS_[u];
+                    fit_plane(S, normal, centroid);
+                    queue.push_back(u);
+                }
+        }
+        regionS.push_back(S);
+    }
+
+    // 4) regions with enough points are planes, sorted by number of points
+    std::vector<uint_t> order;
+    for (uint_t r = 0; r < regionS.size(); ++r)
+        if (regionS[r](3,3) >= minPointsPlane_)
+            order.push_back(r);
+    std::sort(order.begin(), order.end(),
+              [&regionS](uint_t a, uint_t b){return regionS[a](3,3) > regionS[b](3,3);});
+    std::vector<uint_t> regionPlane(regionS.size(), NO_PLANE);
+    matrixS_.clear();
+    planes_.clear();
+    for (uint_t r : order)
+    {
+        regionPlane[r] = matrixS_.size();
+        matrixS_.push_back(regionS[r]);
+        Mat31 normal, centroid;
+        fit_plane(regionS[r], normal, centroid);
+        Mat41 plane;
+        plane << normal, -normal.dot(centroid);
+        planes_.push_back(plane);
+    }
+
+    // 5) plane ids of each point. Points on non planar voxels (borders, intersections, etc.) are assigned
+    //    to the closest plane of a neighbour voxel, if any, at a distance smaller than maxDistance.
+    //    Their S are accumulated afterwards, so planes do not change while points are assigned
+    pointIds_.resize(N);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (long i = 0; i < N; ++i)
+    {
+        uint_t v = pointVoxel_[i];
+        uint_t region = voxelRegion_[v];
+        if (region != NO_PLANE)
+        {
+            pointIds_[i] = regionPlane[region];
+            continue;
+        }
+        pointIds_[i] = NO_PLANE;
+        Mat41 pHomog;
+        pHomog << points.row(i).transpose(), 1.0;
+        matData_t minDistance = maxDistance_;
+        int64_t x, y, z;
+        voxel_key_coordinates(voxelKeys_[v], x, y, z);
+        for (int64_t dx = -1; dx <= 1; ++dx)
+          for (int64_t dy = -1; dy <= 1; ++dy)
+            for (int64_t dz = -1; dz <= 1; ++dz)
+            {
+                auto it = voxelIndex_.find(voxel_key(x + dx, y + dy, z + dz));
+                if (it == voxelIndex_.end() || voxelRegion_[it->second] == NO_PLANE)
+                    continue;
+                uint_t plane = regionPlane[voxelRegion_[it->second]];
+                if (plane == NO_PLANE)
+                    continue;
+                matData_t distance = std::fabs(planes_[plane].dot(pHomog));
+                if (distance < minDistance)
+                {
+                    minDistance = distance;
+                    pointIds_[i] = plane;
+                }
+            }
+    }
+    for (long i = 0; i < N; ++i)
+    {
+        if (pointIds_[i] == NO_PLANE || voxelRegion_[pointVoxel_[i]] != NO_PLANE)
+            continue;
+        Mat41 pHomog;
+        pHomog << points.row(i).transpose(), 1.0;
+        matrixS_[pointIds_[i]].noalias() += pHomog * pHomog.transpose();
+    }
+    return matrixS_.size();
+}
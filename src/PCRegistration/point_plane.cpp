@@ -0,0 +1,169 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * point_plane.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <vector>
+#include <cassert>
+#include "mrob/pc_registration.hpp"
+#include "mrob/registration_solver.hpp"
+
+
+using namespace mrob;
+
+namespace {
+
+/**
+ * Points and normals in a structure of arrays (SoA), each coordinate contiguous over
+ * all points, such that the loop over points can be vectorized (see gicp)
+ */
+struct PointPlaneData
+{
+    PointPlaneData(const Eigen::Ref<const MatX> &X, const Eigen::Ref<const MatX> &Y,
+                   const Eigen::Ref<const MatX> &normalsY)
+    {
+        copy(X, x);
+        copy(Y, y);
+        copy(normalsY, ny);
+    }
+    static void copy(const Eigen::Ref<const MatX> &A, std::vector<matData_t> *a)
+    {
+        for (uint_t k = 0; k < 3; ++k)
+        {
+            a[k].resize(A.rows());
+            for (uint_t i = 0; i < A.rows(); ++i)
+                a[k][i] = A(i,k);
+        }
+    }
+    std::vector<matData_t> x[3], y[3], nx[3], ny[3];
+};
+
+}
+
+int PCRegistration::point_to_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsY, SE3 &T, double tol)
+{
+    RegistrationOptions options;
+    options.tol = tol;
+    return point_to_plane(X, Y, normalsY, T, options).iterations; // number of iterations
+}
+
+PCRegistration::RegistrationStats PCRegistration::point_to_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsY, SE3 &T, const RegistrationOptions &options)
+{
+    assert(X.cols() == 3  && "PCRegistration::point_to_plane: Incorrect sizing, we expect Nx3");
+    assert(X.rows() >= 6  && "PCRegistration::point_to_plane: Incorrect sizing, we expect at least 6 correspondences");
+    assert(Y.rows() == X.rows()  && "PCRegistration::point_to_plane: Same number of correspondences");
+    assert(normalsY.rows() == Y.rows() && normalsY.cols() == 3 && "PCRegistration::point_to_plane: Incorrect sizing of normals");
+    const long N = X.rows();
+    PointPlaneData data(X, Y, normalsY);
+    std::vector<matData_t> blockAccumulators;
+    const matData_t c2 = options.kernelWidth * options.kernelWidth;
+
+    auto evaluate = [&](const SE3 &T, Mat61 &J, Mat6 &H, uint_t &inliers) -> double
+    {
+        const Mat3 R = T.R();
+        const Mat31 t = T.t();
+        const matData_t r00 = R(0,0), r01 = R(0,1), r02 = R(0,2),
+                        r10 = R(1,0), r11 = R(1,1), r12 = R(1,2),
+                        r20 = R(2,0), r21 = R(2,1), r22 = R(2,2);
+        const matData_t t0 = t(0), t1 = t(1), t2 = t(2);
+        // residual r = n'(y - p), p = Rx + t, and Jacobian [(n x p)', -n'] (with Jr = [p^, -I])
+        auto residual = [&](long i) -> ResidualRow
+        {
+            const matData_t x0 = data.x[0][i], x1 = data.x[1][i], x2 = data.x[2][i];
+            const matData_t p0 = r00*x0 + r01*x1 + r02*x2 + t0;
+            const matData_t p1 = r10*x0 + r11*x1 + r12*x2 + t1;
+            const matData_t p2 = r20*x0 + r21*x1 + r22*x2 + t2;
+            const matData_t n0 = data.ny[0][i], n1 = data.ny[1][i], n2 = data.ny[2][i];
+            return ResidualRow{n0*(data.y[0][i] - p0) + n1*(data.y[1][i] - p1) + n2*(data.y[2][i] - p2),
+                               n1*p2 - n2*p1, n2*p0 - n0*p2, n0*p1 - n1*p0, -n0, -n1, -n2};
+        };
+        auto accumulate_block = [&](long start, long end, matData_t *acc)
+        {
+            accumulate_scalar_residuals_block(options.kernel, residual, c2, start, end, acc);
+        };
+        return reduce_blocks(N, accumulate_block, blockAccumulators, J, H, inliers);
+    };
+
+    return solve_registration(evaluate, T, N, options);
+}
+
+int PCRegistration::symmetric_point_plane(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+        const Eigen::Ref<const MatX> normalsX, const Eigen::Ref<const MatX> normalsY, SE3 &T, double tol)
+{
+    RegistrationOptions options;
+    options.tol = tol;
+    return symmetric_point_plane(X, Y, normalsX, normalsY, T, options).iterations; // number of iterations
+}
+
+PCRegistration::RegistrationStats PCRegistration::symmetric_point_plane(const Eigen::Ref<const MatX> X,
+        const Eigen::Ref<const MatX> Y, const Eigen::Ref<const MatX> normalsX, const Eigen::Ref<const MatX> normalsY,
+        SE3 &T, const RegistrationOptions &options)
+{
+    assert(X.cols() == 3  && "PCRegistration::symmetric_point_plane: Incorrect sizing, we expect Nx3");
+    assert(X.rows() >= 6  && "PCRegistration::symmetric_point_plane: Incorrect sizing, we expect at least 6 correspondences");
+    assert(Y.rows() == X.rows()  && "PCRegistration::symmetric_point_plane: Same number of correspondences");
+    assert(normalsX.rows() == X.rows() && normalsX.cols() == 3 && "PCRegistration::symmetric_point_plane: Incorrect sizing of normals");
+    assert(normalsY.rows() == Y.rows() && normalsY.cols() == 3 && "PCRegistration::symmetric_point_plane: Incorrect sizing of normals");
+    const long N = X.rows();
+    PointPlaneData data(X, Y, normalsY);
+    PointPlaneData::copy(normalsX, data.nx);
+    std::vector<matData_t> blockAccumulators;
+    const matData_t c2 = options.kernelWidth * options.kernelWidth;
+
+    auto evaluate = [&](const SE3 &T, Mat61 &J, Mat6 &H, uint_t &inliers) -> double
+    {
+        const Mat3 R = T.R();
+        const Mat31 t = T.t();
+        const matData_t r00 = R(0,0), r01 = R(0,1), r02 = R(0,2),
+                        r10 = R(1,0), r11 = R(1,1), r12 = R(1,2),
+                        r20 = R(2,0), r21 = R(2,1), r22 = R(2,2);
+        const matData_t t0 = t(0), t1 = t(1), t2 = t(2);
+        // residual r = e'm, with e = y - p, m = ny + q and q = R nx, the normal of x rotated (and oriented as ny).
+        // Since q also rotates, the Jacobian is [(m x p - e x q)', -m']
+        auto residual = [&](long i) -> ResidualRow
+        {
+            const matData_t x0 = data.x[0][i], x1 = data.x[1][i], x2 = data.x[2][i];
+            const matData_t p0 = r00*x0 + r01*x1 + r02*x2 + t0;
+            const matData_t p1 = r10*x0 + r11*x1 + r12*x2 + t1;
+            const matData_t p2 = r20*x0 + r21*x1 + r22*x2 + t2;
+            const matData_t e0 = data.y[0][i] - p0, e1 = data.y[1][i] - p1, e2 = data.y[2][i] - p2;
+            const matData_t a0 = data.nx[0][i], a1 = data.nx[1][i], a2 = data.nx[2][i];
+            const matData_t n0 = data.ny[0][i], n1 = data.ny[1][i], n2 = data.ny[2][i];
+            matData_t q0 = r00*a0 + r01*a1 + r02*a2;
+            matData_t q1 = r10*a0 + r11*a1 + r12*a2;
+            matData_t q2 = r20*a0 + r21*a1 + r22*a2;
+            const matData_t orientation = q0*n0 + q1*n1 + q2*n2 < 0.0 ? -1.0 : 1.0;
+            q0 *= orientation; q1 *= orientation; q2 *= orientation;
+            const matData_t m0 = n0 + q0, m1 = n1 + q1, m2 = n2 + q2;
+            return ResidualRow{e0*m0 + e1*m1 + e2*m2,
+                               (m1*p2 - m2*p1) - (e1*q2 - e2*q1),
+                               (m2*p0 - m0*p2) - (e2*q0 - e0*q2),
+                               (m0*p1 - m1*p0) - (e0*q1 - e1*q0),
+                               -m0, -m1, -m2};
+        };
+        auto accumulate_block = [&](long start, long end, matData_t *acc)
+        {
+            accumulate_scalar_residuals_block(options.kernel, residual, c2, start, end, acc);
+        };
+        return reduce_blocks(N, accumulate_block, blockAccumulators, J, H, inliers);
+    };
+
+    return solve_registration(evaluate, T, N, options);
+}
@@ -0,0 +1,285 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * ransac.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include "mrob/pc_registration.hpp"
+
+
+using namespace mrob;
+
+namespace {
+
+// hypotheses are generated and scored in parallel batches. All decisions (best hypothesis,
+// SPRT parameters and stopping) are taken after each batch in hypothesis order, so the
+// result does not depend on the number of threads
+const uint_t ransacBatchSize = 64;
+const uint_t ransacSampleSize = 3;
+const uint_t ransacMaxRefinements = 10;
+
+/**
+ * Minimal samples of correspondences, drawn sequentially from a seeded generator,
+ * uniformly (RANSAC) or progressively from the top ranked correspondences (PROSAC)
+ */
+class MinimalSampler
+{
+  public:
+    MinimalSampler(uint_t N, bool prosac, uint_t maxIterations, uint_t seed) :
+        N_(N), prosac_(prosac), generator_(seed), t_(0), n_(ransacSampleSize), TnPrime_(1.0)
+    {
+        // PROSAC growth function, Tn is the expected number of samples drawn from the top n
+        // correspondences out of the maxIterations samples of RANSAC
+        Tn_ = maxIterations;
+        for (uint_t i = 0; i < ransacSampleSize; ++i)
+            Tn_ *= double(n_ - i) / (N_ - i);
+    }
+    void sample(uint_t *indexes)
+    {
+        t_++;
+        uint_t range = N_, drawn = 0;
+        if (prosac_)
+        {
+            if (t_ > TnPrime_ && n_ < N_)
+            {
+                double Tn1 = Tn_ * (n_ + 1) / (n_ + 1 - ransacSampleSize);
+                TnPrime_ += std::ceil(Tn1 - Tn_);
+                Tn_ = Tn1;
+                n_++;
+            }
+            range = n_;
+            // the newest correspondence is included and the rest are drawn from the previous ones
+            if (TnPrime_ >= t_)
+            {
+                indexes[drawn++] = n_ - 1;
+                range = n_ - 1;
+            }
+        }
+        std::uniform_int_distribution<uint_t> distribution(0, range - 1);
+        while (drawn < ransacSampleSize)
+        {
+            uint_t candidate = distribution(generator_);
+            if (std::find(indexes, indexes + drawn, candidate) == indexes + drawn)
+                indexes[drawn++] = candidate;
+        }
+    }
+    std::mt19937& get_generator() {return generator_;}
+
+  protected:
+    uint_t N_;
+    bool prosac_;
+    std::mt19937 generator_;
+    uint_t t_, n_;
+    double Tn_, TnPrime_;
+};
+
+/**
+ * Counts the inliers of the hypothesis T, visiting correspondences in a random order.
+ * When SPRT is enabled, the likelihood ratio of the hypothesis being bad is updated on each
+ * correspondence and the hypothesis is rejected as soon as it exceeds the threshold A.
+ * Outputs the number of correspondences tested and returns the number of inliers.
+ */
+uint_t score_hypothesis(const Eigen::Ref<const MatX> &X, const Eigen::Ref<const MatX> &Y, const SE3 &T,
+        const std::vector<uint_t> &order, double threshold2, bool sprt, double epsilon, double delta, double A,
+        bool &rejected, uint_t &tested)
+{
+    const Mat3 R = T.R();
+    const Mat31 t = T.t();
+    const double ratioInlier = delta / epsilon, ratioOutlier = (1.0 - delta) / (1.0 - epsilon);
+    double likelihoodRatio = 1.0;
+    uint_t numberInliers = 0;
+    rejected = false;
+    for (tested = 0; tested < order.size(); )
+    {
+        const uint_t i = order[tested++];
+        Mat31 r = Y.row(i).transpose() - R * X.row(i).transpose() - t;
+        if (r.squaredNorm() < threshold2)
+        {
+            numberInliers++;
+            likelihoodRatio *= ratioInlier;
+        }
+        else
+            likelihoodRatio *= ratioOutlier;
+        if (sprt && likelihoodRatio > A)
+        {
+            rejected = true;
+            break;
+        }
+    }
+    return numberInliers;
+}
+
+/**
+ * SPRT decision threshold A, solution of A = tM C + 1 + log(A) (Chum and Matas 2008),
+ * where C is the average information gained per correspondence verified.
+ */
+double sprt_threshold(double epsilon, double delta, double modelCost)
+{
+    double C = (1.0 - delta) * std::log((1.0 - delta) / (1.0 - epsilon)) + delta * std::log(delta / epsilon);
+    double A0 = modelCost * C + 1.0, A = A0;
+    for (uint_t k = 0; k < 10; ++k)
+        A = A0 + std::log(A);
+    return A;
+}
+
+void collect_inliers(const Eigen::Ref<const MatX> &X, const Eigen::Ref<const MatX> &Y, const SE3 &T,
+        double threshold2, std::vector<uint_t> &inliers)
+{
+    const Mat3 R = T.R();
+    const Mat31 t = T.t();
+    inliers.clear();
+    for (uint_t i = 0; i < X.rows(); ++i)
+    {
+        Mat31 r = Y.row(i).transpose() - R * X.row(i).transpose() - t;
+        if (r.squaredNorm() < threshold2)
+            inliers.push_back(i);
+    }
+}
+
+}
+
+int PCRegistration::ransac_arun(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y, SE3 &T,
+        std::vector<uint_t> &inliers, const RansacOptions &options)
+{
+    assert(X.cols() == 3  && "PCRegistration::ransac_arun: Incorrect sizing, we expect Nx3");
+    assert(X.rows() >= 3  && "PCRegistration::ransac_arun: Incorrect sizing, we expect at least 3 correspondences");
+    assert(Y.rows() == X.rows()  && "PCRegistration::ransac_arun: Same number of correspondences");
+    const uint_t N = X.rows();
+    const double threshold2 = options.threshold * options.threshold;
+    inliers.clear();
+
+    // 1) samples are drawn sequentially and correspondences are verified in a random order,
+    //    required by SPRT (PROSAC correspondences are sorted)
+    MinimalSampler sampler(N, options.prosac, options.maxIterations, options.seed);
+    std::vector<uint_t> order(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), sampler.get_generator());
+
+    // SPRT starts once there is a hypothesis, epsilon being its ratio of inliers
+    double epsilon = 0.0, delta = options.sprtDelta, A = 0.0;
+    bool sprtActive = false;
+    double rejectedInliers = 0.0, rejectedTested = 0.0;
+
+    SE3 bestT;
+    uint_t bestInliers = 0;
+    uint_t iteration = 0, requiredIterations = options.maxIterations;
+    std::vector<uint_t> samples(ransacBatchSize * ransacSampleSize), scores(ransacBatchSize), tested(ransacBatchSize);
+    std::vector<int> valid(ransacBatchSize);
+    std::vector<char> rejected(ransacBatchSize);
+    std::vector<SE3> models(ransacBatchSize);
+    while (iteration < requiredIterations)
+    {
+        // 2) generate and score a batch of hypotheses in parallel
+        const long batch = std::min(ransacBatchSize, requiredIterations - iteration);
+        for (long b = 0; b < batch; ++b)
+            sampler.sample(&samples[b*ransacSampleSize]);
+        #pragma omp parallel for schedule(dynamic)
+        for (long b = 0; b < batch; ++b)
+        {
+            Eigen::Matrix<matData_t, 3, 3, Eigen::RowMajor> xs, ys;
+            for (uint_t k = 0; k < ransacSampleSize; ++k)
+            {
+                xs.row(k) = X.row(samples[b*ransacSampleSize + k]);
+                ys.row(k) = Y.row(samples[b*ransacSampleSize + k]);
+            }
+            valid[b] = arun(xs, ys, models[b]);
+            if (valid[b])
+            {
+                bool isRejected;
+                scores[b] = score_hypothesis(X, Y, models[b], order, threshold2, sprtActive, epsilon, delta, A,
+                                             isRejected, tested[b]);
+                rejected[b] = isRejected;
+            }
+        }
+
+        // 3) update the best hypothesis and the SPRT estimates, in hypothesis order
+        for (long b = 0; b < batch; ++b)
+        {
+            iteration++;
+            if (!valid[b])
+                continue;
+            if (rejected[b])
+            {
+                rejectedInliers += scores[b];
+                rejectedTested += tested[b];
+                continue;
+            }
+            if (scores[b] > bestInliers)
+            {
+                bestInliers = scores[b];
+                bestT = models[b];
+            }
+        }
+        if (bestInliers < ransacSampleSize)
+            continue;
+        epsilon = double(bestInliers) / N;
+
+        // 4) number of iterations to sample an all-inlier set with the given confidence
+        const double allInliers = std::pow(epsilon, ransacSampleSize);
+        if (allInliers >= 1.0)
+            requiredIterations = iteration;
+        else
+        {
+            double k = std::log(1.0 - options.confidence) / std::log(1.0 - allInliers);
+            if (k < requiredIterations)
+                requiredIterations = std::max(iteration, static_cast<uint_t>(std::ceil(k)));
+        }
+
+        // 5) delta is the average ratio of inliers of the rejected (bad) hypotheses
+        if (options.sprt)
+        {
+            if (rejectedTested > 0.0)
+                delta = std::max(rejectedInliers / rejectedTested, 1e-6);
+            sprtActive = epsilon > delta && epsilon < 1.0;
+            if (sprtActive)
+                A = sprt_threshold(epsilon, delta, options.sprtModelCost);
+        }
+    }
+    if (bestInliers < ransacSampleSize)
+        return iteration;
+
+    // 6) refinement of the best hypothesis by Arun over all its inliers, until they do not change
+    collect_inliers(X, Y, bestT, threshold2, inliers);
+    std::vector<uint_t> newInliers;
+    for (uint_t r = 0; r < ransacMaxRefinements; ++r)
+    {
+        MatX Xi(inliers.size(), 3), Yi(inliers.size(), 3);
+        for (uint_t i = 0; i < inliers.size(); ++i)
+        {
+            Xi.row(i) = X.row(inliers[i]);
+            Yi.row(i) = Y.row(inliers[i]);
+        }
+        SE3 refinedT;
+        if (!arun(Xi, Yi, refinedT))
+            break;
+        collect_inliers(X, Y, refinedT, threshold2, newInliers);
+        if (newInliers.size() < inliers.size())
+            break;
+        bestT = refinedT;
+        bool converged = newInliers == inliers;
+        inliers.swap(newInliers);
+        if (converged)
+            break;
+    }
+    T = bestT;
+    return iteration;
+}
@@ -0,0 +1,314 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * spatial_index.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/spatial_index.hpp"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cassert>
+#include <stdexcept>
+
+using namespace mrob;
+
+
+SpatialIndex::SpatialIndex()
+{
+}
+
+SpatialIndex::~SpatialIndex()
+{
+}
+
+uint_t SpatialIndex::insert_neighbour(int index, matData_t squaredDistance, uint_t k, uint_t n,
+                                      int *indexes, matData_t *squaredDistances)
+{
+    // the list is full and the candidate is worse than the last element
+    if (n == k && squaredDistance >= squaredDistances[k-1])
+        return n;
+    uint_t i = n < k ? n++ : k - 1;
+    while (i > 0 && squaredDistances[i-1] > squaredDistance)
+    {
+        indexes[i] = indexes[i-1];
+        squaredDistances[i] = squaredDistances[i-1];
+        --i;
+    }
+    indexes[i] = index;
+    squaredDistances[i] = squaredDistance;
+    return n;
+}
+
+void SpatialIndex::knn_batch(const Eigen::Ref<const MatX> &queries, uint_t k, MatXi &indexes, MatX &squaredDistances,
+                             matData_t maxDistance) const
+{
+    assert(queries.cols() == 3 && "SpatialIndex::knn_batch: queries must be a M x 3 matrix");
+    const long M = queries.rows();
+    indexes.resize(M, k);
+    squaredDistances.resize(M, k);
+    // row major matrices, so the results of each query are contiguous
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (long i = 0; i < M; ++i)
+    {
+        int *ind = indexes.data() + i*k;
+        matData_t *dist = squaredDistances.data() + i*k;
+        uint_t n = knn(queries.row(i).transpose(), k, ind, dist, maxDistance);
+        for (uint_t j = n; j < k; ++j)
+        {
+            ind[j] = -1;
+            dist[j] = std::numeric_limits<matData_t>::infinity();
+        }
+    }
+}
+
+void SpatialIndex::nearest_batch(const Eigen::Ref<const MatX> &queries, std::vector<int> &indexes,
+                                 std::vector<matData_t> &squaredDistances, matData_t maxDistance) const
+{
+    assert(queries.cols() == 3 && "SpatialIndex::nearest_batch: queries must be a M x 3 matrix");
+    const long M = queries.rows();
+    indexes.resize(M);
+    squaredDistances.resize(M);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (long i = 0; i < M; ++i)
+    {
+        if (knn(queries.row(i).transpose(), 1, &indexes[i], &squaredDistances[i], maxDistance) == 0)
+        {
+            indexes[i] = -1;
+            squaredDistances[i] = std::numeric_limits<matData_t>::infinity();
+        }
+    }
+}
+
+
+// ---------------------------------------------------------------------------------
+// KD-tree
+// ---------------------------------------------------------------------------------
+KDTree::KDTree(uint_t leafSize):
+        leafSize_(leafSize)
+{
+    // a leaf size of 0 would split forever, also in release builds
+    if (leafSize_ == 0)
+        throw std::invalid_argument("KDTree: leaf size must be positive");
+}
+
+KDTree::KDTree(const Eigen::Ref<const MatX> &points, uint_t leafSize):
+        leafSize_(leafSize)
+{
+    // a leaf size of 0 would split forever, also in release builds
+    if (leafSize_ == 0)
+        throw std::invalid_argument("KDTree: leaf size must be positive");
+    build(points);
+}
+
+KDTree::~KDTree()
+{
+}
+
+void KDTree::build(const Eigen::Ref<const MatX> &points)
+{
+    assert(points.cols() == 3 && "KDTree::build: points must be a N x 3 matrix");
+    const uint_t N = points.rows();
+    indexes_.resize(N);
+    std::iota(indexes_.begin(), indexes_.end(), 0);
+    points_.resize(3*N);
+    for (uint_t i = 0; i < N; ++i)
+        for (uint_t j = 0; j < 3; ++j)
+            points_[3*i + j] = points(i,j);
+    nodes_.clear();
+    nodes_.reserve(2 * (N / leafSize_ + 1));
+    if (N > 0)
+        build_node(0, N);
+
+    // points are reordered such that the points of each leaf are contiguous
+    std::vector<matData_t> sorted(3*N);
+    for (uint_t i = 0; i < N; ++i)
+        for (uint_t j = 0; j < 3; ++j)
+            sorted[3*i + j] = points(indexes_[i], j);
+    points_.swap(sorted);
+}
+
+uint_t KDTree::build_node(uint_t start, uint_t end)
+{
+    uint_t id = nodes_.size();
+    nodes_.push_back(Node{start, end, -1, 0.0, 0, 0});
+    if (end - start <= leafSize_)
+        return id;
+
+    // split along the dimension of largest extent, at the median
+    Mat31 minP = Mat31::Constant(std::numeric_limits<matData_t>::infinity());
+    Mat31 maxP = -minP;
+    for (uint_t i = start; i < end; ++i)
+        for (uint_t j = 0; j < 3; ++j)
+        {
+            minP(j) = std::min(minP(j), points_[3*indexes_[i] + j]);
+            maxP(j) = std::max(maxP(j), points_[3*indexes_[i] + j]);
+        }
+    int axis;
+    (maxP - minP).maxCoeff(&axis);
+    if (maxP(axis) - minP(axis) <= 0.0)
+        return id;// all points are equal, this is a leaf
+    uint_t middle = start + (end - start) / 2;
+    std::nth_element(indexes_.begin() + start, indexes_.begin() + middle, indexes_.begin() + end,
+                     [this, axis](uint_t a, uint_t b){return points_[3*a + axis] < points_[3*b + axis];});
+    matData_t split = points_[3*indexes_[middle] + axis];
+
+    uint_t left = build_node(start, middle);
+    uint_t right = build_node(middle, end);
+    nodes_[id].axis = axis;
+    nodes_[id].split = split;
+    nodes_[id].left = left;
+    nodes_[id].right = right;
+    return id;
+}
+
+uint_t KDTree::knn(const Mat31 &query, uint_t k, int *indexes, matData_t *squaredDistances, matData_t maxDistance) const
+{
+    if (nodes_.empty() || k == 0)
+        return 0;
+    uint_t n = 0;
+    matData_t maxSquared = maxDistance * maxDistance;
+    // depth first search, with the distance from the query to the split plane of the unexplored branch
+    struct Pending {uint_t node; matData_t squaredDistance;};
+    Pending stack[128];
+    uint_t top = 0;
+    stack[top++] = Pending{0, 0.0};
+    while (top > 0)
+    {
+        Pending current = stack[--top];
+        matData_t bound = n == k ? std::min(maxSquared, squaredDistances[k-1]) : maxSquared;
+        if (current.squaredDistance >= bound)
+            continue;
+        const Node &node = nodes_[current.node];
+        if (node.axis < 0)
+        {
+            for (uint_t i = node.start; i < node.end; ++i)
+            {
+                const matData_t *p = &points_[3*i];
+                matData_t dx = p[0] - query(0), dy = p[1] - query(1), dz = p[2] - query(2);
+                matData_t d2 = dx*dx + dy*dy + dz*dz;
+                if (d2 < maxSquared)
+                    n = insert_neighbour(indexes_[i], d2, k, n, indexes, squaredDistances);
+            }
+            continue;
+        }
+        matData_t diff = query(node.axis) - node.split;
+        uint_t nearChild = diff < 0.0 ? node.left : node.right;
+        uint_t farChild = diff < 0.0 ? node.right : node.left;
+        // the far child is pushed first, so the near one is explored before
+        stack[top++] = Pending{farChild, std::max(current.squaredDistance, diff*diff)};
+        stack[top++] = Pending{nearChild, current.squaredDistance};
+    }
+    return n;
+}
+
+
+// ---------------------------------------------------------------------------------
+// Voxel hash grid
+// ---------------------------------------------------------------------------------
+VoxelHashGrid::VoxelHashGrid(matData_t voxelSize):
+        voxelSize_(voxelSize)
+{
+    assert(voxelSize_ > 0.0 && "VoxelHashGrid: voxel size must be positive");
+}
+
+VoxelHashGrid::VoxelHashGrid(const Eigen::Ref<const MatX> &points, matData_t voxelSize):
+        voxelSize_(voxelSize)
+{
+    assert(voxelSize_ > 0.0 && "VoxelHashGrid: voxel size must be positive");
+    build(points);
+}
+
+VoxelHashGrid::~VoxelHashGrid()
+{
+}
+
+void VoxelHashGrid::build(const Eigen::Ref<const MatX> &points)
+{
+    assert(points.cols() == 3 && "VoxelHashGrid::build: points must be a N x 3 matrix");
+    const long N = points.rows();
+
+    // 1) voxel of each point, keys in parallel and the hash table sequentially
+    std::vector<uint64_t> keys(N);
+    #pragma omp parallel for
+    for (long i = 0; i < N; ++i)
+        keys[i] = voxel_key(points.row(i).transpose(), voxelSize_);
+    voxelIndex_.clear();
+    std::vector<uint_t> pointVoxel(N);
+    for (long i = 0; i < N; ++i)
+        pointVoxel[i] = voxelIndex_.emplace(keys[i], voxelIndex_.size()).first->second;
+
+    // 2) counting sort of the points by voxel, points in a voxel are contiguous
+    voxelStart_.assign(voxelIndex_.size() + 1, 0);
+    for (long i = 0; i < N; ++i)
+        ++voxelStart_[pointVoxel[i] + 1];
+    std::partial_sum(voxelStart_.begin(), voxelStart_.end(), voxelStart_.begin());
+    std::vector<uint_t> position(voxelStart_.begin(), voxelStart_.end() - 1);
+    indexes_.resize(N);
+    points_.resize(3*N);
+    for (long i = 0; i < N; ++i)
+    {
+        uint_t j = position[pointVoxel[i]]++;
+        indexes_[j] = i;
+        for (uint_t d = 0; d < 3; ++d)
+            points_[3*j + d] = points(i,d);
+    }
+}
+
+uint_t VoxelHashGrid::knn(const Mat31 &query, uint_t k, int *indexes, matData_t *squaredDistances, matData_t maxDistance) const
+{
+    if (k == 0)
+        return 0;
+    uint_t n = 0;
+    maxDistance = std::min(maxDistance, voxelSize_);
+    matData_t maxSquared = maxDistance * maxDistance;
+    int64_t x, y, z;
+    voxel_coordinates(query, voxelSize_, x, y, z);
+    for (int64_t dx = -1; dx <= 1; ++dx)
+      for (int64_t dy = -1; dy <= 1; ++dy)
+        for (int64_t dz = -1; dz <= 1; ++dz)
+        {
+            auto it = voxelIndex_.find(voxel_key(x + dx, y + dy, z + dz));
+            if (it == voxelIndex_.end())
+                continue;
+            for (uint_t i = voxelStart_[it->second]; i < voxelStart_[it->second + 1]; ++i)
+            {
+                const matData_t *p = &points_[3*i];
+                matData_t ex = p[0] - query(0), ey = p[1] - query(1), ez = p[2] - query(2);
+                matData_t d2 = ex*ex + ey*ey + ez*ez;
+                if (d2 < maxSquared)
+                    n = insert_neighbour(indexes_[i], d2, k, n, indexes, squaredDistances);
+            }
+        }
+    return n;
+}
+
+MatX VoxelHashGrid::get_voxel_centroids() const
+{
+    const long M = voxelIndex_.size();
+    MatX centroids(M, 3);
+    #pragma omp parallel for
+    for (long v = 0; v < M; ++v)
+    {
+        Mat31 sum = Mat31::Zero();
+        for (uint_t i = voxelStart_[v]; i < voxelStart_[v+1]; ++i)
+            sum += Mat31(points_[3*i], points_[3*i + 1], points_[3*i + 2]);
+        centroids.row(v) = sum.transpose() / (matData_t)(voxelStart_[v+1] - voxelStart_[v]);
+    }
+    return centroids;
+}
@@ -0,0 +1,446 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_PCRegistration.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/pc_registration.hpp"
+#include "mrob/spatial_index.hpp"
+#include "mrob/voxel_map.hpp"
+
+#include <iostream>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <limits>
+
+
+using namespace mrob;
+using namespace mrob::PCRegistration;
+
+static int failures = 0;
+
+void check(bool condition, const char *name)
+{
+    std::cout << (condition ? "[  OK  ] " : "[ FAIL ] ") << name << std::endl;
+    if (!condition)
+        failures++;
+}
+
+// Distance between the estimated and the true transformation
+double error_se3(const SE3 &T, const SE3 &Tgt)
+{
+    return (Tgt.inv() * T).ln_vee().norm();
+}
+
+// Corner of a room (floor and two walls) and a curved surface, N x 3
+MatX create_scene(uint_t N, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    MatX Y(N, 3);
+    for (uint_t i = 0; i < N; ++i)
+    {
+        double a = u(gen), b = u(gen);
+        switch (i % 4)
+        {
+            case 0: Y.row(i) << 4*a, 4*b, 0.0; break;
+            case 1: Y.row(i) << 0.0, 4*a, 2*b; break;
+            case 2: Y.row(i) << 4*a, 0.0, 2*b; break;
+            default: Y.row(i) << 1 + 2*a, 1 + 2*b, 0.5 + 0.3*std::sin(3*a)*std::cos(2*b);
+        }
+    }
+    return Y;
+}
+
+// Points of the scene observed from Tgt, X = Tgt^-1 Y
+MatX observe_scene(const MatX &Y, const SE3 &Tgt)
+{
+    MatX X(Y.rows(), 3);
+    for (long i = 0; i < Y.rows(); ++i)
+        X.row(i) = Tgt.inv().transform(Y.row(i).transpose()).transpose();
+    return X;
+}
+
+SE3 create_transformation()
+{
+    Mat61 xi;
+    xi << 0.02, -0.01, 0.03, 0.05, -0.04, 0.03;
+    return SE3(xi);
+}
+
+// Brute force k nearest neighbours (squared distances) of q in Y, closer than maxDistance
+std::vector<double> brute_force_knn(const MatX &Y, const Mat31 &q, uint_t k, double maxDistance)
+{
+    std::vector<double> distances;
+    for (long j = 0; j < Y.rows(); ++j)
+    {
+        double d = (Y.row(j).transpose() - q).squaredNorm();
+        if (d < maxDistance * maxDistance)
+            distances.push_back(d);
+    }
+    std::sort(distances.begin(), distances.end());
+    distances.resize(std::min<size_t>(k, distances.size()));
+    return distances;
+}
+
+// Spatial indexes against brute force
+void test_spatial_indexes()
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    const MatX Y = create_scene(6000, gen);
+    const uint_t k = 8, M = 300;
+    const double voxelSize = 0.3;
+    MatX Q(M, 3);
+    for (uint_t i = 0; i < M; ++i)
+        Q.row(i) << 2 + 2*u(gen), 2 + 2*u(gen), 1 + u(gen);
+    KDTree tree(Y);
+    VoxelHashGrid grid(Y, voxelSize);
+    MatXi indexesTree, indexesGrid;
+    MatX distancesTree, distancesGrid;
+    tree.knn_batch(Q, k, indexesTree, distancesTree);
+    grid.knn_batch(Q, k, indexesGrid, distancesGrid, voxelSize);
+    bool treeCorrect = true, gridCorrect = true;
+    for (uint_t i = 0; i < M; ++i)
+    {
+        const Mat31 q = Q.row(i).transpose();
+        std::vector<double> all = brute_force_knn(Y, q, k, 1e10);
+        std::vector<double> inVoxel = brute_force_knn(Y, q, k, voxelSize);
+        for (uint_t j = 0; j < k; ++j)
+        {
+            treeCorrect &= std::fabs(distancesTree(i,j) - all[j]) < 1e-12 &&
+                           (Y.row(indexesTree(i,j)).transpose() - q).squaredNorm() == distancesTree(i,j);
+            if (j < inVoxel.size())
+                gridCorrect &= std::fabs(distancesGrid(i,j) - inVoxel[j]) < 1e-12;
+            else
+                gridCorrect &= indexesGrid(i,j) == -1;
+        }
+    }
+    check(treeCorrect, "KDTree knn equals brute force");
+    check(gridCorrect, "VoxelHashGrid knn equals brute force within the voxel size");
+    bool thrown = false;
+    try
+    {
+        KDTree invalid(Y, 0);
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    check(thrown, "KDTree with a leaf size of 0 throws");
+}
+
+// Voxel downsampling on a hand-built cloud: one centroid per occupied voxel, in any order
+void test_voxel_downsample()
+{
+    MatX X(6, 3);
+    X << 0.1, 0.2, 0.3,     // voxel (0,0,0)
+         0.3, 0.4, 0.5,
+         0.5, 0.6, 0.1,
+        -0.2, 0.5, 0.5,     // voxel (-1,0,0)
+        -0.8, 0.1, 0.9,
+         2.5, 1.5,-0.5;     // voxel (2,1,-1)
+    MatX centroids(3, 3);
+    centroids << 0.3, 0.4, 0.3,
+                -0.5, 0.3, 0.7,
+                 2.5, 1.5,-0.5;
+    MatX D = voxel_downsample(X, 1.0);
+    bool sameCentroids = D.rows() == centroids.rows();
+    for (long i = 0; sameCentroids && i < centroids.rows(); ++i)
+    {
+        bool found = false;
+        for (long j = 0; j < D.rows(); ++j)
+            found |= (D.row(j) - centroids.row(i)).norm() < 1e-12;
+        sameCentroids &= found;
+    }
+    check(D.rows() == 3, "voxel_downsample returns one point per occupied voxel");
+    check(sameCentroids, "voxel_downsample returns the centroid of each voxel");
+}
+
+// ICP variants recover a known transformation
+void test_icp()
+{
+    std::mt19937 gen(2);
+    const MatX Y = create_scene(6000, gen);
+    const SE3 Tgt = create_transformation();
+    const MatX X = observe_scene(Y, Tgt);
+    {
+        SE3 T;
+        int iters = icp(X, Y, T, 0.5, 1e-8, 100);
+        check(iters > 0 && error_se3(T, Tgt) < 1e-4, "ICP point to point recovers T");
+    }
+    {
+        const MatX covX = estimate_covariances(X, 10), covY = estimate_covariances(Y, 10);
+        SE3 T;
+        int iters = icp_gicp(X, Y, covX, covY, T, 0.5, 1e-8, 100);
+        check(iters > 0 && error_se3(T, Tgt) < 1e-4, "ICP GICP recovers T");
+    }
+    {
+        // associated points, with the normals of X and Y
+        const MatX normalsX = estimate_normals(X, 10), normalsY = estimate_normals(Y, 10);
+        RegistrationOptions options;
+        options.tol = 1e-8;
+        SE3 T, Ts;
+        point_to_plane(X, Y, normalsY, T, options);
+        check(error_se3(T, Tgt) < 1e-4, "point_to_plane recovers T");
+        symmetric_point_plane(X, Y, normalsX, normalsY, Ts, options);
+        check(error_se3(Ts, Tgt) < 1e-4, "symmetric_point_plane recovers T");
+    }
+    for (auto method : {POINT_PLANE, SYMMETRIC_POINT_PLANE, GICP})
+    {
+        SE3 T;
+        std::vector<RegistrationStats> stats = icp_pyramid(X, Y, T, create_pyramid_levels(3, 0.0, 0.05), method);
+        check(stats.back().iterations > 0 && error_se3(T, Tgt) < 1e-4, "ICP pyramid (point to plane, symmetric, GICP) recovers T");
+    }
+}
+
+// Robust kernels with 30% outliers
+void test_robust_kernels()
+{
+    std::mt19937 gen(3);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::uniform_real_distribution<double> box(-2.0, 2.0);
+    const uint_t N = 2000;
+    Mat61 xi;
+    xi << 0.3, -0.2, 0.4, 0.5, -1.0, 0.3;
+    const SE3 T(xi);
+    MatX X(N, 3), Y(N, 3);
+    for (uint_t i = 0; i < N; ++i)
+    {
+        Mat31 p;
+        p << box(gen), box(gen), box(gen);
+        X.row(i) = p.transpose();
+        Mat31 q = T.transform(p) + Mat31(noise(gen), noise(gen), noise(gen));
+        if (i % 10 < 3)
+            q << 3*box(gen), 3*box(gen), 3*box(gen);
+        Y.row(i) = q.transpose();
+    }
+    MatX cov(3*N, 3);
+    for (uint_t i = 0; i < N; ++i)
+        cov.block<3,3>(3*i, 0) = Mat3::Identity()*1e-4;
+    for (auto kernel : {HUBER, CAUCHY, GEMAN_MCCLURE})
+    {
+        RegistrationOptions options;
+        options.kernel = kernel;
+        options.kernelWidth = 0.05;
+        options.useLM = true;
+        options.maxIters = 50;
+        SE3 Tw;
+        RegistrationStats stats = weighted_point(X, Y, MatX1::Ones(N), Tw, options);
+        check(stats.converged && std::fabs(stats.inlierRatio - 0.7) < 0.01 && error_se3(Tw, T) < 5e-3,
+              "weighted_point with robust kernel and 30% outliers");
+        options.kernelWidth = 3.0;
+        SE3 Tg;
+        stats = gicp(X, Y, cov, cov, Tg, options);
+        check(stats.converged && error_se3(Tg, T) < 5e-3, "gicp with robust kernel and 30% outliers");
+    }
+    RegistrationOptions options;
+    SE3 Tq;
+    weighted_point(X, Y, MatX1::Ones(N), Tq, options);
+    check(error_se3(Tq, T) > 0.1, "weighted_point without kernel is biased by the outliers");
+}
+
+// RANSAC with 60% outliers, deterministic for a given seed
+void test_ransac()
+{
+    std::mt19937 gen(4);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::uniform_real_distribution<double> box(-5.0, 5.0);
+    const uint_t N = 1000;
+    Mat61 xi;
+    xi << 0.7, -0.5, 1.2, 2.0, -1.0, 3.0;
+    const SE3 T(xi);
+    MatX X(N, 3), Y(N, 3);
+    std::vector<int> isInlier(N);
+    for (uint_t i = 0; i < N; ++i)
+    {
+        Mat31 p;
+        p << box(gen), box(gen), box(gen);
+        X.row(i) = p.transpose();
+        Mat31 q = T.transform(p) + Mat31(noise(gen), noise(gen), noise(gen));
+        isInlier[i] = i % 5 < 2;
+        if (!isInlier[i])
+            q << box(gen), box(gen), box(gen);
+        Y.row(i) = q.transpose();
+    }
+    RansacOptions options;
+    options.threshold = 0.05;
+    SE3 Tr;
+    std::vector<uint_t> inliers;
+    ransac_arun(X, Y, Tr, inliers, options);
+    uint_t correct = 0;
+    for (uint_t i : inliers)
+        correct += isInlier[i];
+    check(inliers.size() >= 0.95*0.4*N && correct == inliers.size() && error_se3(Tr, T) < 5e-3,
+          "RANSAC Arun with 60% outliers");
+    SE3 Tr2;
+    std::vector<uint_t> inliers2;
+    ransac_arun(X, Y, Tr2, inliers2, options);
+    check(inliers == inliers2 && (Tr.T() - Tr2.T()).norm() == 0.0, "RANSAC is deterministic for a seed");
+
+    // PROSAC on correspondences sorted by quality with 85% outliers, most of them ranked last:
+    // 90% inliers on the top 100 and 60 inliers among the rest
+    std::vector<int> isInlierSorted(N);
+    for (uint_t i = 0; i < N; ++i)
+    {
+        Mat31 p;
+        p << box(gen), box(gen), box(gen);
+        X.row(i) = p.transpose();
+        Mat31 q = T.transform(p) + Mat31(noise(gen), noise(gen), noise(gen));
+        isInlierSorted[i] = i < 100 ? i % 10 != 0 : i % 15 == 0;
+        if (!isInlierSorted[i])
+            q << box(gen), box(gen), box(gen);
+        Y.row(i) = q.transpose();
+    }
+    // smallest budget of hypotheses (doubling) that recovers the model
+    auto hypotheses_to_solve = [&](bool prosac) -> uint_t
+    {
+        options.prosac = prosac;
+        for (options.maxIterations = 16; options.maxIterations <= 16384; options.maxIterations *= 2)
+        {
+            SE3 Ts;
+            std::vector<uint_t> inliersSorted;
+            ransac_arun(X, Y, Ts, inliersSorted, options);
+            uint_t correctSorted = 0;
+            for (uint_t i : inliersSorted)
+                correctSorted += isInlierSorted[i];
+            if (inliersSorted.size() >= 0.95*150 && correctSorted == inliersSorted.size() && error_se3(Ts, T) < 5e-3)
+                return options.maxIterations;
+        }
+        return std::numeric_limits<uint_t>::max();
+    };
+    uint_t hypothesesProsac = hypotheses_to_solve(true), hypothesesUniform = hypotheses_to_solve(false);
+    check(hypothesesProsac < std::numeric_limits<uint_t>::max(), "PROSAC Arun with 85% outliers sorted by quality");
+    check(hypothesesProsac <= hypothesesUniform, "PROSAC requires no more hypotheses than uniform sampling");
+}
+
+// ArunAccumulator: merging partial accumulators equals Arun on all points, far from the origin
+void test_arun_accumulator()
+{
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    const SE3 Tgt = create_transformation();
+    const uint_t N = 500;
+    MatX X(N, 3), Y(N, 3);
+    for (uint_t i = 0; i < N; ++i)
+    {
+        Mat31 p;
+        p << 1e4 + u(gen), -1e4 + 2*u(gen), 1e3 + 3*u(gen);
+        X.row(i) = p.transpose();
+        Y.row(i) = (Tgt.transform(p) + Mat31(noise(gen), noise(gen), noise(gen))).transpose();
+    }
+    SE3 Tall;
+    arun(X, Y, Tall);
+    ArunAccumulator first, second, empty;
+    for (uint_t i = 0; i < N; ++i)
+    {
+        if (i < N/3)
+            first.add(X.row(i).transpose(), Y.row(i).transpose());
+        else
+            second.add(X.row(i).transpose(), Y.row(i).transpose());
+    }
+    first.merge(second);
+    first.merge(empty);
+    empty.merge(first);
+    SE3 Tmerged, TmergedEmpty;
+    int solved = first.solve(Tmerged) && empty.solve(TmergedEmpty);
+    check(solved && first.get_number_points() == N && (Tmerged.T() - Tall.T()).norm() < 1e-6 &&
+          (TmergedEmpty.T() - Tall.T()).norm() < 1e-6, "ArunAccumulator::merge equals arun");
+}
+
+// Scans registered against a VoxelMap, and the map bounded by the radius
+void test_voxel_map()
+{
+    std::mt19937 gen(6);
+    const MatX Y = create_scene(20000, gen);
+    const SE3 Tgt = create_transformation();
+    VoxelMap map(0.3, 8.0);
+    map.insert(Y, SE3());
+    SE3 T;
+    // voxel means are biased on corners and curved surfaces, so the solution is close to T (about 5 mm)
+    RegistrationStats stats = map.register_scan(observe_scene(Y, Tgt), T, 30);
+    check(stats.iterations > 0 && stats.iterations < 30 && error_se3(T, Tgt) < 1e-2, "VoxelMap::register_scan recovers T");
+    Mat61 xi;
+    // removal passes run once the sensor has moved a tenth of the radius (0.8)
+    const uint_t numberVoxels = map.get_number_voxels();
+    xi << 0, 0, 0, 9.0, 0, 0;
+    map.insert(MatX(0, 3), SE3(xi));
+    const uint_t afterPass = map.get_number_voxels();
+    xi << 0, 0, 0, 9.7, 0, 0;
+    map.insert(MatX(0, 3), SE3(xi));
+    const bool deferred = map.get_number_voxels() == afterPass;
+    xi << 0, 0, 0, 9.9, 0, 0;
+    map.insert(MatX(0, 3), SE3(xi));
+    check(afterPass < numberVoxels && deferred && map.get_number_voxels() < afterPass,
+          "VoxelMap removal passes are amortized over the sensor motion");
+    xi << 0, 0, 0, 20.0, 0, 0;
+    map.insert(MatX(0, 3), SE3(xi));
+    check(map.get_number_voxels() == 0, "VoxelMap removes the voxels out of the radius");
+}
+
+// VoxelMap knn of voxel means against brute force
+void test_voxel_map_knn()
+{
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    const MatX Y = create_scene(6000, gen);
+    const uint_t k = 8, M = 300;
+    const double maxDistance = 0.5;
+    VoxelMap map(0.2, 100.0, 1, 1e-3, VoxelMap::MEANS);
+    map.insert(Y, SE3());
+    const MatX means = map.get_means();
+    bool correct = true;
+    bool unbounded = true;
+    for (uint_t i = 0; i < M; ++i)
+    {
+        const Mat31 q(2 + 2*u(gen), 2 + 2*u(gen), 1 + u(gen));
+        std::vector<double> inMap = brute_force_knn(means, q, k, maxDistance);
+        Mat31 neighbours[k];
+        matData_t distances[k];
+        uint_t n = map.knn(q, k, neighbours, distances, maxDistance);
+        correct &= n == inMap.size();
+        for (uint_t j = 0; j < n && j < inMap.size(); ++j)
+            correct &= std::fabs(distances[j] - inMap[j]) < 1e-12 &&
+                       std::fabs((neighbours[j] - q).squaredNorm() - distances[j]) < 1e-12;
+        // without a maximum distance, the neighbours are the k closest means
+        std::vector<double> all = brute_force_knn(means, q, k, 1e10);
+        n = map.knn(q, k, neighbours, distances, std::numeric_limits<matData_t>::infinity());
+        unbounded &= n == k;
+        for (uint_t j = 0; j < n; ++j)
+            unbounded &= std::fabs(distances[j] - all[j]) < 1e-12;
+    }
+    check(correct, "VoxelMap knn of voxel means equals brute force");
+    check(unbounded, "VoxelMap knn with an infinite distance equals brute force");
+}
+
+int main()
+{
+    test_spatial_indexes();
+    test_voxel_downsample();
+    test_icp();
+    test_robust_kernels();
+    test_ransac();
+    test_arun_accumulator();
+    test_voxel_map();
+    test_voxel_map_knn();
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,214 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_loam.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/loam.hpp"
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+
+using namespace mrob;
+
+static int failures = 0;
+
+void check(bool condition, const char *name)
+{
+    std::cout << (condition ? "[  OK  ] " : "[ FAIL ] ") << name << std::endl;
+    if (!condition)
+        failures++;
+}
+
+/**
+ * Range of a ray from o along the unit direction d on a hall: floor, ceiling, four walls,
+ * two rows of pillars and a crate. Returns maxRange if there is no hit.
+ */
+const double maxRange = 80.0;
+double cast_ray(const Mat31 &o, const Mat31 &d)
+{
+    double range = maxRange;
+    auto plane = [&](uint_t axis, double offset)
+    {
+        if (std::fabs(d(axis)) < 1e-9)
+            return;
+        double t = (offset - o(axis)) / d(axis);
+        if (t > 0.5 && t < range)
+            range = t;
+    };
+    plane(2, 0.0);
+    plane(2, 5.0);
+    plane(0, -20.0);
+    plane(0, 70.0);
+    plane(1, -10.0);
+    plane(1, 10.0);
+    // pillars of radius 0.4 every 6 m
+    const double a = d(0)*d(0) + d(1)*d(1);
+    for (int k = -3; k < 12 && a > 1e-12; ++k)
+        for (int side = -1; side <= 1; side += 2)
+        {
+            const double dx = o(0) - 6.0*k, dy = o(1) - 4.0*side;
+            const double b = 2*(dx*d(0) + dy*d(1)), c = dx*dx + dy*dy - 0.16;
+            const double disc = b*b - 4*a*c;
+            if (disc < 0)
+                continue;
+            double t = (-b - std::sqrt(disc)) / (2*a);
+            if (t > 0.5 && t < range)
+                range = t;
+        }
+    // crate of 2 x 2 x 1.5 (slab method)
+    const Mat31 low(14.0, -7.0, 0.0), high(16.0, -5.0, 1.5);
+    double tmin = 0.0, tmax = range;
+    bool hit = true;
+    for (uint_t axis = 0; axis < 3; ++axis)
+    {
+        if (std::fabs(d(axis)) < 1e-12)
+        {
+            hit &= o(axis) >= low(axis) && o(axis) <= high(axis);
+            continue;
+        }
+        double t1 = (low(axis) - o(axis)) / d(axis), t2 = (high(axis) - o(axis)) / d(axis);
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+    }
+    if (hit && tmin < tmax && tmin > 0.5)
+        range = tmin;
+    return range;
+}
+
+/**
+ * Scan of a spinning lidar at pose T, in the sensor frame. Beams cover elevations in [-24.8, 2] deg,
+ * and the points of each ring are ordered by azimuth in [-pi, pi)
+ */
+MatX create_scan(const SE3 &T, uint_t numberBeams, uint_t numberAzimuths, std::mt19937 &gen,
+                 std::vector<uint_t> &rings)
+{
+    std::normal_distribution<double> noise(0.0, 0.01);
+    std::vector<Mat31> points;
+    rings.clear();
+    for (uint_t b = 0; b < numberBeams; ++b)
+    {
+        const double elevation = (-24.8 + b * 26.8 / (numberBeams - 1)) * M_PI / 180.0;
+        for (uint_t a = 0; a < numberAzimuths; ++a)
+        {
+            const double azimuth = -M_PI + a * 2.0 * M_PI / numberAzimuths;
+            Mat31 d(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth), std::sin(elevation));
+            double range = cast_ray(T.t(), T.R() * d);
+            if (range >= maxRange)
+                continue;
+            points.push_back(d * (range + noise(gen)));
+            rings.push_back(b);
+        }
+    }
+    MatX P(points.size(), 3);
+    for (uint_t i = 0; i < points.size(); ++i)
+        P.row(i) = points[i].transpose();
+    return P;
+}
+
+/**
+ * Counts the features of each (ring, sector). Sectors divide the points of a ring, ordered by
+ * azimuth and without the 5 points at each end, in 6 parts (as Loam::extract_ring_features)
+ */
+typedef std::tuple<double, double, double> PointKey;
+std::map<std::pair<uint_t, uint_t>, uint_t> count_sectors(const MatX &points, const std::vector<uint_t> &rings,
+                                                          const MatX &features)
+{
+    std::vector<uint_t> ringSize(*std::max_element(rings.begin(), rings.end()) + 1, 0);
+    std::map<PointKey, std::pair<uint_t, uint_t>> position;// ring and index in the ring of each point
+    for (uint_t i = 0; i < rings.size(); ++i)
+        position[PointKey(points(i,0), points(i,1), points(i,2))] = std::make_pair(rings[i], ringSize[rings[i]]++);
+    std::map<std::pair<uint_t, uint_t>, uint_t> count;
+    for (long i = 0; i < features.rows(); ++i)
+    {
+        auto p = position.at(PointKey(features(i,0), features(i,1), features(i,2)));
+        const uint_t K = 5, N = ringSize[p.first];
+        uint_t sector = 0;
+        while (sector < 5 && p.second >= K + (N - 2*K) * (sector + 1) / 6)
+            sector++;
+        count[std::make_pair(p.first, sector)]++;
+    }
+    return count;
+}
+
+uint_t max_count(const std::map<std::pair<uint_t, uint_t>, uint_t> &count)
+{
+    uint_t maxCount = 0;
+    for (auto &c : count)
+        maxCount = std::max(maxCount, c.second);
+    return maxCount;
+}
+
+/**
+ * LOAM on a synthetic sequence of scans with known motion.
+ * Usage: test_loam [beams azimuths scans], by default a reduced sequence of 32 x 900 points per
+ * scan and 30 scans. The complete benchmark is test_loam 64 1800 100.
+ */
+int main(int argc, char *argv[])
+{
+    uint_t numberBeams = 32, numberAzimuths = 900, numberScans = 30;
+    if (argc == 4)
+    {
+        numberBeams = std::atoi(argv[1]);
+        numberAzimuths = std::atoi(argv[2]);
+        numberScans = std::atoi(argv[3]);
+    }
+    std::mt19937 gen(1);
+    Loam loam;
+    uint_t maxSharp = 0, maxLessSharp = 0, maxFlat = 0, numberSharp = 0, numberFlat = 0;
+    double maxError = 0.0, totalTime = 0.0;
+    SE3 firstPose;
+    for (uint_t s = 0; s < numberScans; ++s)
+    {
+        // forward motion of about 0.125 m per scan, with lateral and yaw oscillations
+        Mat61 xi;
+        xi << 0, 0, 0.3*std::sin(0.03*s), 0.125*s, 1.0*std::sin(0.02*s), 1.7;
+        const SE3 Tgt(xi);
+        if (s == 0)
+            firstPose = Tgt;
+        std::vector<uint_t> rings;
+        MatX P = create_scan(Tgt, numberBeams, numberAzimuths, gen, rings);
+
+        auto start = std::chrono::steady_clock::now();
+        SE3 T = loam.add_scan(P, rings);
+        totalTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        maxSharp = std::max(maxSharp, max_count(count_sectors(P, rings, loam.get_sharp_points())));
+        maxLessSharp = std::max(maxLessSharp, max_count(count_sectors(P, rings, loam.get_less_sharp_points())));
+        maxFlat = std::max(maxFlat, max_count(count_sectors(P, rings, loam.get_flat_points())));
+        numberSharp += loam.get_sharp_points().rows();
+        numberFlat += loam.get_flat_points().rows();
+        // the trajectory starts at the identity, the first pose of the sensor
+        maxError = std::max(maxError, ((firstPose.inv() * Tgt).inv() * T).ln_vee().norm());
+    }
+    std::cout << numberScans << " scans of " << numberBeams << " x " << numberAzimuths << " rays, "
+              << 1e3 * totalTime / numberScans << " ms per scan, maximum error " << maxError << std::endl;
+
+    check(numberSharp > 0 && numberFlat > 0 && maxSharp == 2 && maxLessSharp <= 20 && maxFlat == 4,
+          "LOAM features per sector: at most 2 sharp, 20 less sharp and 4 flat");
+    check(loam.get_number_poses() == numberScans && maxError < 0.05, "LOAM follows the trajectory");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
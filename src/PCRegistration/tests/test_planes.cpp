@@ -0,0 +1,452 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * test_planes.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+
+#include "mrob/plane_registration.hpp"
+#include "mrob/plane_eigen_solver.hpp"
+#include "mrob/plane_odometry.hpp"
+#include "mrob/plane_segmentation.hpp"
+
+#include <Eigen/Eigenvalues>
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+using namespace mrob;
+
+static int failures = 0;
+
+void check(bool condition, const char *name)
+{
+    std::cout << (condition ? "[  OK  ] " : "[ FAIL ] ") << name << std::endl;
+    if (!condition)
+        failures++;
+}
+
+// Point on plane id of a room: planes are orthogonal to the axis id % 3, at a distance id / 3
+Mat31 plane_point(uint_t id, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 1e-3);
+    Mat31 p(u(gen), u(gen), u(gen));
+    p(id % 3) = (id / 3) + noise(gen);
+    return p;
+}
+
+// Planes observed from a trajectory interpolated from the identity to exp(xi), points in the sensor frame
+void create_planes(PlaneRegistration &reg, uint_t numberPlanes, uint_t numberPoses, uint_t numberPoints,
+                   const Mat61 &xi, std::mt19937 &gen)
+{
+    reg.set_number_planes_and_poses(numberPlanes, numberPoses);
+    for (uint_t id = 0; id < numberPlanes; ++id)
+        reg.add_new_plane(id);
+    for (uint_t t = 0; t < numberPoses; ++t)
+    {
+        const SE3 Tinv = SE3(Mat61(xi * double(t) / (numberPoses - 1))).inv();
+        for (uint_t id = 0; id < numberPlanes; ++id)
+            for (uint_t i = 0; i < numberPoints; ++i)
+            {
+                Mat31 p = Tinv.transform(plane_point(id, gen));
+                reg.plane_push_back_point(id, t, p);
+            }
+    }
+}
+
+double error_se3(const SE3 &T, const SE3 &Tgt)
+{
+    return (Tgt.inv() * T).ln_vee().norm();
+}
+
+// L-BFGS and nonlinear CG reach the solution of LM
+void test_first_order_methods()
+{
+    Mat61 xi;
+    xi << 0.02, -0.03, 0.01, 0.1, -0.05, 0.05;
+    double errorLM;
+    {
+        std::mt19937 gen(1);
+        PlaneRegistration reg;
+        create_planes(reg, 6, 4, 50, xi, gen);
+        reg.solve(PlaneRegistration::LM_ELLIP);
+        errorLM = reg.get_current_error();
+    }
+    for (auto mode : {PlaneRegistration::GRADIENT_LBFGS, PlaneRegistration::GRADIENT_CG})
+    {
+        std::mt19937 gen(1);
+        PlaneRegistration reg;
+        create_planes(reg, 6, 4, 50, xi, gen);
+        double errorInitial = reg.get_current_error();
+        reg.solve(mode);
+        double error = reg.get_current_error();
+        check(error < errorInitial && error < errorLM * (1.0 + 1e-3) && error_se3(reg.get_last_pose(), SE3(xi)) < 1e-3,
+              mode == PlaneRegistration::GRADIENT_LBFGS ? "L-BFGS converges on plane registration" :
+                                                         "nonlinear CG converges on plane registration");
+    }
+}
+
+// Access to the gradient and Hessian of the registration
+class PlaneRegistrationTest: public PlaneRegistration
+{
+  public:
+    const MatX1& get_gradient() const {return gradient_;}
+    const MatX& get_hessian() const {return hessian_;}
+};
+
+// The parallel evaluation of planes does not depend on the number of threads
+void test_parallel_planes()
+{
+#ifdef _OPENMP
+    Mat61 xi;
+    xi << 0.02, -0.03, 0.01, 0.1, -0.05, 0.05;
+    // two equal problems, since planes are estimated starting from their previous estimation
+    std::mt19937 gen(2), genParallel(2);
+    PlaneRegistrationTest reg, regParallel;
+    create_planes(reg, 60, 5, 20, xi, gen);
+    create_planes(regParallel, 60, 5, 20, xi, genParallel);
+    const int threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    double error = reg.get_current_error();
+    reg.calculate_gradient_hessian();
+    omp_set_num_threads(std::max(threads, 4));
+    double errorParallel = regParallel.get_current_error();
+    regParallel.calculate_gradient_hessian();
+    check(error == errorParallel && reg.get_gradient() == regParallel.get_gradient() &&
+          reg.get_hessian() == regParallel.get_hessian(), "plane evaluation is the same for 1 and several threads");
+    omp_set_num_threads(threads);
+#endif
+}
+
+// SUFFICIENT_STATISTICS planes reach the same solution as STORE_POINTS, without keeping points
+void test_sufficient_statistics()
+{
+    Mat61 xi;
+    xi << 0.02, -0.03, 0.01, 0.1, -0.05, 0.05;
+    const uint_t numberPlanes = 6, numberPoses = 4;
+    std::mt19937 gen(3), genStatistics(3);
+    PlaneRegistration points, statistics, batch;
+    create_planes(points, numberPlanes, numberPoses, 50, xi, gen);
+    statistics.set_points_mode(Plane::SUFFICIENT_STATISTICS);
+    create_planes(statistics, numberPlanes, numberPoses, 50, xi, genStatistics);
+    // the same points added by batches (N x 3)
+    batch.set_points_mode(Plane::SUFFICIENT_STATISTICS);
+    batch.set_number_planes_and_poses(numberPlanes, numberPoses);
+    for (uint_t id = 0; id < numberPlanes; ++id)
+    {
+        batch.add_new_plane(id);
+        for (uint_t t = 0; t < numberPoses; ++t)
+        {
+            std::vector<Mat31> &p = points.get_plane(id)->get_points(t);
+            MatX P(p.size(), 3);
+            for (uint_t i = 0; i < p.size(); ++i)
+                P.row(i) = p[i].transpose();
+            batch.plane_push_back_points(id, t, P);
+        }
+    }
+    check(statistics.get_plane(0)->get_points(0).empty() && statistics.get_plane(0)->get_number_points(0) == 50 &&
+          statistics.calculate_total_number_points() == points.calculate_total_number_points(),
+          "sufficient statistics count points without storing them");
+    double error = points.get_current_error();
+    check(std::fabs(statistics.get_current_error() - error) < 1e-9 * error &&
+          std::fabs(batch.get_current_error() - error) < 1e-9 * error, "sufficient statistics have the error of points");
+    points.solve(PlaneRegistration::LM_ELLIP);
+    statistics.solve(PlaneRegistration::LM_ELLIP);
+    batch.solve(PlaneRegistration::LM_ELLIP);
+    check(error_se3(statistics.get_last_pose(), points.get_last_pose()) < 1e-9 &&
+          error_se3(batch.get_last_pose(), points.get_last_pose()) < 1e-9, "sufficient statistics have the solution of points");
+}
+
+// Matrix S of N points on a rectangle of sides 1 and width, with thickness, and transformed by T
+Mat4 points_S(uint_t N, double width, double thickness, const SE3 &T, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    Mat4 S = Mat4::Zero();
+    for (uint_t i = 0; i < N; ++i)
+    {
+        Mat41 p;
+        p << T.transform(Mat31(u(gen), width * u(gen), thickness * u(gen))), 1.0;
+        S += p * p.transpose();
+    }
+    return S;
+}
+
+// min_eigenpair_4x4 against the complete eigen decomposition, also for rank deficient matrices
+void test_min_eigenpair()
+{
+    std::mt19937 gen(4);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::vector<Mat4> Q;
+    for (uint_t i = 0; i < 20; ++i)
+    {
+        Mat61 xi;
+        xi << u(gen), u(gen), u(gen), u(gen), u(gen), u(gen);
+        Q.push_back(points_S(50, 1.0, 1e-2, SE3(xi), gen));// plane with noise, full rank
+        Q.push_back(points_S(50, 1.0, 0.0, SE3(xi), gen));// exact plane, rank 3
+        Q.push_back(points_S(50, 0.0, 0.0, SE3(xi), gen));// line, rank 2
+    }
+    Q.push_back(Mat4::Zero());
+    bool correct = true, unique = true;
+    std::vector<Mat41> warm(Q.size());
+    for (uint_t i = 0; i < Q.size(); ++i)
+    {
+        Eigen::SelfAdjointEigenSolver<Mat4> es(Q[i]);
+        const Mat41 reference = es.eigenvectors().col(0);
+        const double scale = 1.0 + es.eigenvalues()(3);
+        warm[i] = reference + 0.1 * Mat41(u(gen), u(gen), u(gen), u(gen));
+        // warm start (close to the solution, as a previous iteration) and no warm start
+        for (Mat41 v : {warm[i], Mat41(Mat41::Zero())})
+        {
+            double lambda = min_eigenpair_4x4(Q[i], v);
+            correct &= std::fabs(lambda - es.eigenvalues()(0)) < 1e-9 * scale &&
+                       std::fabs(v.norm() - 1.0) < 1e-9 &&
+                       (Q[i] * v - lambda * v).norm() < 1e-6 * scale;
+            // the eigenvector is unique (up to sign) only if the minimum eigenvalue is simple
+            if (es.eigenvalues()(1) - es.eigenvalues()(0) > 1e-6 * scale)
+                unique &= std::fabs(std::fabs(v.dot(reference)) - 1.0) < 1e-9;
+        }
+    }
+    check(correct, "min_eigenpair_4x4 equals SelfAdjointEigenSolver, including rank deficient Q");
+    check(unique, "min_eigenpair_4x4 eigenvector equals SelfAdjointEigenSolver");
+    std::vector<Mat41> v = warm;
+    std::vector<double> lambda;
+    min_eigenpair_4x4_batch(Q, v, lambda);
+    bool batch = lambda.size() == Q.size();
+    for (uint_t i = 0; i < Q.size() && batch; ++i)
+    {
+        Mat41 single = warm[i];
+        batch &= min_eigenpair_4x4(Q[i], single) == lambda[i] && single == v[i];
+    }
+    check(batch, "min_eigenpair_4x4_batch equals min_eigenpair_4x4");
+}
+
+// Planes observed at some of the times only, and a trajectory that grows with new observations
+void test_sparse_observations()
+{
+    Mat61 xi;
+    xi << 0.02, -0.03, 0.01, 0.1, -0.05, 0.05;
+    const uint_t numberPlanes = 6, numberPoses = 6;
+    std::mt19937 gen(5);
+    PlaneRegistration batch, online;
+    batch.set_number_planes_and_poses(numberPlanes, numberPoses);
+    for (uint_t id = 0; id < numberPlanes; ++id)
+    {
+        batch.add_new_plane(id);
+        online.add_new_plane(id);
+    }
+    auto observe = [&gen](uint_t id, const SE3 &T)
+    {
+        MatX P(50, 3);
+        for (uint_t i = 0; i < 50; ++i)
+            P.row(i) = T.inv().transform(plane_point(id, gen)).transpose();
+        return P;
+    };
+    for (uint_t t = 0; t < numberPoses; ++t)
+    {
+        online.add_pose(SE3());
+        for (uint_t id = 0; id < numberPlanes; ++id)
+        {
+            if (t > 0 && (id + t) % 3 == 0)
+                continue;
+            MatX P = observe(id, SE3(Mat61(xi * double(t) / (numberPoses - 1))));
+            batch.plane_push_back_points(id, t, P);
+            online.plane_push_back_points(id, t, P);
+        }
+    }
+    check(online.get_number_poses() == numberPoses && batch.get_plane(0)->get_number_observations() == 5 &&
+          !batch.get_plane(0)->is_observed(3) && batch.get_plane(0)->get_number_points(3) == 0,
+          "planes keep only the times where they are observed");
+    batch.solve(PlaneRegistration::LM_ELLIP);
+    online.solve(PlaneRegistration::LM_ELLIP);
+    check(error_se3(batch.get_last_pose(), SE3(xi)) < 5e-3 && error_se3(online.get_last_pose(), batch.get_last_pose()) < 1e-9,
+          "plane registration with sparse observations");
+    // a new pose, observing all planes, extends the solved trajectory
+    uint_t t = online.add_pose(online.get_last_pose());
+    const Mat61 xiNew = 1.2 * xi;
+    for (uint_t id = 0; id < numberPlanes; ++id)
+        online.plane_push_back_points(id, t, observe(id, SE3(xiNew)));
+    online.solve(PlaneRegistration::LM_ELLIP);
+    check(online.get_number_poses() == numberPoses + 1 && error_se3(online.get_last_pose(), SE3(xiNew)) < 5e-3,
+          "plane registration on a growing trajectory");
+}
+
+// Sliding window odometry over a sequence of scans observing planes, with a known trajectory
+void test_plane_odometry()
+{
+    std::mt19937 gen(6);
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    const uint_t numberPlanes = 40, numberPoses = 60;
+    std::vector<Mat31> normals(numberPlanes), centers(numberPlanes);
+    for (uint_t i = 0; i < numberPlanes; ++i)
+    {
+        normals[i] << noise(gen), noise(gen), noise(gen);
+        normals[i].normalize();
+        centers[i] << 3*u(gen), 3*u(gen), 3*u(gen);
+    }
+    std::vector<SE3> gt;
+    for (uint_t t = 0; t < numberPoses; ++t)
+    {
+        Mat61 xi;
+        xi << 0.01*std::sin(0.1*t), 0.001*t, 0.01*std::cos(0.2*t), 0.03*t, 0.01*std::sin(0.3*t), 0.005*t;
+        gt.push_back(SE3(xi));
+    }
+    for (auto mode : {Plane::SUFFICIENT_STATISTICS, Plane::STORE_POINTS})
+    {
+        PlaneOdometry odometry(5, mode);
+        double maxError = 0.0;
+        uint_t maxActive = 0;
+        for (uint_t t = 0; t < numberPoses; ++t)
+        {
+            // each plane is observed on a part of the sequence, and sporadically
+            std::vector<Mat31> points;
+            std::vector<uint_t> ids;
+            for (uint_t i = 0; i < numberPlanes; ++i)
+            {
+                if (std::fabs(t - 1.2*i) > 12 && (t + i) % 7)
+                    continue;
+                Mat31 u1 = normals[i].unitOrthogonal(), u2 = normals[i].cross(u1);
+                for (uint_t k = 0; k < 20; ++k)
+                {
+                    Mat31 p = centers[i] + u(gen)*u1 + u(gen)*u2 + 0.005*noise(gen)*normals[i];
+                    points.push_back(gt[t].inv().transform(p));
+                    ids.push_back(i);
+                }
+            }
+            MatX P(points.size(), 3);
+            for (uint_t k = 0; k < points.size(); ++k)
+                P.row(k) = points[k].transpose();
+            odometry.add_scan(P, ids);
+            maxActive = std::max(maxActive, odometry.get_number_active_planes());
+            maxError = std::max(maxError, error_se3(odometry.get_pose(t), gt[0].inv() * gt[t]));
+        }
+        std::cout << "plane odometry, maximum error " << maxError << ", maximum active planes " << maxActive << std::endl;
+        check(odometry.get_number_poses() == numberPoses && odometry.get_number_planes() == numberPlanes &&
+              maxActive < numberPlanes && maxError < 0.01, "plane odometry follows the trajectory with a bounded window");
+    }
+}
+
+// Room of 10 x 8 x 3 (6 planes) with clutter inside, segmented into planes
+void create_room(std::vector<Mat31> &points, std::vector<int> &planeIds, std::mt19937 &gen)
+{
+    std::uniform_real_distribution<double> u(-1.0, 1.0);
+    std::normal_distribution<double> noise(0.0, 0.01);
+    for (uint_t k = 0; k < 30000; ++k)
+    {
+        double a = u(gen), b = u(gen);
+        Mat31 p;
+        switch (k % 6)
+        {
+            case 0: p << 5*a, 4*b, noise(gen); break;
+            case 1: p << 5*a, 4*b, 3 + noise(gen); break;
+            case 2: p << -5 + noise(gen), 4*a, 1.5 + 1.5*b; break;
+            case 3: p << 5 + noise(gen), 4*a, 1.5 + 1.5*b; break;
+            case 4: p << 5*a, -4 + noise(gen), 1.5 + 1.5*b; break;
+            default: p << 5*a, 4 + noise(gen), 1.5 + 1.5*b;
+        }
+        points.push_back(p);
+        planeIds.push_back(k % 6);
+    }
+    for (uint_t k = 0; k < 1500; ++k)
+    {
+        points.push_back(Mat31(4*u(gen), 3*u(gen), 1.5 + 1.4*u(gen)));
+        planeIds.push_back(-1);
+    }
+}
+
+void test_plane_segmentation()
+{
+    std::mt19937 gen(7);
+    std::vector<Mat31> points;
+    std::vector<int> gtIds;
+    create_room(points, gtIds, gen);
+    MatX P(points.size(), 3);
+    for (uint_t i = 0; i < points.size(); ++i)
+        P.row(i) = points[i].transpose();
+    PlaneSegmentation segmentation(1.0, 0.05, 0.17, 10, 100);
+    uint_t numberPlanes = segmentation.segment(P);
+    // each segmented plane is one of the planes of the room, and it contains most of its points
+    bool correct = numberPlanes == 6;
+    for (uint_t j = 0; j < numberPlanes && correct; ++j)
+    {
+        std::vector<uint_t> count(7, 0);
+        for (uint_t i = 0; i < points.size(); ++i)
+            if (segmentation.get_point_ids()[i] == j)
+                count[gtIds[i] + 1]++;
+        uint_t total = 0, best = 1;
+        for (uint_t k = 0; k < 7; ++k)
+        {
+            total += count[k];
+            if (count[k] > count[best])
+                best = k;
+        }
+        correct &= best > 0 && count[best] > 0.95 * 5000 && count[best] > 0.99 * total &&
+                   std::fabs(segmentation.get_matrices_S()[j](3,3) - total) < 1e-9;
+    }
+    check(correct, "plane segmentation finds the planes of a room");
+}
+
+// Planes from a segmentation, added by their matrices S to a default PlaneRegistration
+void test_segmentation_registration()
+{
+    std::mt19937 gen(8);
+    std::vector<Mat31> points;
+    std::vector<int> gtIds;
+    create_room(points, gtIds, gen);
+    Mat61 xi;
+    xi << 0.02, -0.01, 0.03, 0.1, -0.05, 0.02;
+    const SE3 T(xi);
+    PlaneRegistration reg;
+    for (uint_t t = 0; t < 2; ++t)
+    {
+        // the second scan is observed from T, plane ids are associated by the ground truth
+        MatX P(points.size(), 3);
+        for (uint_t i = 0; i < points.size(); ++i)
+            P.row(i) = (t == 0 ? points[i] : T.inv().transform(points[i])).transpose();
+        PlaneSegmentation segmentation(1.0, 0.05, 0.17, 10, 100);
+        uint_t numberPlanes = segmentation.segment(P);
+        std::vector<uint_t> ids(numberPlanes);
+        for (uint_t i = 0; i < points.size(); ++i)
+            if (segmentation.get_point_ids()[i] != PlaneSegmentation::NO_PLANE && gtIds[i] >= 0)
+                ids[segmentation.get_point_ids()[i]] = gtIds[i];
+        reg.add_planes_matrix_S(t, ids, segmentation.get_matrices_S());
+    }
+    check(reg.get_plane(0)->get_points_mode() == Plane::SUFFICIENT_STATISTICS && reg.get_point_cloud(0).empty(),
+          "planes from matrices S are sufficient statistics");
+    reg.solve(PlaneRegistration::LM_ELLIP);
+    check(error_se3(reg.get_last_pose(), T) < 1e-2, "plane registration from a plane segmentation");
+}
+
+int main()
+{
+    test_first_order_methods();
+    test_parallel_planes();
+    test_sufficient_statistics();
+    test_min_eigenpair();
+    test_sparse_observations();
+    test_plane_odometry();
+    test_plane_segmentation();
+    test_segmentation_registration();
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
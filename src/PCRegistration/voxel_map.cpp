@@ -0,0 +1,282 @@
+/* Copyright (c) 2018, Skolkovo Institute of Science and Technology (Skoltech)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * voxel_map.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#include <Eigen/Eigenvalues>
+
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+#include <limits>
+#include <algorithm>
+#include "mrob/voxel_map.hpp"
+
+
+using namespace mrob;
+
+// fraction of the radius that the sensor moves between passes removing the voxels out of the radius
+const matData_t removalFraction = 0.1;
+
+VoxelMap::VoxelMap(double voxelSize, double radius, uint_t minPointsVoxel, double e, VoxelMap::mapMode mode):
+        voxelSize_(voxelSize), radius_(radius), e_(e), minPointsVoxel_(minPointsVoxel), mode_(mode),
+        lastRemoval_(Mat31::Zero()), removed_(false)
+{
+    reset_box();
+    assert(voxelSize_ > 0.0 && "VoxelMap: voxel size must be positive");
+    assert((mode_ == MEANS || minPointsVoxel_ >= 3) && "VoxelMap: at least 3 points per voxel are required");
+}
+
+VoxelMap::~VoxelMap()
+{
+}
+
+void VoxelMap::clear()
+{
+    voxels_.clear();
+    updatedVoxels_.clear();
+    removed_ = false;
+    reset_box();
+}
+
+void VoxelMap::reset_box()
+{
+    std::fill(boxMin_, boxMin_ + 3, std::numeric_limits<int64_t>::max());
+    std::fill(boxMax_, boxMax_ + 3, std::numeric_limits<int64_t>::min());
+}
+
+void VoxelMap::update_box(uint64_t key)
+{
+    int64_t coordinates[3];
+    voxel_key_coordinates(key, coordinates[0], coordinates[1], coordinates[2]);
+    for (uint_t a = 0; a < 3; ++a)
+    {
+        boxMin_[a] = std::min(boxMin_[a], coordinates[a]);
+        boxMax_[a] = std::max(boxMax_[a], coordinates[a]);
+    }
+}
+
+void VoxelMap::insert(const Eigen::Ref<const MatX> &points, const SE3 &T)
+{
+    assert(points.cols() == 3  && "VoxelMap::insert: Incorrect sizing, we expect Nx3");
+    const long N = points.rows();
+
+    // 1) Welford update of the voxel of each point, amortized O(1) per point
+    updatedVoxels_.clear();
+    for (long i = 0; i < N; ++i)
+    {
+        const Mat31 p = T.transform(points.row(i).transpose());
+        auto inserted = voxels_.emplace(voxel_key(p, voxelSize_), Voxel());
+        if (inserted.second)
+            update_box(inserted.first->first);
+        Voxel &voxel = inserted.first->second;
+        voxel.N++;
+        const Mat31 delta = p - voxel.mean;
+        voxel.mean += delta / (matData_t)voxel.N;
+        if (mode_ == MEANS)
+            continue;
+        voxel.M2.noalias() += delta * (p - voxel.mean).transpose();
+        if (!voxel.updated)
+        {
+            voxel.updated = true;
+            updatedVoxels_.push_back(&voxel);
+        }
+    }
+
+    // 2) regularized covariances of the updated voxels, in parallel
+    const long numberUpdated = updatedVoxels_.size();
+    #pragma omp parallel for schedule(dynamic, 64)
+    for (long v = 0; v < numberUpdated; ++v)
+    {
+        Voxel &voxel = *updatedVoxels_[v];
+        voxel.updated = false;
+        if (voxel.N < minPointsVoxel_)
+            continue;
+        Eigen::SelfAdjointEigenSolver<Mat3> es(voxel.M2 / (matData_t)voxel.N);
+        Mat31 normal = es.eigenvectors().col(0);
+        voxel.covariance = Mat3::Identity() - (1.0 - e_) * normal * normal.transpose();
+    }
+
+    // 3) sliding radius, a pass over the map removes the voxels out of the radius. Passes run once the
+    // sensor has moved a fraction of the radius (and at least a voxel), so their O(voxels) cost is
+    // amortized over the scans along that distance. The bounding box of the voxels is recomputed.
+    const Mat31 sensor = T.t();
+    const matData_t removalDistance = std::max<matData_t>(voxelSize_, removalFraction * radius_);
+    if (!removed_ || (sensor - lastRemoval_).norm() > removalDistance)
+    {
+        const matData_t radius2 = radius_ * radius_;
+        reset_box();
+        for (auto it = voxels_.begin(); it != voxels_.end(); )
+        {
+            if ((it->second.mean - sensor).squaredNorm() > radius2)
+                it = voxels_.erase(it);
+            else
+            {
+                update_box(it->first);
+                ++it;
+            }
+        }
+        lastRemoval_ = sensor;
+        removed_ = true;
+    }
+}
+
+const VoxelMap::Voxel* VoxelMap::find_closest_voxel(const Mat31 &p) const
+{
+    int64_t x, y, z;
+    voxel_coordinates(p, voxelSize_, x, y, z);
+    const Voxel *closest = nullptr;
+    matData_t closestDistance = voxelSize_ * voxelSize_;
+    for (int64_t dx = -1; dx <= 1; ++dx)
+        for (int64_t dy = -1; dy <= 1; ++dy)
+            for (int64_t dz = -1; dz <= 1; ++dz)
+            {
+                auto it = voxels_.find(voxel_key(x + dx, y + dy, z + dz));
+                if (it == voxels_.end() || it->second.N < minPointsVoxel_)
+                    continue;
+                matData_t d = (it->second.mean - p).squaredNorm();
+                if (d < closestDistance)
+                {
+                    closestDistance = d;
+                    closest = &it->second;
+                }
+            }
+    return closest;
+}
+
+uint_t VoxelMap::knn(const Mat31 &query, uint_t k, Mat31 *means, matData_t *squaredDistances, matData_t maxDistance) const
+{
+    if (voxels_.empty())
+        return 0;
+    int64_t x, y, z;
+    voxel_coordinates(query, voxelSize_, x, y, z);
+    const matData_t maxDistance2 = maxDistance * maxDistance;
+    // rings out of the bounding box of the voxels are empty, which bounds them for an infinite maxDistance
+    const int64_t coordinates[3] = {x, y, z};
+    int64_t boxRings = 0;
+    for (uint_t a = 0; a < 3; ++a)
+        boxRings = std::max(boxRings, std::max(coordinates[a] - boxMin_[a], boxMax_[a] - coordinates[a]));
+    const matData_t distanceRings = std::ceil(maxDistance / voxelSize_);
+    const int64_t rings = distanceRings < (matData_t)boxRings ? (int64_t)distanceRings : boxRings;
+    // squared distance from the query to the voxel at offset d along an axis
+    auto axis_distance = [this](matData_t q, int64_t voxel, int64_t d) -> matData_t
+    {
+        if (d == 0)
+            return 0.0;
+        const matData_t gap = d > 0 ? (voxel + d) * voxelSize_ - q : q - (voxel + d + 1) * voxelSize_;
+        return gap * gap;
+    };
+    uint_t n = 0;
+    for (int64_t r = 0; r <= rings; ++r)
+    {
+        // voxels on the ring r (Chebyshev distance), only the faces dz = +-r inside the ring.
+        // Voxels farther than maxDistance or the k-th neighbour are not looked up
+        for (int64_t dx = -r; dx <= r; ++dx)
+            for (int64_t dy = -r; dy <= r; ++dy)
+            {
+                const matData_t dxy = axis_distance(query(0), x, dx) + axis_distance(query(1), y, dy);
+                const int64_t step = (std::abs(dx) == r || std::abs(dy) == r) ? 1 : 2*r;
+                for (int64_t dz = -r; dz <= r; dz += step)
+                {
+                    const matData_t bound = dxy + axis_distance(query(2), z, dz);
+                    if (bound >= maxDistance2 || (n == k && bound >= squaredDistances[k-1]))
+                        continue;
+                    auto it = voxels_.find(voxel_key(x + dx, y + dy, z + dz));
+                    if (it == voxels_.end() || it->second.N < minPointsVoxel_)
+                        continue;
+                    const matData_t d = (it->second.mean - query).squaredNorm();
+                    if (d >= maxDistance2 || (n == k && d >= squaredDistances[k-1]))
+                        continue;
+                    // sorted insertion, the farthest is dropped when full
+                    uint_t j = n < k ? n++ : k - 1;
+                    for ( ; j > 0 && squaredDistances[j-1] > d; --j)
+                    {
+                        squaredDistances[j] = squaredDistances[j-1];
+                        means[j] = means[j-1];
+                    }
+                    squaredDistances[j] = d;
+                    means[j] = it->second.mean;
+                }
+            }
+        // voxels on the next rings are at least r * voxelSize far
+        const matData_t ringDistance = r * voxelSize_;
+        if (n == k && squaredDistances[k-1] <= ringDistance * ringDistance)
+            break;
+    }
+    return n;
+}
+
+PCRegistration::RegistrationStats VoxelMap::register_scan(const Eigen::Ref<const MatX> &points, SE3 &T,
+        uint_t maxIters, double tol, const PCRegistration::RegistrationOptions &options) const
+{
+    assert(points.cols() == 3  && "VoxelMap::register_scan: Incorrect sizing, we expect Nx3");
+    assert(mode_ == GAUSSIANS && "VoxelMap::register_scan: the map has no covariances");
+    const long N = points.rows();
+    std::vector<const Voxel*> association(N);
+    auto associate = [&](const SE3 &current, PCRegistration::Correspondences &c) -> uint_t
+    {
+        // lookups of the closest voxel in parallel, points have zero covariance
+        #pragma omp parallel for schedule(static)
+        for (long i = 0; i < N; ++i)
+            association[i] = find_closest_voxel(current.transform(points.row(i).transpose()));
+        uint_t M = 0;
+        for (long i = 0; i < N; ++i)
+            if (association[i] != nullptr)
+                M++;
+        c.X.resize(M, 3);
+        c.Y.resize(M, 3);
+        c.covX.setZero(3*M, 3);
+        c.covY.resize(3*M, 3);
+        for (long i = 0, j = 0; i < N; ++i)
+        {
+            if (association[i] == nullptr)
+                continue;
+            c.X.row(j) = points.row(i);
+            c.Y.row(j) = association[i]->mean.transpose();
+            c.covY.block<3,3>(3*j, 0) = association[i]->covariance;
+            j++;
+        }
+        return M;
+    };
+    return PCRegistration::icp_driver(associate, T, PCRegistration::GICP, tol, maxIters, options, 6);
+}
+
+MatX VoxelMap::get_means() const
+{
+    std::vector<const Voxel*> valid;
+    for (auto &v : voxels_)
+        if (v.second.N >= minPointsVoxel_)
+            valid.push_back(&v.second);
+    MatX means(valid.size(), 3);
+    for (uint_t i = 0; i < valid.size(); ++i)
+        means.row(i) = valid[i]->mean.transpose();
+    return means;
+}
+
+MatX VoxelMap::get_covariances() const
+{
+    assert(mode_ == GAUSSIANS && "VoxelMap::get_covariances: the map has no covariances");
+    std::vector<const Voxel*> valid;
+    for (auto &v : voxels_)
+        if (v.second.N >= minPointsVoxel_)
+            valid.push_back(&v.second);
+    MatX covariances(3*valid.size(), 3);
+    for (uint_t i = 0; i < valid.size(); ++i)
+        covariances.block<3,3>(3*i, 0) = valid[i]->covariance;
+    return covariances;
+}
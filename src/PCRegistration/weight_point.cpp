@@ -21,57 +21,87 @@
  *              Mobile Robotics Lab, Skoltech 
  */
 
-#include <Eigen/LU> // for inverse and determinant
-
 #include <memory>
 #include <iostream>
 #include "mrob/pc_registration.hpp"
+#include "mrob/registration_solver.hpp"
 
 
 using namespace mrob;
 
+namespace {
+
+/**
+ * Cost, gradient and Hessian of the weighted point registration at T, where each
+ * correspondence is weighted by w_i and the robust kernel K on s_i = w_i ||y - Tx||^2
+ */
+template<PCRegistration::robustKernel K>
+double weighted_point_evaluate(const Eigen::Ref<const MatX> &X, const Eigen::Ref<const MatX> &Y,
+        const Eigen::Ref<const MatX1> &weight, const SE3 &T, matData_t c2, Mat61 &J, Mat6 &H, uint_t &inliers)
+{
+    uint_t N = X.rows();
+    J.setZero();
+    H.setZero();
+    inliers = 0;
+    double cost = 0.0;
+    // not vectoried operations (due to Jacobian)
+    for ( uint_t i = 0; i < N ; ++i)
+    {
+        // 1) Calculate residual r = y - Tx and the robust weight
+        Mat31 Txi = T.transform(X.row(i));
+        Mat31 r = Y.row(i).transpose() - Txi;
+        matData_t s = weight(i) * r.squaredNorm();
+        cost += PCRegistration::robust_cost<K>(s, c2);
+        if (s < c2)
+            inliers++;
+        matData_t wi = weight(i) * PCRegistration::robust_weight<K>(s, c2);
+
+        // 2) Calculate Jacobian for residual Jf = df/d xi = w * r' Jr, where Jr = [(Tx)^ ; -I])
+        Mat<3,6> Jr;
+        Jr << hat3(Txi) , -Mat3::Identity();
+        Mat<1,6> Ji = wi * r.transpose() * Jr;
+        J += Ji;//Eigen manages this for us
+
+        // 3) Hessian Hi ~ w * Jr' * Jr
+        Mat6 Hi = wi * Jr.transpose() * Jr;
+        H += Hi;
+    }
+    return cost;
+}
+
+}
+
 int PCRegistration::weighted_point(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
            const Eigen::Ref<const MatX1> weight,  SE3 &T, double tol)
 {
-    assert(X.cols() == 3  && "PCRegistration::Gicp: Incorrect sizing, we expect Nx3");
-    assert(X.rows() >= 3  && "PCRegistration::Gicp: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
-    assert(Y.rows() == X.rows()  && "PCRegistration::Gicp: Same number of correspondences");
-    uint_t N = X.rows();
+    RegistrationOptions options;
+    options.tol = tol;
+    return weighted_point(X, Y, weight, T, options).iterations; // number of iterations
+}
+
+PCRegistration::RegistrationStats PCRegistration::weighted_point(const Eigen::Ref<const MatX> X, const Eigen::Ref<const MatX> Y,
+           const Eigen::Ref<const MatX1> weight,  SE3 &T, const RegistrationOptions &options)
+{
+    assert(X.cols() == 3  && "PCRegistration::weighted_point: Incorrect sizing, we expect Nx3");
+    assert(X.rows() >= 3  && "PCRegistration::weighted_point: Incorrect sizing, we expect at least 3 correspondences (not aligned)");
+    assert(Y.rows() == X.rows()  && "PCRegistration::weighted_point: Same number of correspondences");
     // TODO precalculation of T by reduced Arun
+    const matData_t c2 = options.kernelWidth * options.kernelWidth;
 
-    // Initialize Jacobian and Hessian
-    Mat61 J = Mat61::Zero();
-    Mat6 H = Mat6::Zero();
-    uint_t iters = 0;
-    double deltaUpdate = 1e3;
-    do
+    auto evaluate = [&](const SE3 &T, Mat61 &J, Mat6 &H, uint_t &inliers) -> double
     {
-        J.setZero();
-        H.setZero();
-        // not vectoried operations (due to Jacobian)
-        for ( uint_t i = 0; i < N ; ++i)
+        switch (options.kernel)
         {
-            // 1) Calculate residual r = y - Tx and the inverse of joint covariance
-            Mat31 Txi = T.transform(X.row(i));
-            Mat31 r = Y.row(i).transpose() - Txi;
-
-            // 2) Calculate Jacobian for residual Jf = df/d xi = w * r' Jr, where Jr = [(Tx)^ ; -I])
-            Mat<3,6> Jr;
-            Jr << hat3(Txi) , -Mat3::Identity();
-            Mat<1,6> Ji = weight(i) * r.transpose() * Jr;
-            J += Ji;//Eigen manages this for us
-
-            // 3) Hessian Hi ~ w * Jr' * Jr
-            Mat6 Hi = weight(i) * Jr.transpose() * Jr;
-            H += Hi;
+            case HUBER:
+                return weighted_point_evaluate<HUBER>(X, Y, weight, T, c2, J, H, inliers);
+            case CAUCHY:
+                return weighted_point_evaluate<CAUCHY>(X, Y, weight, T, c2, J, H, inliers);
+            case GEMAN_MCCLURE:
+                return weighted_point_evaluate<GEMAN_MCCLURE>(X, Y, weight, T, c2, J, H, inliers);
+            default:
+                return weighted_point_evaluate<QUADRATIC>(X, Y, weight, T, c2, J, H, inliers);
         }
-        // 4) Update Solution
-        Mat61 dxi = -H.inverse()*J;
-        T.update_lhs(dxi); //Left side update
-        deltaUpdate = dxi.norm();
-        iters++;
-
-    }while(deltaUpdate > tol && iters < 20);
+    };
 
-    return iters; // number of iterations
+    return solve_registration(evaluate, T, X.rows(), options);
 }
@@ -44,6 +44,9 @@ typedef Eigen::Matrix<matData_t, 5,5, Eigen::RowMajor> Mat5;
 typedef Eigen::Matrix<matData_t, 6,6, Eigen::RowMajor> Mat6;
 typedef Eigen::Matrix<matData_t, Eigen::Dynamic,Eigen::Dynamic, Eigen::RowMajor> MatX;
 
+// Integer matrices, for indexes
+typedef Eigen::Matrix<int, Eigen::Dynamic,Eigen::Dynamic, Eigen::RowMajor> MatXi;
+
 //Sparse Matrices
 typedef Eigen::SparseMatrix<matData_t, Eigen::ColMajor> SMatCol;
 typedef Eigen::SparseMatrix<matData_t, Eigen::RowMajor> SMatRow;
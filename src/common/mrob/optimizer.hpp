@@ -25,6 +25,10 @@
 #define OPTIMIZER_HPP_
 
 #include "mrob/matrix_base.hpp"
+#include <Eigen/Cholesky>
+#include <Eigen/SparseCholesky>
+#include <Eigen/Eigenvalues>
+#include <vector>
 
 namespace mrob{
 
@@ -44,9 +48,29 @@ namespace mrob{
  *         x' = x - (H + lambda * I)^-1 * gradient
  *  - Levenberg-Marquardt: Elliptical approximation
  *         x' = x - (H + lambda * D)^-1 * gradient, where D = diag(H)
+ *  - L-BFGS: quasi-Newton, first order method. The inverse Hessian is approximated
+ *    from the last m gradient differences and the step is calculated by a line search
+ *    satisfying the strong Wolfe conditions (c1_, c2_).
+ *  - Nonlinear Conjugate Gradient (Polak-Ribiere+), first order method, with the same line search.
+ *
+ *  First order methods never build a Hessian, they only require calculate_error()
+ *  and calculate_gradient().
  *
  *  given the following requirements:
  *  - C(x): a Cost function
+ *
+ * The inverse of the Hessian is never calculated explicitly. The linear system
+ * (H + lambda * D) dx = - gradient is solved by a factorization, according to the
+ * linear solver selected (see linearSolver). The subclass fills either the dense
+ * hessian_ or, for large sparse problems, hessianSparse_ (leaving hessian_ empty),
+ * see FGraphSolveDense. A dense Hessian is converted when the sparse solver is selected.
+ *
+ * On LM, when a step is rejected the Hessian and the gradient are not recalculated,
+ * since the state is the same. For a dense Hessian, the eigendecomposition of the
+ * undamped Hessian (scaled by D^-1/2 on the elliptical LM) is calculated on the first
+ * rejection, so each further lambda is an O(n^2) solve instead of a new O(n^3)
+ * factorization. The sparse solver refactorizes numerically the damped Hessian, reusing
+ * its symbolic analysis.
  */
 
 
@@ -58,18 +82,66 @@ public:
 	 *  - NR: Newton-Raphson (Gauss_newtow is a variant with approximations in the Hessian)
 	 *  - LM_S: Levenberg Marquardt: Spherical
 	 *  - LM_E: Levenberg Marquardt: Eliptical
+	 *  - LBFGS: Limited memory BFGS, first order
+	 *  - NONLINEAR_CG: Nonlinear Conjugate Gradient, first order
 	 */
-	enum optimMethod{NEWTON_RAPHSON=0, LEVENBERG_MARQUARDT_SPHER, LEVENBERG_MARQUARDT_ELLIP};
+	enum optimMethod{NEWTON_RAPHSON=0, LEVENBERG_MARQUARDT_SPHER, LEVENBERG_MARQUARDT_ELLIP, LBFGS, NONLINEAR_CG};
+	/**
+	 * This enums the linear solvers for calculating the step dx:
+	 *  - DENSE_LDLT: (default) robust Cholesky, valid for semi-definite Hessians
+	 *  - DENSE_CHOLESKY: LLT, faster but requires a positive definite Hessian.
+	 *    If the factorization fails, it falls back to LDLT.
+	 *  - SPARSE_LDLT: simplicial LDLT on the sparse Hessian. The ordering and symbolic
+	 *    factorization are only calculated when the sparsity pattern of the Hessian changes.
+	 */
+	enum linearSolver{DENSE_LDLT=0, DENSE_CHOLESKY, SPARSE_LDLT};
     Optimizer(matData_t solutionTolerance = 1e-4, matData_t lambda = 1e-5);
     virtual ~Optimizer();
 
     /**
      * Optimization call.
-     * Input: optmization method from {NR=0, LM_S, LM_E}
+     * Input: optmization method from {NR=0, LM_S, LM_E, LBFGS, NONLINEAR_CG}
      * output: number of iterations
      */
     uint_t optimize(optimMethod method, double lambda = 1e-5);
 
+    /**
+     * Parameters for the line search, strong Wolfe conditions:
+     *   sufficient decrease C(x + a*d) <= C(x) + c1 * a * grad'd
+     *   curvature           |grad(x + a*d)'d| <= c2 * |grad'd|
+     * with 0 < c1 < c2 < 1. For nonlinear CG the curvature parameter is at most 0.1.
+     */
+    void set_wolfe_parameters(matData_t c1, matData_t c2) {c1_ = c1; c2_ = c2;}
+    /**
+     * Number of pairs of gradient differences stored by L-BFGS, it must be positive,
+     * otherwise throws std::invalid_argument
+     */
+    void set_lbfgs_memory(uint_t m);
+    /**
+     * Maximum number of iterations of all the methods (100 by default)
+     */
+    void set_max_iterations(uint_t maxIters) {maxIters_ = maxIters;}
+    /**
+     * Prints a message when LM does not converge (false by default). Otherwise, non
+     * convergence is reported by the number of iterations returned, equal to the maximum.
+     */
+    void set_verbose(bool verbose) {verbose_ = verbose;}
+
+    /**
+     * Sets the linear solver used at each iteration (see linearSolver)
+     */
+    void set_linear_solver(linearSolver solver) {linearSolver_ = solver;}
+    linearSolver get_linear_solver() const {return linearSolver_;}
+
+    /**
+     * Trust region update of the LM damping (Bertsekas p.105), shared by all LM implementations.
+     * Input: decrease of the error after the step, and the decrease predicted by the damped
+     * quadratic model -dx'*grad - 0.5*dx'*(H + lambda*D)*dx. When the error does not decrease
+     * the step is rejected and the model is not used.
+     * Output: the new lambda
+     */
+    static matData_t update_lambda(matData_t lambda, matData_t errorDecrease, matData_t modelDecrease);
+
     /**
      * General abstract functions to implement:
      * Calculate error calculates the current error function
@@ -85,6 +157,13 @@ public:
      *    inside the update_bookkeep_state which will have invalid residuals and need update (less prefered option)
      */
     virtual void calculate_gradient_hessian() = 0;
+    /**
+     * Calculates only the gradient, for first order methods (L-BFGS, CG).
+     * It is called after calculate_error() on the same state.
+     * By default it calculates the Hessian as well, subclasses should override
+     * it to avoid building the Hessian.
+     */
+    virtual void calculate_gradient() {calculate_gradient_hessian();}
     /**
      * Updates the current solution
      */
@@ -97,7 +176,8 @@ public:
     virtual void bookkeep_state() = 0;
     /**
      * For Levenberg-Marquard
-     * Undoes an incorrect update
+     * Undoes an incorrect update. Only the state is restored, the optimizer
+     * calls calculate_error() on it before using any evaluation of the subclass
      */
     virtual void update_state_from_bookkeep() = 0;
 
@@ -118,6 +198,29 @@ protected:
      */
     uint_t optimize_newton_raphson_one_iteration(bool useLambda = false);
 
+    /**
+     * Calculates the step dx = - (H + lambda * D)^-1 * grad by factorizing
+     * the Hessian, according to the linear solver selected.
+     *
+     * Input newHessian indicates that the Hessian has been recalculated. Otherwise, the
+     * Hessian is from a previous call (LM rejected step) and its diagonal is restored
+     * before damping it again. In that case, a dense Hessian is not factorized again
+     * but solved by solve_step_eigen(). The sparse Hessian is refactorized.
+     */
+    void solve_step(bool useLambda, bool newHessian = true);
+    /**
+     * Solves the damped step from the eigendecomposition of the undamped dense Hessian,
+     * calculated once per Hessian, in O(n^2) for each lambda.
+     * Output: false if the damped Hessian is not positive definite (or the elliptical
+     * scaling is not defined), then the step must be solved by a factorization.
+     */
+    bool solve_step_eigen();
+    /**
+     * Compares the sparsity pattern of hessianSparse_ (compressed) with the pattern
+     * of the last symbolic factorization.
+     */
+    bool sparse_pattern_changed() const;
+
     /**
      * Levenberg-Marquardt method, inside will distinguish between elliptic and spherical
      *
@@ -126,15 +229,63 @@ protected:
      */
     uint_t optimize_levenberg_marquardt();
 
+    /**
+     * L-BFGS with a line search. The direction is calculated by the two-loop
+     * recursion over the last lbfgsMemory_ pairs (s,y).
+     */
+    uint_t optimize_lbfgs();
+
+    /**
+     * Nonlinear Conjugate Gradient, Polak-Ribiere+, with restart when the
+     * direction is not descent.
+     */
+    uint_t optimize_nonlinear_cg();
+
+    /**
+     * Line search along the direction d, satisfying the strong Wolfe conditions,
+     * by bracketing and zoom (Nocedal-Wright, Alg. 3.5 and 3.6).
+     * Input: error and gradient at the current state (before the step), direction,
+     *        initial step and curvature parameter.
+     * Output: the step alpha (0 if no step was found). The state is updated to
+     *         x + alpha * d, with error and gradient_ evaluated there.
+     */
+    matData_t line_search(matData_t &error, const MatX1 &gradient, const MatX1 &d, matData_t alphaInit, matData_t c2);
+
+    /**
+     * Evaluates the error at x + alpha * d, from the bookkept state x
+     */
+    matData_t evaluate_step(matData_t alpha, const MatX1 &d);
+
 
     optimMethod optimization_method_;
+    linearSolver linearSolver_;
     matData_t solutionTolerance_;
     MatX1 gradient_, dx_;
     MatX hessian_;
+    SMatCol hessianSparse_;
+    // Undamped diagonal of the Hessian, for reusing the Hessian on LM
+    MatX1 hessianDiagonal_;
+
+    // Factorizations are kept as members, so their memory and the sparse structure are reused
+    Eigen::LDLT<MatX> ldlt_;
+    Eigen::LLT<MatX> llt_;
+    Eigen::SimplicialLDLT<SMatCol, Eigen::Lower, Eigen::AMDOrdering<SMatCol::StorageIndex>> sparseLdlt_;
+    // Sparsity pattern (compressed outer and inner indexes) of the last symbolic factorization
+    std::vector<SMatCol::StorageIndex> sparsePatternOuter_, sparsePatternInner_;
+    // Eigendecomposition V*Lambda*V' of the scaled undamped Hessian S*H*S, S the diagonal eigenScale_,
+    // and V'*S*grad, valid while the Hessian does not change (LM rejected steps)
+    Eigen::SelfAdjointEigenSolver<MatX> eigen_;
+    MatX1 eigenScale_, eigenGradient_;
+    bool eigenValid_;
 
     // Necessary for LM, Other LM parameters are set to default (see .cpp)
     matData_t lambda_;
 
+    // First order methods
+    matData_t c1_, c2_;
+    uint_t lbfgsMemory_, maxIters_;
+    bool verbose_;
+
 };
 }
 
@@ -22,13 +22,18 @@
  */
 
 #include "mrob/optimizer.hpp"
-#include <Eigen/LU> // for inverse and determinant
 #include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 using namespace mrob;
 
 Optimizer::Optimizer(matData_t solutionTolerance, matData_t lambda) :
-        solutionTolerance_(solutionTolerance), lambda_(lambda)
+        linearSolver_(DENSE_LDLT), solutionTolerance_(solutionTolerance),
+        eigenValid_(false), lambda_(lambda),
+        c1_(1e-4), c2_(0.9), lbfgsMemory_(10), maxIters_(100), verbose_(false)
 {
 
 }
@@ -38,6 +43,13 @@ Optimizer::~Optimizer()
 
 }
 
+void Optimizer::set_lbfgs_memory(uint_t m)
+{
+    if (m == 0)
+        throw std::invalid_argument("Optimizer::set_lbfgs_memory: memory must be positive");
+    lbfgsMemory_ = m;
+}
+
 
  uint_t Optimizer::optimize(optimMethod method, double lambda)
 {
@@ -50,6 +62,10 @@ Optimizer::~Optimizer()
       case LEVENBERG_MARQUARDT_ELLIP:
           lambda_ = lambda;
           return optimize_levenberg_marquardt();
+      case LBFGS:
+          return optimize_lbfgs();
+      case NONLINEAR_CG:
+          return optimize_nonlinear_cg();
     }
     return 0;
 }
@@ -59,26 +75,124 @@ uint_t Optimizer::optimize_newton_raphson_one_iteration(bool useLambda)
 {
     // 1) build problem: Gradient and Hessian and re-evaluates
     calculate_gradient_hessian();
-    if (useLambda)
+
+    // 2) dx = - (H + lambda * D)^-1 * grad, by factorization
+    solve_step(useLambda);
+
+    // 3) update the solution
+    this->update_state(dx_);
+
+    return 1;
+}
+
+void Optimizer::solve_step(bool useLambda, bool newHessian)
+{
+    // 1) select the Hessian to factorize. Subclasses providing only a dense Hessian (hessian_ not empty)
+    //    are converted if the sparse solver is required
+    bool sparse = linearSolver_ == SPARSE_LDLT;
+    if (sparse && newHessian && hessian_.size() > 0)
+        hessianSparse_ = hessian_.sparseView();
+
+    // 2) bookkeep or restore the undamped diagonal and add the damping factor
+    uint_t N = sparse ? hessianSparse_.rows() : hessian_.rows();
+    if (newHessian)
+    {
+        hessianDiagonal_ = sparse ? MatX1(hessianSparse_.diagonal()) : MatX1(hessian_.diagonal());
+        eigenValid_ = false;
+    }
+    if (useLambda || !newHessian)
     {
-        if (optimization_method_ == LEVENBERG_MARQUARDT_SPHER)
+        for (uint_t i = 0; i < N ; ++i)
         {
-            for (uint_t i = 0; i < hessian_.diagonalSize() ; ++i)
-                hessian_(i,i) += lambda_;
+            matData_t d = hessianDiagonal_(i);
+            if (useLambda && optimization_method_ == LEVENBERG_MARQUARDT_SPHER)
+                d += lambda_;
+            if (useLambda && optimization_method_ == LEVENBERG_MARQUARDT_ELLIP)
+                d *= 1.0 + lambda_;
+            if (sparse)
+                hessianSparse_.coeffRef(i,i) = d;
+            else
+                hessian_(i,i) = d;
         }
+    }
+
+    // 3) LM retry on the same dense Hessian: only the damping has changed, solved from its eigendecomposition
+    if (useLambda && !newHessian && !sparse && solve_step_eigen())
+        return;
+
+    // 4) factorize and solve. LLT falls back to LDLT if the Hessian is not positive definite
+    bool denseLdlt = false;
+    switch(linearSolver_)
+    {
+      case DENSE_CHOLESKY:
+        llt_.compute(hessian_);
+        if (llt_.info() == Eigen::Success)
+            dx_ = - llt_.solve(gradient_);
+        else
+            denseLdlt = true;
+        break;
+      case DENSE_LDLT:
+        denseLdlt = true;
+        break;
+      case SPARSE_LDLT:
+        // the ordering and symbolic decomposition are only recalculated if the sparsity pattern changes
+        hessianSparse_.makeCompressed();
+        if (sparse_pattern_changed())
+        {
+            sparseLdlt_.analyzePattern(hessianSparse_);
+            sparsePatternOuter_.assign(hessianSparse_.outerIndexPtr(), hessianSparse_.outerIndexPtr() + N + 1);
+            sparsePatternInner_.assign(hessianSparse_.innerIndexPtr(), hessianSparse_.innerIndexPtr() + hessianSparse_.nonZeros());
+        }
+        sparseLdlt_.factorize(hessianSparse_);
+        dx_ = - sparseLdlt_.solve(gradient_);
+        break;
+    }
+    if (denseLdlt)
+    {
+        ldlt_.compute(hessian_);
+        dx_ = - ldlt_.solve(gradient_);
+    }
+}
+
+bool Optimizer::solve_step_eigen()
+{
+    if (!eigenValid_)
+    {
+        // Undamped Hessian, scaled by S = D^-1/2 for the elliptical damping (S = I for the spherical), so
+        // in both cases H + lambda * D = S^-1 * V * (Lambda + lambda * I) * V' * S^-1
+        const uint_t N = hessian_.rows();
         if (optimization_method_ == LEVENBERG_MARQUARDT_ELLIP)
         {
-            for (uint_t i = 0; i < hessian_.diagonalSize() ; ++i)
-                hessian_(i,i) *= 1.0 + lambda_;
+            if ((hessianDiagonal_.array() <= 0.0).any())
+                return false;
+            eigenScale_ = hessianDiagonal_.cwiseSqrt().cwiseInverse();
         }
+        else
+            eigenScale_.setOnes(N);
+        MatX scaledHessian = eigenScale_.asDiagonal() * hessian_ * eigenScale_.asDiagonal();
+        scaledHessian.diagonal() = eigenScale_.cwiseProduct(hessianDiagonal_).cwiseProduct(eigenScale_);
+        eigen_.compute(scaledHessian);
+        if (eigen_.info() != Eigen::Success)
+            return false;
+        eigenGradient_ = eigen_.eigenvectors().transpose() * eigenScale_.cwiseProduct(gradient_);
+        eigenValid_ = true;
     }
 
-    // 2) dx = - h^-1 * grad XXX test for singularities?
-    dx_ = - hessian_.inverse() * gradient_;
-    // 3) update the solution
-    this->update_state(dx_);
+    // dx = - S * V * (Lambda + lambda * I)^-1 * V' * S * grad, if the damped system is positive definite
+    MatX1 damped = eigen_.eigenvalues().array() + lambda_;
+    if (damped.minCoeff() <= 0.0)
+        return false;
+    dx_ = - eigenScale_.cwiseProduct(eigen_.eigenvectors() * eigenGradient_.cwiseQuotient(damped));
+    return true;
+}
 
-    return 1;
+bool Optimizer::sparse_pattern_changed() const
+{
+    const uint_t N = hessianSparse_.cols();
+    if (sparsePatternOuter_.size() != N + 1 || sparsePatternInner_.size() != (uint_t)hessianSparse_.nonZeros())
+        return true;
+    return !std::equal(sparsePatternOuter_.begin(), sparsePatternOuter_.end(), hessianSparse_.outerIndexPtr()) ||
+           !std::equal(sparsePatternInner_.begin(), sparsePatternInner_.end(), hessianSparse_.innerIndexPtr());
 }
 
 uint_t Optimizer::optimize_newton_raphson()
@@ -94,27 +208,43 @@ uint_t Optimizer::optimize_newton_raphson()
         diff_error = previous_error - current_error;
         previous_error = current_error;
         iters++;
-    }while(fabs(diff_error) > solutionTolerance_ && iters < 1e2);
+    }while(fabs(diff_error) > solutionTolerance_ && iters < maxIters_);
 
 
     return iters;
 }
 
-uint_t Optimizer::optimize_levenberg_marquardt()
+matData_t Optimizer::update_lambda(matData_t lambda, matData_t errorDecrease, matData_t modelDecrease)
 {
     // LM trust region as described in Bertsekas (p.105)
     // sigma reference to the fidelity of the model at the proposed solution \in [0,1]
-    matData_t sigma1(0.25), sigma2(0.8);// 0 < sigma1 < sigma2 < 1
-    matData_t beta1(2.0), beta2(0.25); // lambda updates multiplier values, beta1 > 1 > beta2 >0
+    const matData_t sigma1(0.25), sigma2(0.8);// 0 < sigma1 < sigma2 < 1
+    const matData_t beta1(2.0), beta2(0.25); // lambda updates multiplier values, beta1 > 1 > beta2 >0
+    if (errorDecrease < 0)
+        return lambda * beta1;
+    matData_t modelFidelity = errorDecrease / modelDecrease;
+    if (modelFidelity < sigma1)
+        return lambda * beta1;
+    if (modelFidelity > sigma2)
+        return lambda * beta2;
+    return lambda;
+}
+
+uint_t Optimizer::optimize_levenberg_marquardt()
+{
     uint_t iters = 0;
     matData_t previous_error = calculate_error(), diff_error, current_error;
-    bool improvement; // variable for controlling when no update is done and number of iterations is exceeded.
+    bool improvement = true; // variable for controlling when no update is done and number of iterations is exceeded.
     do
     {
         iters++;
-        // 1) solve the current subproblem by Newton Raphson
+        // 1) solve the current subproblem by Newton Raphson. If the previous step was rejected, the
+        //    state has not changed and the Hessian and gradient are reused, only the damping is new.
         this->bookkeep_state();
-        optimize_newton_raphson_one_iteration(true);
+        if (improvement)
+            calculate_gradient_hessian();
+        solve_step(true, improvement);
+        this->update_state(dx_);
         current_error = calculate_error();
         //std::cout << "iter " << iters << ", error = " << current_error << ", lambda = "<< lambda_ << std::endl;
         diff_error = previous_error - current_error;
@@ -124,7 +254,7 @@ uint_t Optimizer::optimize_levenberg_marquardt()
         if (diff_error < 0)
         {
             //std::cout << "no improvement\n";
-            lambda_ *= beta1;
+            lambda_ = update_lambda(lambda_, diff_error, 0.0);
             this->update_state_from_bookkeep();
             improvement = false;
             continue;
@@ -140,27 +270,208 @@ uint_t Optimizer::optimize_levenberg_marquardt()
         //     err(x_k) - m_k(dx)
         // where m_k is the quadratized model m_k(dx) = err(x_k) + dx'*Grad r + 0.5 dx'(Hessian + LM)dx
         // => f = d err / (-dx'*Grad r - 0.5 dx'(Hessian + LM)dx)
-        matData_t modelFidelity = diff_error / (-dx_.dot(gradient_) - 0.5*dx_.dot(hessian_* dx_));
-
+        matData_t quadraticTerm = linearSolver_ == SPARSE_LDLT ? dx_.dot(hessianSparse_* dx_) : dx_.dot(hessian_* dx_);
 
         // 4) update lambda
-        if (modelFidelity < sigma1)
-            lambda_ *= beta1;
-        if (modelFidelity > sigma2)
-            lambda_ *= beta2;
+        lambda_ = update_lambda(lambda_, diff_error, -dx_.dot(gradient_) - 0.5*quadraticTerm);
 
-    }while(iters < 1e2);
+    }while(iters < maxIters_);
 
     if (!improvement)
     {
         this->update_state_from_bookkeep();//If no improvement shown, undo again
+        calculate_error();// the subclass is evaluated on the restored state (residuals, planes)
     }
 
 
-    // output
-    std::cout << "Optimizer::optimize_levenberg_marquardt: failed to converge after "
-              << iters << " iterations and error " << calculate_error()
-              << std::endl;
+    // output, only if requested. Solvers running concurrently (FGraphSolveBatch) would interleave it
+    if (verbose_)
+        std::cout << "Optimizer::optimize_levenberg_marquardt: failed to converge after "
+                  << iters << " iterations and error " << calculate_error()
+                  << std::endl;
 
     return iters;
 }
+
+uint_t Optimizer::optimize_lbfgs()
+{
+    uint_t iters = 0;
+    matData_t error = calculate_error(), previous_error;
+    calculate_gradient();
+    MatX1 gradient = gradient_, d;
+    // circular memory of pairs s_k = x_k+1 - x_k, y_k = grad_k+1 - grad_k
+    std::vector<MatX1> s, y;
+    std::vector<matData_t> rho, alpha(lbfgsMemory_);
+    uint_t first = 0;
+    do
+    {
+        iters++;
+        // 1) direction d = - H_k * grad by the two-loop recursion
+        d = -gradient;
+        uint_t m = s.size();
+        for (uint_t i = 0; i < m; ++i)
+        {
+            uint_t k = (first + m - 1 - i) % m;
+            alpha[k] = rho[k] * s[k].dot(d);
+            d -= alpha[k] * y[k];
+        }
+        if (m > 0)
+        {
+            uint_t last = (first + m - 1) % m;
+            d *= s[last].dot(y[last]) / y[last].squaredNorm();
+        }
+        for (uint_t i = 0; i < m; ++i)
+        {
+            uint_t k = (first + i) % m;
+            matData_t beta = rho[k] * y[k].dot(d);
+            d += (alpha[k] - beta) * s[k];
+        }
+        // not a descent direction, restart memory
+        if (d.dot(gradient) >= 0)
+        {
+            d = -gradient;
+            s.clear(); y.clear(); rho.clear();
+            first = 0;
+        }
+
+        // 2) line search, the first step is scaled if there is no curvature information
+        matData_t alphaInit = s.empty() ? std::min(1.0, 1.0 / gradient.norm()) : 1.0;
+        previous_error = error;
+        matData_t step = line_search(error, gradient, d, alphaInit, c2_);
+        if (step == 0.0)
+            break;
+
+        // 3) update memory
+        MatX1 sk = step * d, yk = gradient_ - gradient;
+        matData_t sy = sk.dot(yk);
+        if (sy > 1e-12 * sk.norm() * yk.norm())
+        {
+            if (s.size() < lbfgsMemory_)
+            {
+                s.push_back(sk); y.push_back(yk); rho.push_back(1.0 / sy);
+            }
+            else
+            {
+                s[first] = sk; y[first] = yk; rho[first] = 1.0 / sy;
+                first = (first + 1) % lbfgsMemory_;
+            }
+        }
+        gradient = gradient_;
+    }while(std::fabs(previous_error - error) > solutionTolerance_ && iters < maxIters_);
+
+    return iters;
+}
+
+uint_t Optimizer::optimize_nonlinear_cg()
+{
+    uint_t iters = 0;
+    matData_t error = calculate_error(), previous_error;
+    calculate_gradient();
+    MatX1 gradient = gradient_, d = -gradient_;
+    matData_t step = std::min(1.0, 1.0 / gradient.norm());
+    // curvature condition for CG requires c2 < 1/2, recommended 0.1
+    matData_t c2 = std::min(c2_, 0.1);
+    do
+    {
+        iters++;
+        // 1) line search, initial step from the previous one (Nocedal-Wright eq. 3.60)
+        previous_error = error;
+        matData_t descent = gradient.dot(d);
+        step = line_search(error, gradient, d, step, c2);
+        if (step == 0.0)
+            break;
+
+        // 2) new direction by Polak-Ribiere+
+        matData_t beta = std::max(0.0, gradient_.dot(gradient_ - gradient) / gradient.squaredNorm());
+        d = -gradient_ + beta * d;
+        if (gradient_.dot(d) >= 0)
+            d = -gradient_;
+        step *= descent / gradient_.dot(d);
+        gradient = gradient_;
+    }while(std::fabs(previous_error - error) > solutionTolerance_ && iters < maxIters_);
+
+    return iters;
+}
+
+matData_t Optimizer::evaluate_step(matData_t alpha, const MatX1 &d)
+{
+    this->update_state_from_bookkeep();
+    dx_ = alpha * d;
+    this->update_state(dx_);
+    return calculate_error();
+}
+
+matData_t Optimizer::line_search(matData_t &error, const MatX1 &gradient, const MatX1 &d, matData_t alphaInit, matData_t c2)
+{
+    const uint_t maxEvaluations = 20;
+    const matData_t error0 = error, descent0 = gradient.dot(d);
+    this->bookkeep_state();
+
+    // Zoom between alphaLo (satisfies sufficient decrease) and alphaHi
+    auto zoom = [&](matData_t alphaLo, matData_t errorLo, matData_t descentLo, matData_t alphaHi, matData_t errorHi) -> matData_t
+    {
+        for (uint_t j = 0; j < maxEvaluations; ++j)
+        {
+            // quadratic interpolation, safeguarded to the inner part of the interval, otherwise bisection
+            matData_t delta = alphaHi - alphaLo;
+            matData_t alpha = alphaLo - 0.5 * descentLo * delta * delta / (errorHi - errorLo - descentLo * delta);
+            matData_t low = std::min(alphaLo, alphaHi), high = std::max(alphaLo, alphaHi);
+            if (!std::isfinite(alpha) || alpha < low + 0.1 * (high - low) || alpha > high - 0.1 * (high - low))
+                alpha = 0.5 * (alphaLo + alphaHi);
+
+            matData_t errorAlpha = evaluate_step(alpha, d);
+            if (errorAlpha > error0 + c1_ * alpha * descent0 || errorAlpha >= errorLo)
+            {
+                alphaHi = alpha;
+                errorHi = errorAlpha;
+            }
+            else
+            {
+                calculate_gradient();
+                matData_t descent = gradient_.dot(d);
+                if (std::fabs(descent) <= -c2 * descent0)
+                {
+                    error = errorAlpha;
+                    return alpha;
+                }
+                if (descent * (alphaHi - alphaLo) >= 0)
+                {
+                    alphaHi = alphaLo;
+                    errorHi = errorLo;
+                }
+                alphaLo = alpha;
+                errorLo = errorAlpha;
+                descentLo = descent;
+            }
+        }
+        // Curvature not satisfied, the best step with sufficient decrease is used (or none)
+        error = evaluate_step(alphaLo, d);
+        calculate_gradient();
+        return alphaLo;
+    };
+
+    // Bracketing phase
+    matData_t alphaPrev = 0.0, errorPrev = error0, descentPrev = descent0, alpha = alphaInit;
+    for (uint_t i = 0; i < maxEvaluations; ++i)
+    {
+        matData_t errorAlpha = evaluate_step(alpha, d);
+        if (errorAlpha > error0 + c1_ * alpha * descent0 || (i > 0 && errorAlpha >= errorPrev))
+            return zoom(alphaPrev, errorPrev, descentPrev, alpha, errorAlpha);
+        calculate_gradient();
+        matData_t descent = gradient_.dot(d);
+        if (std::fabs(descent) <= -c2 * descent0)
+        {
+            error = errorAlpha;
+            return alpha;
+        }
+        if (descent >= 0)
+            return zoom(alpha, errorAlpha, descent, alphaPrev, errorPrev);
+        alphaPrev = alpha;
+        errorPrev = errorAlpha;
+        descentPrev = descent;
+        alpha *= 2.0;
+    }
+    error = evaluate_step(alphaPrev, d);
+    calculate_gradient();
+    return alphaPrev;
+}